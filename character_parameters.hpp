@@ -26,6 +26,24 @@ private:
     void _ledge_hang_set(bool value) { _settings.ledge_hang = value; }
     bool _ledge_hang_get() {  return _settings.ledge_hang; }
 
+    void _cost_up_set(int value) { _settings.costs.up = Math::abs(value); }
+    int _cost_up_get() { return _settings.costs.up; }
+
+    void _cost_down_set(int value) { _settings.costs.down = Math::abs(value); }
+    int _cost_down_get() { return _settings.costs.down; }
+
+    void _cost_level_set(int value) { _settings.costs.level = Math::abs(value); }
+    int _cost_level_get() { return _settings.costs.level; }
+
+    void _cost_ledge_climb_set(int value) { _settings.costs.ledge_climb = Math::abs(value); }
+    int _cost_ledge_climb_get() { return _settings.costs.ledge_climb; }
+
+    void _cost_character_set(int value) { _settings.costs.character = Math::abs(value); }
+    int _cost_character_get() { return _settings.costs.character; }
+
+    void _cost_hazard_set(int value) { _settings.costs.hazard = Math::abs(value); }
+    int _cost_hazard_get() { return _settings.costs.hazard; }
+
 protected:
     static void _bind_methods() {
         ClassDB::bind_method(D_METHOD("max_jump_height_set", "value"), &CharacterParameters::_max_jump_height_set);
@@ -43,12 +61,38 @@ protected:
         ClassDB::bind_method(D_METHOD("ledge_hang_set", "value"), &CharacterParameters::_ledge_hang_set);
         ClassDB::bind_method(D_METHOD("ledge_hang_get"), &CharacterParameters::_ledge_hang_get);
 
+        ClassDB::bind_method(D_METHOD("cost_up_set", "value"), &CharacterParameters::_cost_up_set);
+        ClassDB::bind_method(D_METHOD("cost_up_get"), &CharacterParameters::_cost_up_get);
+
+        ClassDB::bind_method(D_METHOD("cost_down_set", "value"), &CharacterParameters::_cost_down_set);
+        ClassDB::bind_method(D_METHOD("cost_down_get"), &CharacterParameters::_cost_down_get);
+
+        ClassDB::bind_method(D_METHOD("cost_level_set", "value"), &CharacterParameters::_cost_level_set);
+        ClassDB::bind_method(D_METHOD("cost_level_get"), &CharacterParameters::_cost_level_get);
+
+        ClassDB::bind_method(D_METHOD("cost_ledge_climb_set", "value"), &CharacterParameters::_cost_ledge_climb_set);
+        ClassDB::bind_method(D_METHOD("cost_ledge_climb_get"), &CharacterParameters::_cost_ledge_climb_get);
+
+        ClassDB::bind_method(D_METHOD("cost_character_set", "value"), &CharacterParameters::_cost_character_set);
+        ClassDB::bind_method(D_METHOD("cost_character_get"), &CharacterParameters::_cost_character_get);
+
+        ClassDB::bind_method(D_METHOD("cost_hazard_set", "value"), &CharacterParameters::_cost_hazard_set);
+        ClassDB::bind_method(D_METHOD("cost_hazard_get"), &CharacterParameters::_cost_hazard_get);
+
         ADD_PROPERTY(PropertyInfo(Variant::INT, "max_jump_height", PROPERTY_HINT_RANGE, "0"), "max_jump_height_set", "max_jump_height_get");
         ADD_PROPERTY(PropertyInfo(Variant::INT, "air_stride", PROPERTY_HINT_RANGE, "1"), "air_stride_set", "air_stride_get");
         ADD_PROPERTY(PropertyInfo(Variant::INT, "width", PROPERTY_HINT_RANGE, "1"), "width_set", "width_get");
         ADD_PROPERTY(PropertyInfo(Variant::INT, "height", PROPERTY_HINT_RANGE, "1"), "height_set", "height_get");
 
         ADD_PROPERTY(PropertyInfo(Variant::BOOL, "ledge_hang", PROPERTY_HINT_NONE), "ledge_hang_set", "ledge_hang_get");
+
+        ADD_GROUP("Costs", "cost_");
+        ADD_PROPERTY(PropertyInfo(Variant::INT, "cost_up", PROPERTY_HINT_RANGE, "0"), "cost_up_set", "cost_up_get");
+        ADD_PROPERTY(PropertyInfo(Variant::INT, "cost_down", PROPERTY_HINT_RANGE, "0"), "cost_down_set", "cost_down_get");
+        ADD_PROPERTY(PropertyInfo(Variant::INT, "cost_level", PROPERTY_HINT_RANGE, "0"), "cost_level_set", "cost_level_get");
+        ADD_PROPERTY(PropertyInfo(Variant::INT, "cost_ledge_climb", PROPERTY_HINT_RANGE, "0"), "cost_ledge_climb_set", "cost_ledge_climb_get");
+        ADD_PROPERTY(PropertyInfo(Variant::INT, "cost_character", PROPERTY_HINT_RANGE, "0"), "cost_character_set", "cost_character_get");
+        ADD_PROPERTY(PropertyInfo(Variant::INT, "cost_hazard", PROPERTY_HINT_RANGE, "0"), "cost_hazard_set", "cost_hazard_get");
     }
 
 public:
@@ -3,35 +3,56 @@
 #include <algorithm>
 #include <vector>
 
+#include "core/os/os.h"
+#include "core/project_settings.h"
 #include "core/script_language.h"
 
-struct less_than_closest_point {
-    const pathfinding::Graph& _graph;
-    const pathfinding::Settings& _settings;
-    Vector2 _point;
-    bool _prefer_floors;
-    
-    less_than_closest_point(const pathfinding::Graph& graph, const pathfinding::Settings& settings, Vector2 point, bool prefer_floors)
-    : _graph(graph), _settings(settings), _point(point), _prefer_floors(prefer_floors) {}
-
-    inline bool operator()(const Vector2& v1, const Vector2& v2) {
-        if (_prefer_floors) {
-            bool v1_on_floor = _graph.on_floor(_settings, v1.x, v1.y);
-            bool v2_on_floor = _graph.on_floor(_settings, v2.x, v2.y);
-            if (v1_on_floor != v2_on_floor) return v1_on_floor;
-        }
+#include "pathfinding/free_cells.hpp"
+#include "pathfinding/rasterize.hpp"
+
+GriddedGraph::GriddedGraph() : _grid(RES()) {
+    _grid.instance();
+    _streaming = false;
+    _page_loads_per_frame = 4;
+    _version = 0;
+    _coarse_version = 0;
+    _coarse_built = false;
+    _refresh_in_background = false;
+
+    _paged.source_set([this](int32_t page_x, int32_t page_y, pathfinding::PageRef& page) {
+        return _load_page(page_x, page_y, page);
+    });
+}
 
-        float delta1 = (v1 - _point).abs().dot(Vector2(1, 1));
-        float delta2 = (v2 - _point).abs().dot(Vector2(1, 1));
-        return delta1 < delta2;
-    }
-};
+GriddedGraph::~GriddedGraph() {
+    _cancel_build();
+}
 
 void GriddedGraph::_bind_methods() {
     ClassDB::bind_method(D_METHOD("grid_set", "grid"), &GriddedGraph::grid_set);
     ClassDB::bind_method(D_METHOD("grid_get"), &GriddedGraph::grid_get);
 
     ClassDB::bind_method(D_METHOD("refresh_static_masses"), &GriddedGraph::refresh_static_masses);
+    ClassDB::bind_method(D_METHOD("refresh_in_background_set", "value"), &GriddedGraph::refresh_in_background_set);
+    ClassDB::bind_method(D_METHOD("refresh_in_background_get"), &GriddedGraph::refresh_in_background_get);
+    ClassDB::bind_method(D_METHOD("is_refreshing"), &GriddedGraph::is_refreshing);
+
+    ClassDB::bind_method(D_METHOD("save_graph", "path"), &GriddedGraph::save_graph);
+    ClassDB::bind_method(D_METHOD("load_graph", "path"), &GriddedGraph::load_graph);
+
+    ClassDB::bind_method(D_METHOD("streaming_set", "value"), &GriddedGraph::streaming_set);
+    ClassDB::bind_method(D_METHOD("streaming_get"), &GriddedGraph::streaming_get);
+
+    ClassDB::bind_method(D_METHOD("page_budget_set", "pages"), &GriddedGraph::page_budget_set);
+    ClassDB::bind_method(D_METHOD("page_budget_get"), &GriddedGraph::page_budget_get);
+
+    ClassDB::bind_method(D_METHOD("page_loads_per_frame_set", "value"), &GriddedGraph::page_loads_per_frame_set);
+    ClassDB::bind_method(D_METHOD("page_loads_per_frame_get"), &GriddedGraph::page_loads_per_frame_get);
+
+    ClassDB::bind_method(D_METHOD("prefetch", "world_rect"), &GriddedGraph::prefetch);
+
+    ClassDB::bind_method(D_METHOD("set_cost_region", "world_rect", "cost"), &GriddedGraph::set_cost_region);
+    ClassDB::bind_method(D_METHOD("clear_costs"), &GriddedGraph::clear_costs);
 
     ClassDB::bind_method(D_METHOD("find_floor", "character_parameters", "graph_position", "depth"), &GriddedGraph::find_floor, DEFVAL(10));
 
@@ -41,18 +62,140 @@ void GriddedGraph::_bind_methods() {
     ClassDB::bind_method(D_METHOD("world_units", "graph_units"), &GriddedGraph::world_units);
     ClassDB::bind_method(D_METHOD("graph_units", "world_units"), &GriddedGraph::graph_units);
 
-    ClassDB::bind_method(D_METHOD("get_closest_free_cell_in_world_cover", "character_parameters", "point", "regions", "prefer_floors"), &GriddedGraph::get_closest_free_cell_in_world_cover, DEFVAL(false));
+    ClassDB::bind_method(D_METHOD("get_closest_free_cell_in_world_cover", "character_parameters", "point", "regions", "prefer_floors", "max_count"), &GriddedGraph::get_closest_free_cell_in_world_cover, DEFVAL(false), DEFVAL(0));
 
    	ADD_PROPERTY(PropertyInfo(Variant::OBJECT, "grid", PROPERTY_HINT_RESOURCE_TYPE, "Grid"), "grid_set", "grid_get");
+    ADD_PROPERTY(PropertyInfo(Variant::BOOL, "refresh_in_background"), "refresh_in_background_set", "refresh_in_background_get");
+    ADD_PROPERTY(PropertyInfo(Variant::BOOL, "streaming"), "streaming_set", "streaming_get");
+    ADD_PROPERTY(PropertyInfo(Variant::INT, "page_budget", PROPERTY_HINT_RANGE, "1,1000000,1"), "page_budget_set", "page_budget_get");
+    ADD_PROPERTY(PropertyInfo(Variant::INT, "page_loads_per_frame", PROPERTY_HINT_RANGE, "0,1024,1"), "page_loads_per_frame_set", "page_loads_per_frame_get");
+
+    ADD_SIGNAL(MethodInfo("graph_refreshed"));
+}
+
+void GriddedGraph::_notification(int what) {
+    switch (what) {
+        case NOTIFICATION_READY:
+        {
+            _update_process();
+            break;
+        }
+        case NOTIFICATION_PROCESS:
+        {
+            if (_streaming) _paged.pump(_page_loads_per_frame);
+
+            if (_build && _build->done) {
+                _build_thread.join();
+                std::shared_ptr<RefreshBuild> build = _build;
+                _build.reset();
+
+                _finish_build(build->graph);
+                _update_process();
+            }
+            break;
+        }
+        default: break;
+    }
+}
+
+void GriddedGraph::streaming_set(bool value) {
+    _streaming = value;
+    _paged.clear();
+    _clear_coarse();
+    _version++;
+
+    _update_process();
+}
+
+void GriddedGraph::_clear_coarse() {
+    _coarse.clear();
+    _coarse.clear_costs();
+    _coarse_built = false;
+}
+
+const pathfinding::Graph& GriddedGraph::coarse_graph() {
+    std::vector<int64_t> loaded;
+    _paged.take_loaded(loaded);
+
+    if (_coarse_built && _coarse_version == _version) {
+        for (int64_t key : loaded) pathfinding::downsample_page(graph(), page_key_x(key), page_key_y(key), _coarse);
+        return _coarse;
+    }
+
+    // Only streamed graphs keep blocks of pages they no longer have
+    if (!_streaming) _clear_coarse();
+
+    pathfinding::downsample(graph(), _coarse);
+    _coarse_version = _version;
+    _coarse_built = true;
+    return _coarse;
+}
+
+void GriddedGraph::_update_process() {
+    if (is_inside_tree()) set_process(_streaming || _build);
+}
+
+pathfinding::Region GriddedGraph::_world_region(Rect2 world_rect) const {
+    world_rect = world_rect.abs();
+    Vector2 top_left = world_to_graph(world_rect.position);
+    Vector2 bottom_right = world_to_graph(world_rect.position + world_rect.size);
+
+    pathfinding::Region region;
+    region.x = (int)top_left.x;
+    region.y = (int)top_left.y;
+    region.w = (int)(bottom_right.x - top_left.x) + 1;
+    region.h = (int)(bottom_right.y - top_left.y) + 1;
+    return region;
+}
+
+void GriddedGraph::prefetch(Rect2 world_rect) {
+    prefetch_region(_world_region(world_rect));
+}
+
+void GriddedGraph::prefetch_region(const pathfinding::Region& region) {
+    if (!_streaming) return;
+    _paged.prefetch(region);
+}
+
+void GriddedGraph::set_cost_region(Rect2 world_rect, int cost) {
+    pathfinding::Region region = _world_region(world_rect);
+    uint8_t weight = (uint8_t)CLAMP(cost, 0, 255);
+
+    if (_streaming) _paged.set_cost_region(region, weight);
+    else _graph.set_cost_region(region, weight);
+
+    _version++;
+}
+
+void GriddedGraph::clear_costs() {
+    _paged.clear_costs();
+    _graph.clear_costs();
+    _coarse.clear_costs();
+    _version++;
+}
+
+bool GriddedGraph::acquire(const pathfinding::Region& region, bool block) {
+    if (!_streaming) return true;
+    return _paged.acquire(region, block ? pathfinding::PageMiss_Block : pathfinding::PageMiss_Fail);
+}
+
+void GriddedGraph::snapshot(const pathfinding::Region& region, pathfinding::Graph& out) const {
+    if (!_streaming) {
+        out = _graph;
+        return;
+    }
+
+    _paged.snapshot(region, out);
 }
 
 Vector2 GriddedGraph::find_floor(Ref<CharacterParameters> character_parameters, Vector2 graph_position, int depth) const {
     graph_position = graph_position.snapped(Vector2(1, 1));
     int x = (int)graph_position.x;
     int y = (int)graph_position.y;
+    const pathfinding::Graph& graph = this->graph();
     for (int i = 0; i < depth; i++) {
-        if (!_graph.fits(character_parameters->settings(), x, y + i)) continue;
-        if (_graph.on_floor(character_parameters->settings(), x, y + i)) return graph_position;
+        if (!graph.fits(character_parameters->settings(), x, y + i)) continue;
+        if (graph.on_floor(character_parameters->settings(), x, y + i)) return graph_position;
     }
 
     return Vector2(NAN, NAN);
@@ -74,74 +217,201 @@ Vector2 GriddedGraph::graph_units(Vector2 world_units) const {
     return world_units / grid_get()->step();
 }
 
-PoolVector2Array GriddedGraph::get_closest_free_cell_in_world_cover(Ref<CharacterParameters> character_parameters, Vector2 point, Array regions, bool prefer_floors) const {
-    std::vector<Vector2> free_cells;
+PoolVector2Array GriddedGraph::get_closest_free_cell_in_world_cover(Ref<CharacterParameters> character_parameters, Vector2 point, Array regions, bool prefer_floors, int max_count) const {
+    std::vector<pathfinding::Region> cover;
 
     for (int i = 0; i < regions.size(); i++) {
         auto rect = (Rect2)regions[i];
         Vector2 rect_pos = grid_get()->gridded(rect.position);
         Vector2 rect_size = (grid_get()->gridded(rect.position + rect.size) - rect_pos) + Vector2(1, 1);
-        rect.position = rect_pos;
-        rect.size = rect_size;
-
-        for (int r = 0; r < rect.size.y; r++) {
-            for (int c = 0; c < rect.size.x; c++) {
-                Vector2 cell(rect.position.x + c, rect.position.y + r);
-                if (!_graph.fits(character_parameters->settings(), (int32_t)cell.x, (int32_t)cell.y)) continue;
-                free_cells.push_back(cell);
-            }
-        }
+
+        pathfinding::Region region;
+        region.x = (int)rect_pos.x;
+        region.y = (int)rect_pos.y;
+        region.w = (int)rect_size.x;
+        region.h = (int)rect_size.y;
+        cover.push_back(region);
     }
 
-    std::sort(free_cells.begin(), free_cells.end(), less_than_closest_point(_graph, character_parameters->settings(), grid_get()->gridded(point), prefer_floors));
-    free_cells.erase(std::unique(free_cells.begin(), free_cells.end()), free_cells.end());
+    Vector2 cell = grid_get()->gridded(point);
+
+    std::vector<pathfinding::FreeCell> free_cells;
+    pathfinding::closest_free_cells(graph(), character_parameters->settings(), cover, (int32_t)cell.x, (int32_t)cell.y, prefer_floors, max_count, free_cells);
 
     PoolVector2Array ret_free_cells;
-    for (int i = 0; i < free_cells.size(); i++) {
-        ret_free_cells.append(free_cells[i]);
+    ret_free_cells.resize(free_cells.size());
+
+    {
+        PoolVector2Array::Write write = ret_free_cells.write();
+        for (size_t i = 0; i < free_cells.size(); i++) write[i] = Vector2(free_cells[i].x, free_cells[i].y);
     }
 
     return ret_free_cells;
 }
 
-void GriddedGraph::_add_masses(const Vector<Rect2>& masses) {
-    if (_grid.is_null()) return;
+Rect2 GriddedGraph::_graph_rect(const Rect2& mass) const {
+    Rect2 rect = mass;
+    rect.position = _grid->gridded(_grid->snapped(rect.position));
+    rect.size = _grid->gridded(_grid->snapped(rect.size));
+    return rect;
+}
 
-    _graph.clear();
+pathfinding::Region GriddedGraph::_graph_region(const Rect2& mass) const {
+    Rect2 rect = _graph_rect(mass);
 
-    for (int i = 0; i < masses.size(); i++) {
-        Rect2 rect = masses[i];
+    pathfinding::Region region;
+    region.x = (int)rect.position.x;
+    region.y = (int)rect.position.y;
+    region.w = (int)rect.size.width;
+    region.h = (int)rect.size.height;
+    return region;
+}
 
-        rect.position = _grid->gridded(_grid->snapped(rect.position));
-        rect.size = _grid->gridded(_grid->snapped(rect.size));
+bool GriddedGraph::_load_page(int32_t page_x, int32_t page_y, pathfinding::PageRef& page) {
+    if (_file.is_open()) {
+        page = _file.page(page_x, page_y);
+        return true;
+    }
 
-        for (int y = 0; y < rect.size.height; y++) {
-            for (int x = 0; x < rect.size.width; x++) {
-                int index_x = rect.position.x + x;
-                int index_y = rect.position.y + y;
+    if (_grid.is_null()) return false;
+    if (get_script_instance() == nullptr) return false;
+    if (!get_script_instance()->has_method("_load_page")) return false;
 
-                _graph.set_at(index_x, index_y, pathfinding::FLOOR_TILEKIND);
-            }
-        }
+    Vector2 page_origin(page_x * PAGE_SIZE, page_y * PAGE_SIZE);
+    Rect2 world_rect(graph_to_world(page_origin, false), world_units(Vector2(PAGE_SIZE, PAGE_SIZE)));
+
+    Variant ret = get_script_instance()->call("_load_page", world_rect);
+    if (ret.get_type() != Variant::ARRAY) return false;
+
+    Array arr = (Array)ret;
+    std::vector<pathfinding::Region> masses;
+
+    for (int i = 0; i < arr.size(); i++) {
+        Variant mass = arr[i];
+        if (mass.get_type() != Variant::RECT2) continue;
+        masses.push_back(_graph_region(mass));
+    }
+
+    page = pathfinding::rasterize_page(masses, page_x, page_y);
+    return true;
+}
+
+void GriddedGraph::_start_build(std::vector<pathfinding::Region>& masses) {
+    _cancel_build();
+
+    int threads = MAX(OS::get_singleton()->get_processor_count() - 1, 1);
+
+    if (!_refresh_in_background) {
+        pathfinding::Graph graph;
+        pathfinding::rasterize(masses, graph, threads);
+        _finish_build(graph);
+        return;
     }
+
+    std::shared_ptr<RefreshBuild> build = std::make_shared<RefreshBuild>();
+    build->masses.swap(masses);
+    build->cancelled = false;
+    build->done = false;
+
+    _build = build;
+    _build_thread = std::thread([build, threads]() {
+        pathfinding::rasterize(build->masses, build->graph, threads, &build->cancelled);
+        build->done = true;
+    });
+
+    _update_process();
+}
+
+void GriddedGraph::_cancel_build() {
+    if (!_build) return;
+
+    _build->cancelled = true;
+    _build_thread.join();
+    _build.reset();
+
+    _update_process();
+}
+
+void GriddedGraph::_finish_build(pathfinding::Graph& graph) {
+    // Costs are set apart from the static masses and survive a refresh
+    graph.costs_from(_graph);
+    std::swap(_graph, graph);
+    _version++;
+
+    emit_signal("graph_refreshed");
 }
 
 void GriddedGraph::refresh_static_masses() {
+    // Streamed pages are reloaded from _load_page as they are needed
+    if (_streaming) {
+        _paged.clear();
+        _clear_coarse();
+        _version++;
+        return;
+    }
+
     if (get_script_instance() == nullptr) return;
     if (!get_script_instance()->has_method("_refresh_static_masses")) return;
 
+    _file.close();
+
     Variant ret = get_script_instance()->call("_refresh_static_masses");
     if (ret.get_type() != Variant::ARRAY) return;
 
-    Vector<Rect2> landmasses;
+    if (_grid.is_null()) return;
+
+    std::vector<pathfinding::Region> landmasses;
 
     Array arr = (Array)ret;
 
     for (int i = 0; i < arr.size(); i++) {
         Variant rect = arr[i];
         if (rect.get_type() != Variant::RECT2) continue;
-        landmasses.push_back(rect);
+        landmasses.push_back(_graph_region(rect));
+    }
+
+    _start_build(landmasses);
+}
+
+Error GriddedGraph::save_graph(String path) const {
+    // Only the resident pages of a streamed graph are left, pages from _load_page that were evicted can't be written
+    ERR_FAIL_COND_V(_streaming && !_file.is_open(), ERR_UNAVAILABLE);
+
+    std::string global_path = ProjectSettings::get_singleton()->globalize_path(path).utf8().get_data();
+
+    // Loaded pages point into the open file, writing over it would pull them out from under the graph
+    ERR_FAIL_COND_V(_file.is_open() && global_path == _file_path, ERR_FILE_ALREADY_IN_USE);
+
+    // Streamed out of a file, every page is still there to copy, costs stay with the paged graph
+    if (_streaming) {
+        pathfinding::Graph whole;
+        _file.load(whole);
+        whole.costs_from(_paged.graph());
+        if (!pathfinding::save_graph(whole, global_path)) return ERR_FILE_CANT_WRITE;
+        return OK;
+    }
+
+    if (!pathfinding::save_graph(graph(), global_path)) return ERR_FILE_CANT_WRITE;
+    return OK;
+}
+
+Error GriddedGraph::load_graph(String path) {
+    std::string global_path = ProjectSettings::get_singleton()->globalize_path(path).utf8().get_data();
+    if (!_file.open(global_path)) return ERR_FILE_CANT_OPEN;
+    _file_path = global_path;
+
+    // A refresh still running would overwrite the loaded graph
+    _cancel_build();
+
+    // Streamed pages come out of the file from now on, otherwise every page is mapped in at once
+    if (_streaming) {
+        _paged.clear();
+        _clear_coarse();
+        _version++;
+        return OK;
     }
 
-    _add_masses(landmasses);
+    _file.load(_graph);
+    _version++;
+    return OK;
 }
@@ -5,6 +5,13 @@
 #include "character_parameters.hpp"
 #include "grid.hpp"
 #include "pathfinding/graph.hpp"
+#include "pathfinding/graph_file.hpp"
+#include "pathfinding/lod.hpp"
+#include "pathfinding/paged_graph.hpp"
+
+#include <atomic>
+#include <memory>
+#include <thread>
 
 class GriddedGraph : public Node {
     GDCLASS(GriddedGraph, Node)
@@ -13,16 +20,83 @@ class GriddedGraph : public Node {
 
     Ref<Grid> _grid;
 
-    void _add_masses(const Vector<Rect2>& rect);
+    bool _streaming;
+    int _page_loads_per_frame;
+    pathfinding::PagedGraph _paged;
+
+    pathfinding::GraphFile _file;
+    std::string _file_path;
+
+    uint64_t _version;
+
+    // Blocks of the graph for far away queries, downsampled again the first time they are needed after a static change.
+    // Pages streamed in since only redo their own blocks
+    pathfinding::Graph _coarse;
+    uint64_t _coarse_version;
+    bool _coarse_built;
+    void _clear_coarse();
+
+    // A background refresh rasterizes into its own graph, queries keep using _graph until it is swapped in
+    struct RefreshBuild {
+        std::vector<pathfinding::Region> masses;
+        pathfinding::Graph graph;
+        std::atomic<bool> cancelled;
+        std::atomic<bool> done;
+    };
+
+    bool _refresh_in_background;
+    std::shared_ptr<RefreshBuild> _build;
+    std::thread _build_thread;
+
+    void _start_build(std::vector<pathfinding::Region>& masses);
+    void _cancel_build();
+    void _finish_build(pathfinding::Graph& graph);
+    void _update_process();
+
+    Rect2 _graph_rect(const Rect2& mass) const;
+    pathfinding::Region _world_region(Rect2 world_rect) const;
+    pathfinding::Region _graph_region(const Rect2& mass) const;
+    bool _load_page(int32_t page_x, int32_t page_y, pathfinding::PageRef& page);
 
 protected:
     static void _bind_methods();
 
 public:
-    GriddedGraph() : _grid(RES()) { _grid.instance(); }
+    GriddedGraph();
+    ~GriddedGraph();
+
+    void _notification(int what);
 
     void refresh_static_masses();
 
+    // A streamed graph can only be saved while it streams out of a file, see load_graph
+    Error save_graph(String path) const;
+    Error load_graph(String path);
+
+    void streaming_set(bool value);
+    bool streaming_get() const { return _streaming; }
+
+    void page_budget_set(int pages) { _paged.budget_set(MAX(pages, 1)); }
+    int page_budget_get() const { return (int)_paged.budget_get(); }
+
+    void refresh_in_background_set(bool value) { _refresh_in_background = value; }
+    bool refresh_in_background_get() const { return _refresh_in_background; }
+    bool is_refreshing() const { return (bool)_build; }
+
+    void page_loads_per_frame_set(int value) { _page_loads_per_frame = MAX(value, 0); }
+    int page_loads_per_frame_get() const { return _page_loads_per_frame; }
+
+    void prefetch(Rect2 world_rect);
+    void prefetch_region(const pathfinding::Region& region);
+
+    // Extra cost for entering every cell the rect touches, scaled by each character's hazard cost
+    void set_cost_region(Rect2 world_rect, int cost);
+    void clear_costs();
+
+    // Makes the pages under a graph region resident, always succeeds when not streaming
+    bool acquire(const pathfinding::Region& region, bool block);
+    void snapshot(const pathfinding::Region& region, pathfinding::Graph& out) const;
+
     void grid_set(Ref<Grid> grid)
     {
         _grid = grid;
@@ -42,8 +116,18 @@ public:
     Vector2 world_units(Vector2 graph_units) const;
     Vector2 graph_units(Vector2 world_units) const;
 
-    const pathfinding::Graph& graph() const { return _graph; }
+    // Changes whenever the static graph does, streamed page loads and evictions included
+    uint64_t version() const { return _version + _paged.version(); }
+
+    // Only changes when the level does, streaming pages in and out leaves it alone
+    uint64_t static_version() const { return _version; }
+
+    const pathfinding::Graph& graph() const { return _streaming ? _paged.graph() : _graph; }
+
+    // See pathfinding::downsample, a streamed graph keeps the blocks of evicted pages
+    const pathfinding::Graph& coarse_graph();
 
-    PoolVector2Array get_closest_free_cell_in_world_cover(Ref<CharacterParameters> character_parameters, Vector2 point, Array regions, bool prefer_floor = false) const;
+    // A positive max_count only returns that many of the closest cells
+    PoolVector2Array get_closest_free_cell_in_world_cover(Ref<CharacterParameters> character_parameters, Vector2 point, Array regions, bool prefer_floor = false, int max_count = 0) const;
 };
     
\ No newline at end of file
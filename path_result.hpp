@@ -0,0 +1,107 @@
+#pragma once
+
+#include "core/reference.h"
+
+#include "pathfinding/state.hpp"
+
+#include <vector>
+
+/*
+ * Keeps the states of a computed path on the C++ side. Script reads the waypoints it
+ * needs instead of having every one of them converted up front.
+ */
+class PathResult : public Reference {
+    GDCLASS(PathResult, Reference);
+
+    std::vector<pathfinding::State> _states;
+    int _goal;
+
+    // One state per move, keypoint and time stepped paths can't be validated
+    bool _full;
+
+protected:
+    static void _bind_methods() {
+        ClassDB::bind_method(D_METHOD("size"), &PathResult::size);
+        ClassDB::bind_method(D_METHOD("get_goal"), &PathResult::get_goal);
+        ClassDB::bind_method(D_METHOD("is_full"), &PathResult::is_full);
+        ClassDB::bind_method(D_METHOD("get_position", "index"), &PathResult::get_position);
+        ClassDB::bind_method(D_METHOD("get_scenario", "index"), &PathResult::get_scenario);
+        ClassDB::bind_method(D_METHOD("get_jump", "index"), &PathResult::get_jump);
+        ClassDB::bind_method(D_METHOD("get_positions"), &PathResult::get_positions);
+        ClassDB::bind_method(D_METHOD("get_packed"), &PathResult::get_packed);
+    }
+
+public:
+    PathResult() : _goal(-1), _full(false) {}
+
+    void set(std::vector<pathfinding::State>& states, int goal, bool full) {
+        _states.swap(states);
+        _goal = goal;
+        _full = full;
+    }
+
+    const std::vector<pathfinding::State>& states() const { return _states; }
+
+    int size() const { return (int)_states.size(); }
+    int get_goal() const { return _goal; }
+    bool is_full() const { return _full; }
+
+    Vector2 get_position(int index) const {
+        ERR_FAIL_INDEX_V(index, (int)_states.size(), Vector2());
+        return Vector2(_states[index].x, _states[index].y);
+    }
+
+    int get_scenario(int index) const {
+        ERR_FAIL_INDEX_V(index, (int)_states.size(), 0);
+        return _states[index].scenario_meta;
+    }
+
+    int get_jump(int index) const {
+        ERR_FAIL_INDEX_V(index, (int)_states.size(), 0);
+        return _states[index].jump;
+    }
+
+    PoolVector2Array get_positions() const { return positions(_states); }
+    PoolIntArray get_packed() const { return packed(_states); }
+
+    static PoolVector2Array positions(const std::vector<pathfinding::State>& states) {
+        PoolVector2Array out;
+        out.resize(states.size());
+
+        {
+            PoolVector2Array::Write write = out.write();
+            for (size_t i = 0; i < states.size(); i++) write[i] = Vector2(states[i].x, states[i].y);
+        }
+
+        return out;
+    }
+
+    static PoolIntArray scenarios(const std::vector<pathfinding::State>& states) {
+        PoolIntArray out;
+        out.resize(states.size());
+
+        {
+            PoolIntArray::Write write = out.write();
+            for (size_t i = 0; i < states.size(); i++) write[i] = states[i].scenario_meta;
+        }
+
+        return out;
+    }
+
+    // x, y and scenario of each state one after another
+    static PoolIntArray packed(const std::vector<pathfinding::State>& states) {
+        PoolIntArray out;
+        out.resize(states.size() * 3);
+
+        {
+            PoolIntArray::Write write = out.write();
+            for (size_t i = 0; i < states.size(); i++) {
+                write[i * 3] = states[i].x;
+                write[i * 3 + 1] = states[i].y;
+                write[i * 3 + 2] = states[i].scenario_meta;
+            }
+        }
+
+        return out;
+    }
+};
@@ -1,14 +1,42 @@
 #include "pathfinder.hpp"
 
 #include "core/method_bind_ext.gen.inc"
+#include "core/os/os.h"
+#include "core/project_settings.h"
 
+#include "pathfinding/cooperative.hpp"
+#include "pathfinding/reachable.hpp"
 #include "pathfinding/search.hpp"
+#include "pathfinding/state_key.hpp"
+
+static const uint64_t _latency_bounds_usec[PATHFINDER_LATENCY_BUCKETS - 1] = {
+    100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000
+};
 
 Pathfinder::Pathfinder() {
     _initial_graph_path = NodePath();
     _graph = nullptr;
     _filtered = true;
+    _shortened = false;
+    _lazy_evaluation = false;
+    _result_format = ResultArrays;
+    _reservation_window = _reservations.horizon();
+    _block_on_missing_pages = true;
+    _collect_statistics = false;
     _max_concurrency = 4;
+    _pool = nullptr;
+    _id_counter = 0;
+    _in_flight = 0;
+    _agents_changed = false;
+    _occupancy_version = 0;
+    _lod_focus = Vector2();
+    _lod_radius = 0;
+    _parallel_threads = 1;
+    _parallel_min_area = 256 * 256;
+    _trace_has_graph = false;
+    _trace_graph_version = 0;
+    _trace_graph = 0;
+    reset_statistics();
 }
 
 Pathfinder::~Pathfinder() {}
@@ -20,28 +48,125 @@ void Pathfinder::_bind_methods() {
     ClassDB::bind_method(D_METHOD("filtered_set", "value"), &Pathfinder::_filtered_set);
     ClassDB::bind_method(D_METHOD("filtered_get"), &Pathfinder::_filtered_get);
 
+    ClassDB::bind_method(D_METHOD("shortened_set", "value"), &Pathfinder::_shortened_set);
+    ClassDB::bind_method(D_METHOD("shortened_get"), &Pathfinder::_shortened_get);
+
+    ClassDB::bind_method(D_METHOD("lazy_evaluation_set", "value"), &Pathfinder::_lazy_evaluation_set);
+    ClassDB::bind_method(D_METHOD("lazy_evaluation_get"), &Pathfinder::_lazy_evaluation_get);
+
+    ClassDB::bind_method(D_METHOD("result_format_set", "value"), &Pathfinder::_result_format_set);
+    ClassDB::bind_method(D_METHOD("result_format_get"), &Pathfinder::_result_format_get);
+
+    ClassDB::bind_method(D_METHOD("block_on_missing_pages_set", "value"), &Pathfinder::_block_on_missing_pages_set);
+    ClassDB::bind_method(D_METHOD("block_on_missing_pages_get"), &Pathfinder::_block_on_missing_pages_get);
+
+    ClassDB::bind_method(D_METHOD("collect_statistics_set", "value"), &Pathfinder::_collect_statistics_set);
+    ClassDB::bind_method(D_METHOD("collect_statistics_get"), &Pathfinder::_collect_statistics_get);
+
+    ClassDB::bind_method(D_METHOD("get_statistics"), &Pathfinder::get_statistics);
+    ClassDB::bind_method(D_METHOD("reset_statistics"), &Pathfinder::reset_statistics);
+
+    ClassDB::bind_method(D_METHOD("lod_focus_set", "value"), &Pathfinder::_lod_focus_set);
+    ClassDB::bind_method(D_METHOD("lod_focus_get"), &Pathfinder::_lod_focus_get);
+
+    ClassDB::bind_method(D_METHOD("lod_radius_set", "value"), &Pathfinder::_lod_radius_set);
+    ClassDB::bind_method(D_METHOD("lod_radius_get"), &Pathfinder::_lod_radius_get);
+
+    ClassDB::bind_method(D_METHOD("parallel_threads_set", "value"), &Pathfinder::_parallel_threads_set);
+    ClassDB::bind_method(D_METHOD("parallel_threads_get"), &Pathfinder::_parallel_threads_get);
+    ClassDB::bind_method(D_METHOD("parallel_min_area_set", "value"), &Pathfinder::_parallel_min_area_set);
+    ClassDB::bind_method(D_METHOD("parallel_min_area_get"), &Pathfinder::_parallel_min_area_get);
+
+    ClassDB::bind_method(D_METHOD("reservation_window_set", "value"), &Pathfinder::_reservation_window_set);
+    ClassDB::bind_method(D_METHOD("reservation_window_get"), &Pathfinder::_reservation_window_get);
+
+    ClassDB::bind_method(D_METHOD("advance_reservations", "steps"), &Pathfinder::advance_reservations, DEFVAL(1));
+    ClassDB::bind_method(D_METHOD("clear_reservations"), &Pathfinder::clear_reservations);
+
+    ClassDB::bind_method(D_METHOD("start_trace", "path"), &Pathfinder::start_trace);
+    ClassDB::bind_method(D_METHOD("stop_trace"), &Pathfinder::stop_trace);
+    ClassDB::bind_method(D_METHOD("is_tracing"), &Pathfinder::is_tracing);
+
     ClassDB::bind_method(D_METHOD("_do_callbacks"), &Pathfinder::_do_callbacks);
 
     ClassDB::bind_method(D_METHOD("compute_path",
-        "initial", "goal", "character_parameters", "region", "dynamic_masses", "source", "callback"), &Pathfinder::compute_path);
+        "initial", "goal", "character_parameters", "region", "dynamic_masses", "source", "callback", "agent"), &Pathfinder::compute_path, DEFVAL(-1));
+    ClassDB::bind_method(D_METHOD("compute_path_to_any",
+        "initial", "goals", "character_parameters", "region", "dynamic_masses", "source", "callback", "agent"), &Pathfinder::compute_path_to_any, DEFVAL(-1));
+    ClassDB::bind_method(D_METHOD("reachable_set",
+        "initial", "character_parameters", "max_cost", "region", "dynamic_masses", "source", "callback", "agent"), &Pathfinder::reachable_set, DEFVAL(-1));
+    ClassDB::bind_method(D_METHOD("compute_path_realtime",
+        "initial", "goal", "character_parameters", "lookahead", "region", "dynamic_masses", "source", "callback", "agent"), &Pathfinder::compute_path_realtime, DEFVAL(-1));
+    ClassDB::bind_method(D_METHOD("clear_learned_heuristics"), &Pathfinder::clear_learned_heuristics);
+    ClassDB::bind_method(D_METHOD("get_learned_state_count"), &Pathfinder::get_learned_state_count);
+    ClassDB::bind_method(D_METHOD("build_path_database", "character_parameters", "points", "region"), &Pathfinder::build_path_database);
+    ClassDB::bind_method(D_METHOD("save_path_database", "character_parameters", "path"), &Pathfinder::save_path_database);
+    ClassDB::bind_method(D_METHOD("load_path_database", "character_parameters", "path"), &Pathfinder::load_path_database);
+    ClassDB::bind_method(D_METHOD("has_path_database", "character_parameters"), &Pathfinder::has_path_database);
+    ClassDB::bind_method(D_METHOD("clear_path_databases"), &Pathfinder::clear_path_databases);
+    ClassDB::bind_method(D_METHOD("compute_paths_cooperative",
+        "agents", "region", "dynamic_masses", "source", "callback"), &Pathfinder::compute_paths_cooperative);
+    ClassDB::bind_method(D_METHOD("validate_path",
+        "path", "character_parameters", "dynamic_masses", "agent"), &Pathfinder::validate_path, DEFVAL(-1));
+    ClassDB::bind_method(D_METHOD("repair_path",
+        "path", "character_parameters", "region", "dynamic_masses", "agent"), &Pathfinder::repair_path, DEFVAL(-1));
     ClassDB::bind_method(D_METHOD("cancel", "id"), &Pathfinder::cancel);
 
+    ClassDB::bind_method(D_METHOD("register_agent", "id", "world_rect"), &Pathfinder::register_agent);
+    ClassDB::bind_method(D_METHOD("update_agent", "id", "world_rect"), &Pathfinder::update_agent);
+    ClassDB::bind_method(D_METHOD("unregister_agent", "id"), &Pathfinder::unregister_agent);
+    ClassDB::bind_method(D_METHOD("clear_agents"), &Pathfinder::clear_agents);
+    ClassDB::bind_method(D_METHOD("get_agent_count"), &Pathfinder::get_agent_count);
+    ClassDB::bind_method(D_METHOD("get_occupancy_version"), &Pathfinder::get_occupancy_version);
+
    	ADD_PROPERTY(PropertyInfo(Variant::NODE_PATH, "initial_graph_path", PROPERTY_HINT_NODE_PATH_VALID_TYPES, "GriddedGraph"), "initial_graph_path_set", "initial_graph_path_get");
     ADD_PROPERTY(PropertyInfo(Variant::BOOL, "filtered"), "filtered_set", "filtered_get");
+    ADD_PROPERTY(PropertyInfo(Variant::BOOL, "shortened"), "shortened_set", "shortened_get");
+    ADD_PROPERTY(PropertyInfo(Variant::BOOL, "lazy_evaluation"), "lazy_evaluation_set", "lazy_evaluation_get");
+    ADD_PROPERTY(PropertyInfo(Variant::INT, "result_format", PROPERTY_HINT_ENUM, "Arrays,Packed,Handle"), "result_format_set", "result_format_get");
+    ADD_PROPERTY(PropertyInfo(Variant::BOOL, "block_on_missing_pages"), "block_on_missing_pages_set", "block_on_missing_pages_get");
+    ADD_PROPERTY(PropertyInfo(Variant::BOOL, "collect_statistics"), "collect_statistics_set", "collect_statistics_get");
+    ADD_PROPERTY(PropertyInfo(Variant::INT, "reservation_window", PROPERTY_HINT_RANGE, "1,256,1"), "reservation_window_set", "reservation_window_get");
+
+    ADD_GROUP("Level of Detail", "lod_");
+    ADD_PROPERTY(PropertyInfo(Variant::VECTOR2, "lod_focus"), "lod_focus_set", "lod_focus_get");
+    ADD_PROPERTY(PropertyInfo(Variant::REAL, "lod_radius", PROPERTY_HINT_RANGE, "0,100000,1,or_greater"), "lod_radius_set", "lod_radius_get");
+
+    ADD_GROUP("Parallel Search", "parallel_");
+    ADD_PROPERTY(PropertyInfo(Variant::INT, "parallel_threads", PROPERTY_HINT_RANGE, "1,16,1"), "parallel_threads_set", "parallel_threads_get");
+    ADD_PROPERTY(PropertyInfo(Variant::INT, "parallel_min_area", PROPERTY_HINT_RANGE, "0,1000000,1,or_greater"), "parallel_min_area_set", "parallel_min_area_get");
+
+    ADD_SIGNAL(MethodInfo("lod_refine", PropertyInfo(Variant::INT, "agent")));
 
     BIND_ENUM_CONSTANT(None);
     BIND_ENUM_CONSTANT(OnFloor);
     BIND_ENUM_CONSTANT(InAir);
     BIND_ENUM_CONSTANT(LedgeHangOnLeft);
     BIND_ENUM_CONSTANT(LedgeHangOnRight);
+
+    BIND_ENUM_CONSTANT(ResultArrays);
+    BIND_ENUM_CONSTANT(ResultPacked);
+    BIND_ENUM_CONSTANT(ResultHandle);
 }
 
 void Pathfinder::_do_callbacks() {
+    // Before callbacks run, so queries they make already see this frame's agents
+    if (_agents_changed) _rebuild_occupancy();
+    if (!_agents.empty()) _prefetch_agents();
+    if (!_coarse_agents.empty()) _check_refinement();
+    if (!_path_tables.empty()) _check_path_tables();
+
     std::vector<std::pair<int, Dictionary>> results;
     {
         std::unique_lock<std::mutex> unique_lock(_lock);
-        results = _results;
-        _results.clear();
+        results.swap(_results);
+
+        uint64_t now = OS::get_singleton()->get_ticks_usec();
+        if (now - _window_started_usec >= 1000000) {
+            _queries_per_second = (_completed - _window_completed) * 1000000.0 / (now - _window_started_usec);
+            _window_started_usec = now;
+            _window_completed = _completed;
+        }
     }
 
     for (int i = 0; i < results.size(); i++) {
@@ -70,6 +195,7 @@ NodePath Pathfinder::_initial_graph_path_get() const {
 
 void Pathfinder::_graph_set(GriddedGraph* graph) {
     _graph = graph;
+    _agents_changed = true;
 }
 
 GriddedGraph* Pathfinder::_graph_get() const {
@@ -84,6 +210,183 @@ bool Pathfinder::_filtered_get() const {
     return _filtered;
 }
 
+void Pathfinder::_shortened_set(bool value) {
+    _shortened = value;
+}
+
+bool Pathfinder::_shortened_get() const {
+    return _shortened;
+}
+
+void Pathfinder::_lazy_evaluation_set(bool value) {
+    _lazy_evaluation = value;
+}
+
+bool Pathfinder::_lazy_evaluation_get() const {
+    return _lazy_evaluation;
+}
+
+void Pathfinder::_result_format_set(ResultFormat value) {
+    _result_format = value;
+}
+
+Pathfinder::ResultFormat Pathfinder::_result_format_get() const {
+    return _result_format;
+}
+
+void Pathfinder::_reservation_window_set(int value) {
+    std::unique_lock<std::mutex> lock(_reservations_lock);
+    _reservations.horizon_set(value);
+    _reservation_window = _reservations.horizon();
+}
+
+int Pathfinder::_reservation_window_get() const {
+    return _reservation_window;
+}
+
+void Pathfinder::advance_reservations(int steps) {
+    std::unique_lock<std::mutex> lock(_reservations_lock);
+    _reservations.advance(steps);
+}
+
+void Pathfinder::clear_reservations() {
+    std::unique_lock<std::mutex> lock(_reservations_lock);
+    _reservations.clear();
+}
+
+void Pathfinder::_lod_focus_set(Vector2 value) {
+    _lod_focus = value;
+}
+
+Vector2 Pathfinder::_lod_focus_get() const {
+    return _lod_focus;
+}
+
+void Pathfinder::_lod_radius_set(float value) {
+    _lod_radius = MAX(value, 0);
+}
+
+float Pathfinder::_lod_radius_get() const {
+    return _lod_radius;
+}
+
+void Pathfinder::_parallel_threads_set(int value) {
+    _parallel_threads = CLAMP(value, 1, 16);
+
+    if (_parallel_threads <= 1) _parallel_workers.reset();
+    else if (!_parallel_workers || _parallel_workers->threads() != _parallel_threads) _parallel_workers = std::make_shared<pathfinding::ParallelWorkers>(_parallel_threads);
+}
+
+int Pathfinder::_parallel_threads_get() const {
+    return _parallel_threads;
+}
+
+void Pathfinder::_parallel_min_area_set(int value) {
+    _parallel_min_area = MAX(value, 0);
+}
+
+int Pathfinder::_parallel_min_area_get() const {
+    return _parallel_min_area;
+}
+
+// Automatic regions start small and rarely get large enough
+int Pathfinder::_search_threads(const pathfinding::Region& region, bool widening) const {
+    return !widening && (int64_t)region.w * region.h >= _parallel_min_area ? _parallel_threads : 1;
+}
+
+bool Pathfinder::_is_distant(Vector2 world_position) const {
+    return _lod_radius > 0 && world_position.distance_squared_to(_lod_focus) > _lod_radius * _lod_radius;
+}
+
+void Pathfinder::_check_refinement() {
+    std::vector<int> refined;
+
+    for (auto it = _coarse_agents.begin(); it != _coarse_agents.end(); ) {
+        auto agent = _agents.find(*it);
+        if (agent != _agents.end() && _is_distant(agent->second.position + agent->second.size / 2)) {
+            ++it;
+            continue;
+        }
+
+        if (agent != _agents.end()) refined.push_back(*it);
+        it = _coarse_agents.erase(it);
+    }
+
+    // Handlers usually ask for a new path right away, which changes the set
+    for (int id : refined) emit_signal("lod_refine", id);
+}
+
+void Pathfinder::_block_on_missing_pages_set(bool value) {
+    _block_on_missing_pages = value;
+}
+
+bool Pathfinder::_block_on_missing_pages_get() const {
+    return _block_on_missing_pages;
+}
+
+void Pathfinder::_collect_statistics_set(bool value) {
+    _collect_statistics = value;
+}
+
+bool Pathfinder::_collect_statistics_get() const {
+    return _collect_statistics;
+}
+
+Dictionary Pathfinder::get_statistics() {
+    std::unique_lock<std::mutex> lock(_lock);
+
+    Array histogram;
+    Array bounds;
+    for (int i = 0; i < PATHFINDER_LATENCY_BUCKETS; i++) {
+        histogram.push_back(_latency_histogram[i]);
+        if (i < PATHFINDER_LATENCY_BUCKETS - 1) bounds.push_back(_latency_bounds_usec[i]);
+    }
+
+    Dictionary dict;
+    dict["in_flight"] = _in_flight.load();
+    dict["completed"] = _completed;
+    dict["queries_per_second"] = _queries_per_second;
+    dict["latency_histogram"] = histogram;
+    dict["latency_bounds_usec"] = bounds;
+    return dict;
+}
+
+void Pathfinder::reset_statistics() {
+    std::unique_lock<std::mutex> lock(_lock);
+
+    _completed = 0;
+    for (int i = 0; i < PATHFINDER_LATENCY_BUCKETS; i++) _latency_histogram[i] = 0;
+    _window_started_usec = OS::get_singleton() ? OS::get_singleton()->get_ticks_usec() : 0;
+    _window_completed = 0;
+    _queries_per_second = 0;
+}
+
+void Pathfinder::_record_completion(uint64_t queued_usec) {
+    uint64_t latency = OS::get_singleton()->get_ticks_usec() - queued_usec;
+
+    int bucket = 0;
+    while (bucket < PATHFINDER_LATENCY_BUCKETS - 1 && latency > _latency_bounds_usec[bucket]) bucket++;
+
+    _latency_histogram[bucket]++;
+    _completed++;
+    _in_flight--;
+}
+
+Dictionary Pathfinder::_stats_to_dictionary(const pathfinding::SearchStats& stats, uint64_t queue_wait_usec) const {
+    Dictionary dict;
+    dict["expanded"] = stats.expanded;
+    dict["walked"] = stats.walked;
+    dict["generated"] = stats.generated;
+    dict["reopened"] = stats.reopened;
+    dict["widened"] = stats.widened;
+    dict["fit_checks"] = stats.fit_checks;
+    dict["frontier_peak"] = stats.frontier_peak;
+    dict["tile_reads"] = stats.tile_reads;
+    dict["search_usec"] = stats.search_usec;
+    dict["queue_wait_usec"] = queue_wait_usec;
+    return dict;
+}
+
 void Pathfinder::_notification(int what) {
     switch (what) {
         case NOTIFICATION_READY:
@@ -110,63 +413,756 @@ void Pathfinder::_notification(int what) {
 
 }
 
-int Pathfinder::compute_path(Vector2 initial_world, Vector2 goal_world, Ref<CharacterParameters> character_parameters, Rect2 region, Array dynamic_masses_world, Object* obj, String method) {
-    static pathfinding::Settings empty { 0, 1, 1, 1, false };
-
-    if (!_graph) {
-        return -1;
-    }
-
-    pathfinding::Graph graph = _graph->graph();
-    Ref<Grid> grid = RES();
+Vector2 Pathfinder::_to_cell(Vector2 world_position) const {
+    Ref<Grid> grid;
     if (_graph) grid = _graph->grid_get();
 
-    Vector2 initialv = !grid.is_null() ? grid->gridded(initial_world) : initial_world.floor();
-    Vector2 goalv = !grid.is_null() ? grid->gridded(goal_world) : goal_world.floor();
-
-    auto initial = pathfinding::State::create((int)initialv.x, (int)initialv.y);
-    auto goal = pathfinding::State::create((int)goalv.x, (int)goalv.y);
+    return !grid.is_null() ? grid->gridded(world_position) : world_position.floor();
+}
 
+pathfinding::Region Pathfinder::_to_region(Rect2 region) const {
     pathfinding::Region rgion;
     rgion.x = region.position.snapped(Vector2(1, 1)).x;
     rgion.y = region.position.snapped(Vector2(1, 1)).y;
     rgion.w = region.size.snapped(Vector2(1, 1)).width;
     rgion.h = region.size.snapped(Vector2(1, 1)).height;
+    return rgion;
+}
+
+// Points are single cells, rects cover every cell they touch
+std::vector<pathfinding::Region> Pathfinder::_to_goals(Array goals_world) const {
+    std::vector<pathfinding::Region> goals;
+
+    for (int i = 0; i < goals_world.size(); i++) {
+        Variant goal_world = goals_world[i];
+        pathfinding::Region goal;
+
+        if (goal_world.get_type() == Variant::VECTOR2) {
+            Vector2 cell = _to_cell(goal_world);
+            goal.x = (int)cell.x;
+            goal.y = (int)cell.y;
+            goal.w = 1;
+            goal.h = 1;
+        }
+        else if (goal_world.get_type() == Variant::RECT2) {
+            Rect2 rect = ((Rect2)goal_world).abs();
+            Vector2 top_left = _to_cell(rect.position);
+            Vector2 bottom_right = _to_cell(rect.position + rect.size);
+            goal.x = (int)top_left.x;
+            goal.y = (int)top_left.y;
+            goal.w = (int)(bottom_right.x - top_left.x) + 1;
+            goal.h = (int)(bottom_right.y - top_left.y) + 1;
+        }
+        else continue;
+
+        goals.push_back(goal);
+    }
+
+    return goals;
+}
+
+pathfinding::PathOutput Pathfinder::_path_output() const {
+    if (!_filtered) return pathfinding::PathOutput_Full;
+    return _shortened ? pathfinding::PathOutput_Shortened : pathfinding::PathOutput_Keypoints;
+}
+
+pathfinding::Region Pathfinder::_to_mass(Rect2 mass_world) const {
+    Rect2 rect = mass_world.abs();
+    Vector2 top_left = _graph->world_to_graph(rect.position);
+    Vector2 size = _graph->graph_units(rect.size).ceil();
+
+    pathfinding::Region mass;
+    mass.x = (int)top_left.x;
+    mass.y = (int)top_left.y;
+    mass.w = (int)size.x;
+    mass.h = (int)size.y;
+    return mass;
+}
+
+std::vector<pathfinding::Region> Pathfinder::_to_masses(Array dynamic_masses_world) const {
+    std::vector<pathfinding::Region> masses;
+
+    for (int i = 0; i < dynamic_masses_world.size(); i++) {
+        masses.push_back(_to_mass(dynamic_masses_world[i]));
+    }
+
+    return masses;
+}
+
+bool Pathfinder::_prepare_graph(
+    const pathfinding::Region& footprint,
+    const std::vector<pathfinding::Region>& dynamic_masses,
+    int agent,
+    pathfinding::Graph& graph,
+    bool traced) {
+
+    // A streamed graph only shares the pages the search can touch, missing pages either load now or fail the query
+    if (!_graph->acquire(footprint, _block_on_missing_pages)) return false;
+
+    _graph->snapshot(footprint, graph);
+
+    // Streamed snapshots depend on the footprint so they can't be shared between queries
+    if (traced && _trace.is_open() && (!_trace_has_graph || _graph->streaming_get() || _graph->version() != _trace_graph_version)) {
+        _trace_graph = _trace.write_graph(graph);
+        _trace_has_graph = true;
+        _trace_graph_version = _graph->version();
+    }
+
+    for (const pathfinding::Region& mass : dynamic_masses) {
+        graph.add_dynamic_mass(mass);
+    }
+
+    // The layer is shared as is, only this query's own masses are stamped into its copy
+    if (_occupancy) graph.set_occupancy(_occupancy, agent < 0 ? OCCUPANCY_FREE : agent);
+
+    return true;
+}
+
+void Pathfinder::_rebuild_occupancy() {
+    // Agent rects need the grid to turn into cells, so wait for a graph
+    if (!_graph) return;
+
+    _agents_changed = false;
+    _occupancy_version++;
+    _occupants.clear();
+
+    if (_agents.empty()) {
+        _occupancy.reset();
+        return;
+    }
+
+    for (auto& it : _agents) _occupants.push_back(std::make_pair((int32_t)it.first, _to_mass(it.second)));
+
+    // Queries still holding the last layer keep it, this one replaces it for new ones
+    auto occupancy = std::make_shared<pathfinding::Occupancy>();
+    occupancy->build(_occupants);
+    _occupancy = occupancy;
+}
+
+void Pathfinder::_prefetch_agents() {
+    if (!_graph || !_graph->streaming_get()) return;
+
+    // A page all around, queries from the agent's next few moves shouldn't wait on loads
+    for (auto& it : _agents) {
+        pathfinding::Region region = _to_mass(it.second);
+        region.x -= PAGE_SIZE;
+        region.y -= PAGE_SIZE;
+        region.w += 2 * PAGE_SIZE;
+        region.h += 2 * PAGE_SIZE;
+        _graph->prefetch_region(region);
+    }
+}
+
+void Pathfinder::register_agent(int id, Rect2 world_rect) {
+    ERR_FAIL_COND(id < 0);
+
+    _agents[id] = world_rect;
+    _agents_changed = true;
+}
+
+void Pathfinder::update_agent(int id, Rect2 world_rect) {
+    auto it = _agents.find(id);
+    ERR_FAIL_COND(it == _agents.end());
+
+    if (it->second == world_rect) return;
+    it->second = world_rect;
+    _agents_changed = true;
+}
+
+void Pathfinder::unregister_agent(int id) {
+    _coarse_agents.erase(id);
+    if (_agents.erase(id)) _agents_changed = true;
+}
+
+void Pathfinder::clear_agents() {
+    _coarse_agents.clear();
+    if (_agents.empty()) return;
+
+    _agents.clear();
+    _agents_changed = true;
+}
+
+Error Pathfinder::start_trace(String path) {
+    std::string global_path = ProjectSettings::get_singleton()->globalize_path(path).utf8().get_data();
+    if (!_trace.open(global_path)) return ERR_FILE_CANT_WRITE;
+
+    _trace_has_graph = false;
+    return OK;
+}
+
+void Pathfinder::stop_trace() {
+    _trace.close();
+}
+
+// What queries without character parameters search with, built once by field name so costs keep their defaults
+static pathfinding::Settings _empty_settings() {
+    pathfinding::Settings settings;
+    settings.max_jump_height = 0;
+    settings.air_stride = 1;
+    settings.width = 1;
+    settings.height = 1;
+    settings.ledge_hang = false;
+    return settings;
+}
+
+static const pathfinding::Settings& _settings_of(Ref<CharacterParameters> character_parameters) {
+    static const pathfinding::Settings empty = _empty_settings();
+    return character_parameters.is_null() ? empty : character_parameters->settings();
+}
+
+// State keys only have room for an 8 bit jump counter, searches past it find nothing
+static bool _jump_fits(const pathfinding::Settings& settings) {
+    return pathfinding::Graph::calculate_jump_limit(settings) + (int)settings.air_stride <= STATE_KEY_MAX_JUMP;
+}
+
+int Pathfinder::compute_path(Vector2 initial_world, Vector2 goal_world, Ref<CharacterParameters> character_parameters, Rect2 region, Array dynamic_masses_world, Object* obj, String method, int agent) {
+    Array goals;
+    goals.push_back(goal_world);
+
+    return compute_path_to_any(initial_world, goals, character_parameters, region, dynamic_masses_world, obj, method, agent);
+}
+
+int Pathfinder::compute_path_to_any(Vector2 initial_world, Array goals_world, Ref<CharacterParameters> character_parameters, Rect2 region, Array dynamic_masses_world, Object* obj, String method, int agent) {
+    if (!_graph) {
+        return -1;
+    }
+
+    const pathfinding::Settings& settings = _settings_of(character_parameters);
+    ERR_FAIL_COND_V(!_jump_fits(settings), -1);
+
+    Vector2 initialv = _to_cell(initial_world);
+    auto initial = pathfinding::State::create((int)initialv.x, (int)initialv.y);
+
+    std::vector<pathfinding::Region> goals = _to_goals(goals_world);
+
+    pathfinding::Region rgion = _to_region(region);
+
+    // The largest window the search can grow to bounds the snapshot like a region would
+    bool widening = rgion.w <= 0 || rgion.h <= 0;
+    if (widening) rgion = pathfinding::widen_window(pathfinding::search_window(settings, initial, goals), PATHFINDER_AUTO_WIDENINGS);
 
     int id = _id_counter++;
     _id_counter = _id_counter % (1 << 30);
 
-    // Add dynamic masses to the graph
-    for (int i = 0; i < dynamic_masses_world.size(); i++) {
-        Rect2 rect = dynamic_masses_world[i];
-        rect = rect.abs();
-        Vector2 top_left = _graph->world_to_graph(rect.position);
-        Vector2 size = _graph->graph_units(rect.size).ceil();
-
-        for (real_t x = top_left.x; x < top_left.x + size.x; x++) {
-            for (real_t y = top_left.y; y < top_left.y + size.y; y++) {
-                if (graph.get_at(x, y) != pathfinding::AIR_TILEKIND) continue;
-                graph.set_at(x, y, pathfinding::CHARACTER_TILEKIND);
+    // Answered right away when both ends are points of the character's database
+    if (dynamic_masses_world.empty() && _compute_path_from_table(id, character_parameters, rgion, widening, initial, goals, obj, method)) {
+        if (agent >= 0) _coarse_agents.erase(agent);
+        return id;
+    }
+
+    std::vector<pathfinding::Region> masses = _to_masses(dynamic_masses_world);
+
+    pathfinding::Graph graph;
+    if (goals.empty() || !_prepare_graph(pathfinding::search_footprint(settings, rgion, initial), masses, agent, graph, true)) {
+        _fail_async(id, obj, method);
+        return id;
+    }
+
+    if (_trace.is_open()) {
+        pathfinding::TraceQuery query;
+        query.graph = _trace_graph;
+        query.region = rgion;
+        query.mode = (widening ? TRACE_MODE_WIDENING : 0) | (_lazy_evaluation ? TRACE_MODE_LAZY : 0);
+        query.mode |= (uint32_t)_search_threads(rgion, widening) << TRACE_MODE_THREADS_SHIFT;
+        query.settings = settings;
+        query.initial_x = initial.x;
+        query.initial_y = initial.y;
+        query.goals = goals;
+        query.dynamic_masses = masses;
+
+        // Replays have no registry, the agents the query saw become plain masses
+        if (_occupancy) {
+            for (auto& occupant : _occupants) {
+                if (occupant.first != agent) query.dynamic_masses.push_back(occupant.second);
             }
         }
+
+        _trace.write_query(query);
     }
 
-    _compute_path_async(id, graph, character_parameters.is_null() ? empty : character_parameters->settings(), rgion, initial, goal.x, goal.y, obj, method);
+    // The fine graph is still shared in case the coarse one has no way through
+    pathfinding::Graph coarse_graph;
+    bool coarse = _is_distant(initial_world);
+    if (coarse) {
+        coarse_graph = _graph->coarse_graph();
+        for (const pathfinding::Region& mass : masses) coarse_graph.add_dynamic_mass(pathfinding::coarse_region(mass));
+    }
+
+    if (agent >= 0) {
+        if (coarse) _coarse_agents.insert(agent);
+        else _coarse_agents.erase(agent);
+    }
+
+    _compute_path_async(id, graph, coarse_graph, coarse, widening, settings, rgion, initial, goals, obj, method);
 
     return id;
 }
 
+int Pathfinder::compute_path_realtime(Vector2 initial_world, Vector2 goal_world, Ref<CharacterParameters> character_parameters, int lookahead, Rect2 region, Array dynamic_masses_world, Object* obj, String method, int agent) {
+    if (!_graph) {
+        return -1;
+    }
+
+    const pathfinding::Settings& settings = _settings_of(character_parameters);
+    ERR_FAIL_COND_V(!_jump_fits(settings), -1);
+
+    Vector2 initialv = _to_cell(initial_world);
+    auto initial = pathfinding::State::create((int)initialv.x, (int)initialv.y);
+
+    Array goals_world;
+    goals_world.push_back(goal_world);
+    std::vector<pathfinding::Region> goals = _to_goals(goals_world);
+
+    lookahead = CLAMP(lookahead, 1, 1 << 14);
+
+    // A tick can't get further than one move per expansion, so it only needs the graph around the agent
+    int reach = lookahead * (int)MAX(MAX(settings.width, settings.height), 1u);
+    pathfinding::Region window;
+    window.x = initial.x - reach;
+    window.y = initial.y - reach;
+    window.w = reach * 2 + 1;
+    window.h = reach * 2 + 1;
+
+    // An empty region leaves the window alone, the way compute_path grows its own
+    pathfinding::Region rgion = _to_region(region);
+    rgion = rgion.w > 0 && rgion.h > 0 ? pathfinding::region_intersection(rgion, window) : window;
+
+    int id = _id_counter++;
+    _id_counter = _id_counter % (1 << 30);
+
+    pathfinding::Graph graph;
+    if (goals.empty() || !_prepare_graph(pathfinding::search_footprint(settings, rgion, initial), _to_masses(dynamic_masses_world), agent, graph, false)) {
+        _fail_async(id, obj, method);
+        return id;
+    }
+
+    ObjectID character = character_parameters.is_null() ? 0 : character_parameters->get_instance_id();
+    std::shared_ptr<LearnedTable>& table = _learned[std::make_tuple(character, goals[0].x, goals[0].y)];
+    if (!table) {
+        table = std::make_shared<LearnedTable>();
+        table->heuristic = pathfinding::LearnedHeuristic(goals);
+    }
+
+    _compute_path_realtime_async(id, graph, settings, rgion, initial, lookahead, table, obj, method);
+
+    return id;
+}
+
+void Pathfinder::clear_learned_heuristics() {
+    _learned.clear();
+}
+
+int Pathfinder::get_learned_state_count() {
+    size_t count = 0;
+    for (auto& it : _learned) {
+        std::unique_lock<std::mutex> lock(it.second->lock);
+        count += it.second->heuristic.size();
+    }
+
+    return (int)count;
+}
+
+static bool _same_settings(const pathfinding::Settings& a, const pathfinding::Settings& b) {
+    return a.max_jump_height == b.max_jump_height && a.air_stride == b.air_stride &&
+        a.width == b.width && a.height == b.height && a.ledge_hang == b.ledge_hang &&
+        a.costs.up == b.costs.up && a.costs.down == b.costs.down && a.costs.level == b.costs.level &&
+        a.costs.ledge_climb == b.costs.ledge_climb && a.costs.character == b.costs.character &&
+        a.costs.hazard == b.costs.hazard;
+}
+
+// The level alone, without agents or masses, for building databases
+bool Pathfinder::_snapshot_level(const pathfinding::Settings& settings, const pathfinding::Region& region, bool block, pathfinding::Graph& graph) {
+    pathfinding::Region footprint = pathfinding::search_footprint(settings, region, pathfinding::State::create(region.x, region.y));
+    if (!_graph->acquire(footprint, block)) return false;
+
+    _graph->snapshot(footprint, graph);
+    return true;
+}
+
+Error Pathfinder::build_path_database(Ref<CharacterParameters> character_parameters, PoolVector2Array points_world, Rect2 region) {
+    ERR_FAIL_COND_V(character_parameters.is_null(), ERR_INVALID_PARAMETER);
+    if (!_graph) return ERR_UNCONFIGURED;
+
+    const pathfinding::Settings& settings = character_parameters->settings();
+    ERR_FAIL_COND_V(!_jump_fits(settings), ERR_INVALID_PARAMETER);
+    pathfinding::Region rgion = _to_region(region);
+    ERR_FAIL_COND_V(rgion.w <= 0 || rgion.h <= 0, ERR_INVALID_PARAMETER);
+
+    std::vector<pathfinding::State> points;
+    {
+        PoolVector2Array::Read read = points_world.read();
+        for (int i = 0; i < points_world.size(); i++) {
+            Vector2 cell = _to_cell(read[i]);
+            points.push_back(pathfinding::State::create((int)cell.x, (int)cell.y));
+        }
+    }
+
+    pathfinding::Graph graph;
+    if (!_snapshot_level(settings, rgion, true, graph)) return ERR_CANT_ACQUIRE_RESOURCE;
+
+    auto database = std::make_shared<pathfinding::PathDatabase>();
+    database->build(graph, settings, rgion, points);
+
+    std::unique_lock<std::mutex> lock(_path_tables_lock);
+    PathTable& table = _path_tables[character_parameters->get_instance_id()];
+    table.database = database;
+    table.version = _graph->static_version();
+    table.building = false;
+    return OK;
+}
+
+Error Pathfinder::save_path_database(Ref<CharacterParameters> character_parameters, String path) {
+    ERR_FAIL_COND_V(character_parameters.is_null(), ERR_INVALID_PARAMETER);
+
+    std::shared_ptr<const pathfinding::PathDatabase> database;
+    {
+        std::unique_lock<std::mutex> lock(_path_tables_lock);
+        auto it = _path_tables.find(character_parameters->get_instance_id());
+        if (it == _path_tables.end()) return ERR_DOES_NOT_EXIST;
+        database = it->second.database;
+    }
+
+    std::string global_path = ProjectSettings::get_singleton()->globalize_path(path).utf8().get_data();
+    if (!database->save(global_path)) return ERR_FILE_CANT_WRITE;
+    return OK;
+}
+
+Error Pathfinder::load_path_database(Ref<CharacterParameters> character_parameters, String path) {
+    ERR_FAIL_COND_V(character_parameters.is_null(), ERR_INVALID_PARAMETER);
+    if (!_graph) return ERR_UNCONFIGURED;
+
+    auto database = std::make_shared<pathfinding::PathDatabase>();
+    std::string global_path = ProjectSettings::get_singleton()->globalize_path(path).utf8().get_data();
+    if (!database->load(global_path)) return ERR_FILE_CANT_OPEN;
+
+    // Built for a character that has changed since, its paths may not hold
+    if (!_same_settings(database->settings(), character_parameters->settings())) return ERR_INVALID_DATA;
+
+    std::unique_lock<std::mutex> lock(_path_tables_lock);
+    PathTable& table = _path_tables[character_parameters->get_instance_id()];
+    table.database = database;
+    table.version = _graph->static_version();
+    table.building = false;
+    return OK;
+}
+
+bool Pathfinder::has_path_database(Ref<CharacterParameters> character_parameters) {
+    if (character_parameters.is_null()) return false;
+
+    std::unique_lock<std::mutex> lock(_path_tables_lock);
+    return _path_tables.find(character_parameters->get_instance_id()) != _path_tables.end();
+}
+
+void Pathfinder::clear_path_databases() {
+    std::unique_lock<std::mutex> lock(_path_tables_lock);
+    _path_tables.clear();
+}
+
+void Pathfinder::_check_path_tables() {
+    if (!_graph || !_pool) return;
+
+    uint64_t version = _graph->static_version();
+
+    std::unique_lock<std::mutex> lock(_path_tables_lock);
+    for (auto& it : _path_tables) {
+        PathTable& table = it.second;
+        if (table.building || table.version == version) continue;
+
+        // Missing pages are tried again next frame
+        std::shared_ptr<const pathfinding::PathDatabase> source = table.database;
+        pathfinding::Graph graph;
+        if (!_snapshot_level(source->settings(), source->region(), _block_on_missing_pages, graph)) continue;
+
+        table.building = true;
+        ObjectID character = it.first;
+
+        _pool->push(
+            [this, character, source, graph, version]() {
+                auto database = std::make_shared<pathfinding::PathDatabase>();
+                database->build(graph, source->settings(), source->region(), source->points());
+
+                std::unique_lock<std::mutex> lock(_path_tables_lock);
+                auto it = _path_tables.find(character);
+                if (it == _path_tables.end()) return;
+
+                // One built or loaded in the meantime is newer than this
+                it->second.building = false;
+                if (it->second.database != source) return;
+
+                it->second.database = database;
+                it->second.version = version;
+            }
+        );
+    }
+}
+
+// Every cell a state of the path is in
+static pathfinding::Region _path_bounds(const std::vector<pathfinding::State>& states) {
+    pathfinding::Region bounds;
+    bounds.x = states[0].x;
+    bounds.y = states[0].y;
+    bounds.w = 1;
+    bounds.h = 1;
+
+    for (const pathfinding::State& state : states) {
+        pathfinding::Region cell;
+        cell.x = state.x;
+        cell.y = state.y;
+        cell.w = 1;
+        cell.h = 1;
+        bounds = pathfinding::region_union(bounds, cell);
+    }
+
+    return bounds;
+}
+
+// Covers every state of the path and the tiles around them the checks look at
+static pathfinding::Region _path_footprint(const pathfinding::Settings& settings, const std::vector<pathfinding::State>& states) {
+    return pathfinding::search_footprint(settings, _path_bounds(states), states[0]);
+}
+
+bool Pathfinder::_compute_path_from_table(
+    int id,
+    Ref<CharacterParameters> character_parameters,
+    const pathfinding::Region& region,
+    bool any_region,
+    const pathfinding::State& initial,
+    const std::vector<pathfinding::Region>& goals,
+    Object* obj, String method) {
+
+    if (character_parameters.is_null() || goals.size() != 1 || goals[0].w != 1 || goals[0].h != 1) return false;
+
+    std::shared_ptr<const pathfinding::PathDatabase> database;
+    {
+        std::unique_lock<std::mutex> lock(_path_tables_lock);
+        auto it = _path_tables.find(character_parameters->get_instance_id());
+        if (it == _path_tables.end() || it->second.version != _graph->static_version()) return false;
+        database = it->second.database;
+    }
+
+    if (!_same_settings(database->settings(), character_parameters->settings())) return false;
+
+    // A region that leaves out part of the database's may not allow its paths
+    pathfinding::Region covered = pathfinding::region_intersection(region, database->region());
+    if (!any_region && (covered.w != database->region().w || covered.h != database->region().h)) return false;
+
+    int from = database->point_index(initial.x, initial.y);
+    int to = database->point_index(goals[0].x, goals[0].y);
+    if (from < 0 || to < 0) return false;
+
+    uint64_t started_usec = OS::get_singleton()->get_ticks_usec();
+
+    pathfinding::PathOutput output = _path_output();
+
+    // Keypoints read the tiles along the path, a streamed graph may have evicted some so they are pinned first
+    std::vector<pathfinding::State> path;
+    const pathfinding::Graph* tiles = &_graph->graph();
+    pathfinding::Graph pinned;
+    if (output != pathfinding::PathOutput_Full && _graph->streaming_get()) {
+        if (!database->find(pinned, from, to, path)) return false;
+
+        pathfinding::Region footprint = _path_footprint(database->settings(), path);
+        if (!_graph->acquire(footprint, _block_on_missing_pages)) return false;
+
+        _graph->snapshot(footprint, pinned);
+        tiles = &pinned;
+    }
+
+    if (!database->find(*tiles, from, to, path, output)) return false;
+
+    Dictionary dict;
+    _path_to_dictionary(path, 0, output == pathfinding::PathOutput_Full, _result_format, dict);
+    dict["lod"] = false;
+    dict["database"] = true;
+    if (_collect_statistics) {
+        pathfinding::SearchStats stats;
+        stats.search_usec = OS::get_singleton()->get_ticks_usec() - started_usec;
+        dict["stats"] = _stats_to_dictionary(stats, 0);
+    }
+
+    if (!_pool) {
+        if (obj && obj->has_method(method)) obj->call(method, dict);
+        return true;
+    }
+
+    _callbacks[id] = std::pair<Object*, String>(obj, method);
+    _in_flight++;
+
+    std::unique_lock<std::mutex> lock(_lock);
+    _results.push_back(std::pair<unsigned int, Dictionary>(id, dict));
+    _record_completion(started_usec);
+    return true;
+}
+
+int Pathfinder::compute_paths_cooperative(Array agents_world, Rect2 region, Array dynamic_masses_world, Object* obj, String method) {
+    if (!_graph) {
+        return -1;
+    }
+
+    pathfinding::Region rgion = _to_region(region);
+
+    // Agents are planned in array order, earlier ones get the right of way
+    std::vector<pathfinding::CooperativeAgent> agents;
+    pathfinding::Region footprint;
+
+    for (int i = 0; i < agents_world.size(); i++) {
+        Dictionary agent_world = agents_world[i];
+        Ref<CharacterParameters> character_parameters = agent_world.get("character_parameters", Variant());
+
+        pathfinding::CooperativeAgent agent;
+        agent.id = agent_world.get("id", i);
+        agent.settings = _settings_of(character_parameters);
+        ERR_FAIL_COND_V(!_jump_fits(agent.settings), -1);
+
+        Vector2 initialv = _to_cell(agent_world.get("initial", Vector2()));
+        agent.initial = pathfinding::State::create((int)initialv.x, (int)initialv.y);
+
+        Array goals_world;
+        if (agent_world.has("goals")) goals_world = agent_world["goals"];
+        else goals_world.push_back(agent_world.get("goal", Variant()));
+        agent.goals = _to_goals(goals_world);
+
+        pathfinding::Region agent_footprint = pathfinding::search_footprint(agent.settings, rgion, agent.initial);
+        footprint = agents.empty() ? agent_footprint : pathfinding::region_union(footprint, agent_footprint);
+
+        agents.push_back(agent);
+    }
+
+    int id = _id_counter++;
+    _id_counter = _id_counter % (1 << 30);
+
+    pathfinding::Graph graph;
+    if (agents.empty() || !_prepare_graph(footprint, _to_masses(dynamic_masses_world), -1, graph, false)) {
+        _fail_async(id, obj, method);
+        return id;
+    }
+
+    // One graph serves the whole batch, so it can't leave out each agent's own footprint
+    graph.set_occupancy(pathfinding::OccupancyRef());
+
+    _compute_paths_cooperative_async(id, graph, rgion, agents, obj, method);
+
+    return id;
+}
+
+int Pathfinder::reachable_set(Vector2 initial_world, Ref<CharacterParameters> character_parameters, int max_cost, Rect2 region, Array dynamic_masses_world, Object* obj, String method, int agent) {
+    if (!_graph) {
+        return -1;
+    }
+
+    const pathfinding::Settings& settings = _settings_of(character_parameters);
+    ERR_FAIL_COND_V(!_jump_fits(settings), -1);
+
+    Vector2 initialv = _to_cell(initial_world);
+    auto initial = pathfinding::State::create((int)initialv.x, (int)initialv.y);
+
+    pathfinding::Region rgion = _to_region(region);
+
+    int id = _id_counter++;
+    _id_counter = _id_counter % (1 << 30);
+
+    pathfinding::Graph graph;
+    if (!_prepare_graph(pathfinding::search_footprint(settings, rgion, initial), _to_masses(dynamic_masses_world), agent, graph, false)) {
+        _fail_async(id, obj, method);
+        return id;
+    }
+
+    _reachable_set_async(id, graph, settings, rgion, initial, max_cost, obj, method);
+
+    return id;
+}
+
+int Pathfinder::validate_path(Ref<PathResult> path, Ref<CharacterParameters> character_parameters, Array dynamic_masses_world, int agent) {
+    ERR_FAIL_COND_V(path.is_null() || !path->is_full(), 0);
+    if (!_graph || path->size() == 0) return 0;
+
+    const pathfinding::Settings& settings = _settings_of(character_parameters);
+    ERR_FAIL_COND_V(!_jump_fits(settings), 0);
+    const std::vector<pathfinding::State>& states = path->states();
+
+    // A path over pages that can't be loaded can't be trusted
+    pathfinding::Graph graph;
+    if (!_prepare_graph(_path_footprint(settings, states), _to_masses(dynamic_masses_world), agent, graph, false)) return 0;
+
+    return pathfinding::validate_path(graph, settings, states);
+}
+
+bool Pathfinder::repair_path(Ref<PathResult> path, Ref<CharacterParameters> character_parameters, Rect2 region, Array dynamic_masses_world, int agent) {
+    ERR_FAIL_COND_V(path.is_null() || !path->is_full(), false);
+    if (!_graph || path->size() == 0) return false;
+
+    const pathfinding::Settings& settings = _settings_of(character_parameters);
+    ERR_FAIL_COND_V(!_jump_fits(settings), false);
+    std::vector<pathfinding::State> states = path->states();
+    pathfinding::Region rgion = _to_region(region);
+
+    // An empty region gives every stretch its own window, each one falls inside the window around the whole path
+    pathfinding::Region bounds = rgion;
+    if (rgion.w <= 0 || rgion.h <= 0) {
+        rgion = pathfinding::Region { 0, 0, 0, 0 };
+        bounds = pathfinding::widen_window(pathfinding::search_window(settings, states[0], std::vector<pathfinding::Region>(1, _path_bounds(states))));
+    }
+
+    pathfinding::Graph graph;
+    if (!_prepare_graph(pathfinding::search_footprint(settings, bounds, states[0]), _to_masses(dynamic_masses_world), agent, graph, false)) return false;
+
+    // Left as it was unless every broken stretch could be bridged
+    if (!pathfinding::repair_path(graph, settings, rgion, states)) return false;
+
+    path->set(states, path->get_goal(), true);
+    return true;
+}
+
 void Pathfinder::cancel(int id) {
     _callbacks.erase(id);
 }
 
+// Every format is written in one pass into storage sized up front
+void Pathfinder::_path_to_dictionary(std::vector<pathfinding::State>& path, int goal_index, bool full, ResultFormat format, Dictionary& dict) {
+    switch (format) {
+        case ResultPacked:
+            dict["packed"] = PathResult::packed(path);
+            break;
+        case ResultHandle:
+        {
+            Ref<PathResult> handle;
+            handle.instance();
+            handle->set(path, goal_index, full);
+            dict["handle"] = handle;
+            break;
+        }
+        default:
+            dict["path"] = PathResult::positions(path);
+            dict["scenarios"] = PathResult::scenarios(path);
+            break;
+    }
+
+    dict["goal"] = goal_index;
+}
+
+void Pathfinder::_fail_async(int id, Object* obj, String method) {
+    if (!_pool) {
+        if (!obj || !obj->has_method(method)) return;
+        obj->call(method, Dictionary());
+        return;
+    }
+
+    _callbacks[id] = std::pair<Object*, String>(obj, method);
+
+    std::unique_lock<std::mutex> lock(_lock);
+    _results.push_back(std::pair<unsigned int, Dictionary>(id, Dictionary()));
+}
+
 void Pathfinder::_compute_path_async(
     int id,
     const pathfinding::Graph& graph,
+    const pathfinding::Graph& coarse_graph,
+    bool coarse,
+    bool widening,
     const pathfinding::Settings& settings,
     const pathfinding::Region& region,
     const pathfinding::State& initial,
-    const int goal_x, const int goal_y,
+    const std::vector<pathfinding::Region>& goals,
     Object* obj, String method) {
     
     if (!_pool) {
@@ -177,30 +1173,225 @@ void Pathfinder::_compute_path_async(
 
     _callbacks[id] = std::pair<Object*, String>(obj, method);
 
+    uint64_t queued_usec = OS::get_singleton()->get_ticks_usec();
+    bool collect_statistics = _collect_statistics;
+    bool lazy = _lazy_evaluation;
+    ResultFormat result_format = _result_format;
+    _in_flight++;
+
+    // Keypoints are picked while the path is reconstructed, there is no filter pass
+    pathfinding::PathOutput output = _path_output();
+
+    std::shared_ptr<pathfinding::ParallelWorkers> workers;
+    if (_search_threads(region, widening) > 1) workers = _parallel_workers;
+
+    _pool->push(
+        [this, id, region, graph, coarse_graph, coarse, widening, settings, initial, goals, queued_usec, collect_statistics, lazy, workers, result_format, output]() {
+            uint64_t queue_wait_usec = OS::get_singleton()->get_ticks_usec() - queued_usec;
+
+            std::vector<pathfinding::State> path;
+            pathfinding::SearchStats stats;
+
+            int goal_index;
+            bool lod = coarse && pathfinding::coarse_search(coarse_graph, settings, region, initial, goals, path, goal_index, collect_statistics ? &stats : nullptr, output);
+
+            // Blocks lose passages narrower than themselves, a miss is searched again in full detail
+            if (!lod && widening) pathfinding::search_widening(graph, settings, region, initial, goals, path, goal_index, collect_statistics ? &stats : nullptr, output, lazy);
+            else if (!lod && workers) pathfinding::parallel_search(graph, settings, region, initial, goals, path, goal_index, *workers, collect_statistics ? &stats : nullptr, output, lazy);
+            else if (!lod) pathfinding::search(graph, settings, region, initial, goals, path, goal_index, collect_statistics ? &stats : nullptr, output, lazy);
+
+            // Coarse states are blocks apart, so they never make a full path
+            Dictionary dict;
+            _path_to_dictionary(path, goal_index, output == pathfinding::PathOutput_Full && !lod, result_format, dict);
+            dict["lod"] = lod;
+            dict["database"] = false;
+            if (collect_statistics) {
+                dict["stats"] = _stats_to_dictionary(stats, queue_wait_usec);
+            }
+
+            {
+                std::unique_lock<std::mutex> lock(_lock);
+                this->_results.push_back(std::pair<unsigned int, Dictionary>(id, dict));
+                _record_completion(queued_usec);
+            }
+        }
+    );
+}
+
+void Pathfinder::_compute_paths_cooperative_async(
+    int id,
+    const pathfinding::Graph& graph,
+    const pathfinding::Region& region,
+    const std::vector<pathfinding::CooperativeAgent>& agents,
+    Object* obj, String method) {
+
+    if (!_pool) {
+        if (!obj || !obj->has_method(method)) return;
+        obj->call(method, Dictionary());
+        return;
+    }
+
+    _callbacks[id] = std::pair<Object*, String>(obj, method);
+
+    uint64_t queued_usec = OS::get_singleton()->get_ticks_usec();
+    ResultFormat result_format = _result_format;
+    _in_flight++;
+
+    _pool->push(
+        [this, id, region, graph, agents, queued_usec, result_format]() {
+            std::vector<pathfinding::CooperativePath> paths;
+
+            // Batches claim from the same table, so they are planned one after another
+            std::unique_lock<std::mutex> planning(_cooperative_lock);
+
+            pathfinding::ReservationTable table;
+            {
+                std::unique_lock<std::mutex> lock(_reservations_lock);
+                table = _reservations;
+            }
+
+            // The main thread can advance or clear the table meanwhile without waiting on the searches
+            uint32_t planned_at = table.now();
+            int window = table.horizon();
+            pathfinding::cooperative_plan(graph, region, agents, table, window, paths);
+
+            {
+                std::unique_lock<std::mutex> lock(_reservations_lock);
+                pathfinding::cooperative_claim(agents, paths, window, planned_at, _reservations);
+            }
+
+            planning.unlock();
+
+            Array results;
+            for (size_t i = 0; i < paths.size(); i++) {
+                Dictionary agent;
+                agent["id"] = agents[i].id;
+                agent["cooperative"] = paths[i].cooperative;
+                _path_to_dictionary(paths[i].states, paths[i].goal_index, false, result_format, agent);
+                results.push_back(agent);
+            }
+
+            Dictionary dict;
+            dict["paths"] = results;
+
+            {
+                std::unique_lock<std::mutex> lock(_lock);
+                this->_results.push_back(std::pair<unsigned int, Dictionary>(id, dict));
+                _record_completion(queued_usec);
+            }
+        }
+    );
+}
+
+void Pathfinder::_compute_path_realtime_async(
+    int id,
+    const pathfinding::Graph& graph,
+    const pathfinding::Settings& settings,
+    const pathfinding::Region& region,
+    const pathfinding::State& initial,
+    int lookahead,
+    const std::shared_ptr<LearnedTable>& table,
+    Object* obj, String method) {
+
+    if (!_pool) {
+        if (!obj || !obj->has_method(method)) return;
+        obj->call(method, Dictionary());
+        return;
+    }
+
+    _callbacks[id] = std::pair<Object*, String>(obj, method);
+
+    uint64_t queued_usec = OS::get_singleton()->get_ticks_usec();
+    bool collect_statistics = _collect_statistics;
+    ResultFormat result_format = _result_format;
+    _in_flight++;
+
     _pool->push(
-        [this, id, region, graph, settings, initial, goal_x, goal_y]() {
+        [this, id, region, graph, settings, initial, lookahead, table, queued_usec, collect_statistics, result_format]() {
+            uint64_t queue_wait_usec = OS::get_singleton()->get_ticks_usec() - queued_usec;
+
             std::vector<pathfinding::State> path;
+            pathfinding::SearchStats stats;
+            int goal_index;
+            size_t learned;
 
-            pathfinding::search(graph, settings, region, initial, goal_x, goal_y, path);
+            {
+                std::unique_lock<std::mutex> lock(table->lock);
+                pathfinding::realtime_search(graph, settings, region, initial, lookahead, table->heuristic, path, goal_index, collect_statistics ? &stats : nullptr);
+                learned = table->heuristic.size();
+            }
 
-            if (_filtered) {
-                pathfinding::filter(graph, settings, path);
+            Dictionary dict;
+            _path_to_dictionary(path, goal_index, true, result_format, dict);
+            dict["reached"] = goal_index >= 0;
+            dict["learned"] = (int)learned;
+            if (collect_statistics) {
+                dict["stats"] = _stats_to_dictionary(stats, queue_wait_usec);
             }
 
-            PoolVector2Array gd_path;
+            {
+                std::unique_lock<std::mutex> lock(_lock);
+                this->_results.push_back(std::pair<unsigned int, Dictionary>(id, dict));
+                _record_completion(queued_usec);
+            }
+        }
+    );
+}
+
+void Pathfinder::_reachable_set_async(
+    int id,
+    const pathfinding::Graph& graph,
+    const pathfinding::Settings& settings,
+    const pathfinding::Region& region,
+    const pathfinding::State& initial,
+    const int max_cost,
+    Object* obj, String method) {
+
+    if (!_pool) {
+        if (!obj || !obj->has_method(method)) return;
+        obj->call(method, Dictionary());
+        return;
+    }
+
+    _callbacks[id] = std::pair<Object*, String>(obj, method);
+
+    uint64_t queued_usec = OS::get_singleton()->get_ticks_usec();
+    _in_flight++;
+
+    _pool->push(
+        [this, id, region, graph, settings, initial, max_cost, queued_usec]() {
+            std::vector<pathfinding::Reach> reached;
+
+            pathfinding::reachable_set(graph, settings, region, initial, max_cost, reached);
+
+            PoolVector2Array cells;
+            PoolIntArray costs;
             PoolIntArray scenarios;
-            for (auto& state : path) {
-                gd_path.push_back(Vector2(state.x, state.y));
-                scenarios.push_back((Scenario)state.scenario_meta);
+            cells.resize(reached.size());
+            costs.resize(reached.size());
+            scenarios.resize(reached.size());
+
+            {
+                PoolVector2Array::Write cells_write = cells.write();
+                PoolIntArray::Write costs_write = costs.write();
+                PoolIntArray::Write scenarios_write = scenarios.write();
+
+                for (int i = 0; i < (int)reached.size(); i++) {
+                    cells_write[i] = Vector2(reached[i].x, reached[i].y);
+                    costs_write[i] = reached[i].cost;
+                    scenarios_write[i] = reached[i].scenario_meta;
+                }
             }
-                
+
             Dictionary dict;
-            dict["path"] = gd_path;
+            dict["cells"] = cells;
+            dict["costs"] = costs;
             dict["scenarios"] = scenarios;
 
             {
                 std::unique_lock<std::mutex> lock(_lock);
                 this->_results.push_back(std::pair<unsigned int, Dictionary>(id, dict));
+                _record_completion(queued_usec);
             }
         }
     );
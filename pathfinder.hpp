@@ -5,14 +5,45 @@
 #include "character_parameters.hpp"
 #include "grid.hpp"
 #include "gridded_graph.hpp"
+#include "path_result.hpp"
 #include "tools/threadpool.hpp"
+#include "pathfinding/cooperative.hpp"
 #include "pathfinding/graph.hpp"
+#include "pathfinding/lod.hpp"
+#include "pathfinding/occupancy.hpp"
+#include "pathfinding/parallel.hpp"
+#include "pathfinding/path_database.hpp"
+#include "pathfinding/realtime.hpp"
+#include "pathfinding/repair.hpp"
+#include "pathfinding/search.hpp"
+#include "pathfinding/trace.hpp"
 
 #include "core/map.h"
 
+#include <atomic>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <unordered_set>
+
+// Upper bounds in microseconds, the last bucket catches everything slower
+#define PATHFINDER_LATENCY_BUCKETS 11
+
+// How many times an automatic region may double its first window, see pathfinding::search_widening
+#define PATHFINDER_AUTO_WIDENINGS 4
+
 class Pathfinder : public Node {
     GDCLASS(Pathfinder, Node);
 
+public:
+    enum ResultFormat {
+        ResultArrays = 0,
+        ResultPacked = 1,
+        ResultHandle = 2,
+    };
+
+private:
+
     NodePath _initial_graph_path;
     void _initial_graph_path_set(NodePath graph_path);
     NodePath _initial_graph_path_get() const;
@@ -25,6 +56,27 @@ class Pathfinder : public Node {
     void _filtered_set(bool value);
     bool _filtered_get() const;
 
+    bool _shortened;
+    void _shortened_set(bool value);
+    bool _shortened_get() const;
+
+    // See pathfinding::search, for tall and wide characters
+    bool _lazy_evaluation;
+    void _lazy_evaluation_set(bool value);
+    bool _lazy_evaluation_get() const;
+
+    ResultFormat _result_format;
+    void _result_format_set(ResultFormat value);
+    ResultFormat _result_format_get() const;
+
+    bool _block_on_missing_pages;
+    void _block_on_missing_pages_set(bool value);
+    bool _block_on_missing_pages_get() const;
+
+    bool _collect_statistics;
+    void _collect_statistics_set(bool value);
+    bool _collect_statistics_get() const;
+
     int _max_concurrency;
     ThreadPool* _pool;
     unsigned int _id_counter;
@@ -33,13 +85,158 @@ class Pathfinder : public Node {
     std::unordered_map<int, std::pair<Object*, String>> _callbacks;
     std::vector<std::pair<int, Dictionary>> _results;
 
+    // Rolling statistics, everything but _in_flight is guarded by _lock
+    std::atomic<int> _in_flight;
+    uint64_t _completed;
+    uint64_t _latency_histogram[PATHFINDER_LATENCY_BUCKETS];
+    uint64_t _window_started_usec;
+    uint64_t _window_completed;
+    float _queries_per_second;
+
+    // Claims of cooperatively planned agents, shared by every batch and kept across frames
+    pathfinding::ReservationTable _reservations;
+    std::mutex _reservations_lock;
+
+    // Batches plan on a copy of the table one after another, the table itself is only locked to copy and claim
+    std::mutex _cooperative_lock;
+    int _reservation_window;
+    void _reservation_window_set(int value);
+    int _reservation_window_get() const;
+
+    // Registered agents, rasterized into one shared layer at the start of a frame when any changed
+    std::unordered_map<int, Rect2> _agents;
+    bool _agents_changed;
+    std::vector<std::pair<int32_t, pathfinding::Region>> _occupants;
+    pathfinding::OccupancyRef _occupancy;
+    uint64_t _occupancy_version;
+    void _rebuild_occupancy();
+
+    // Queues the pages around every registered agent on a streamed graph
+    void _prefetch_agents();
+
+    // Queries starting further than the radius from the focus run on the coarse graph, 0 turns it off
+    Vector2 _lod_focus;
+    void _lod_focus_set(Vector2 value);
+    Vector2 _lod_focus_get() const;
+
+    float _lod_radius;
+    void _lod_radius_set(float value);
+    float _lod_radius_get() const;
+
+    // Queries with a region of at least the area search with that many threads, see pathfinding::parallel_search.
+    // The threads are kept next to the pool and serve one query at a time, 1 turns it off. Experimental, off by default
+    int _parallel_threads;
+    void _parallel_threads_set(int value);
+    int _parallel_threads_get() const;
+
+    int _parallel_min_area;
+    void _parallel_min_area_set(int value);
+    int _parallel_min_area_get() const;
+
+    // Replaced when the thread count changes, queries still running keep the old ones alive
+    std::shared_ptr<pathfinding::ParallelWorkers> _parallel_workers;
+    int _search_threads(const pathfinding::Region& region, bool widening) const;
+
+    // Registered agents that were last given a coarse path, signalled once they come within the radius
+    std::unordered_set<int> _coarse_agents;
+    bool _is_distant(Vector2 world_position) const;
+    void _check_refinement();
+
+    // Heuristics learned by realtime queries, one per character and goal cell. Ticks for the same goal take turns
+    struct LearnedTable {
+        std::mutex lock;
+        pathfinding::LearnedHeuristic heuristic;
+    };
+
+    std::map<std::tuple<ObjectID, int, int>, std::shared_ptr<LearnedTable>> _learned;
+
+    // Paths between points of interest, one database per character, rebuilt on the pool once the level changes
+    struct PathTable {
+        std::shared_ptr<const pathfinding::PathDatabase> database;
+        uint64_t version;
+        bool building;
+    };
+
+    std::map<ObjectID, PathTable> _path_tables;
+    std::mutex _path_tables_lock;
+    void _check_path_tables();
+    bool _snapshot_level(const pathfinding::Settings& settings, const pathfinding::Region& region, bool block, pathfinding::Graph& graph);
+
+    bool _compute_path_from_table(
+        int id,
+        Ref<CharacterParameters> character_parameters,
+        const pathfinding::Region& region,
+        bool any_region,
+        const pathfinding::State& initial,
+        const std::vector<pathfinding::Region>& goals,
+        Object* object, String method);
+
+    // Inputs of every query go to the trace while it is open, the graph only when it changed
+    pathfinding::TraceWriter _trace;
+    bool _trace_has_graph;
+    uint64_t _trace_graph_version;
+    uint32_t _trace_graph;
+
+    void _record_completion(uint64_t queued_usec);
+
+    // From filtered and shortened, read on the main thread only, queries carry it by value
+    pathfinding::PathOutput _path_output() const;
+    Dictionary _stats_to_dictionary(const pathfinding::SearchStats& stats, uint64_t queue_wait_usec) const;
+
+    Vector2 _to_cell(Vector2 world_position) const;
+    pathfinding::Region _to_region(Rect2 region) const;
+    pathfinding::Region _to_mass(Rect2 mass_world) const;
+
+    bool _prepare_graph(
+        const pathfinding::Region& footprint,
+        const std::vector<pathfinding::Region>& dynamic_masses,
+        int agent,
+        pathfinding::Graph& graph,
+        bool traced);
+
+    std::vector<pathfinding::Region> _to_goals(Array goals_world) const;
+    std::vector<pathfinding::Region> _to_masses(Array dynamic_masses_world) const;
+
+    static void _path_to_dictionary(std::vector<pathfinding::State>& path, int goal_index, bool full, ResultFormat format, Dictionary& dict);
+
+    void _fail_async(int id, Object* object, String method);
+
     void _compute_path_async(
+        int id,
+        const pathfinding::Graph& graph,
+        const pathfinding::Graph& coarse_graph,
+        bool coarse,
+        bool widening,
+        const pathfinding::Settings& settings,
+        const pathfinding::Region& region,
+        const pathfinding::State& initial,
+        const std::vector<pathfinding::Region>& goals,
+        Object* object, String method);
+
+    void _compute_paths_cooperative_async(
+        int id,
+        const pathfinding::Graph& graph,
+        const pathfinding::Region& region,
+        const std::vector<pathfinding::CooperativeAgent>& agents,
+        Object* object, String method);
+
+    void _compute_path_realtime_async(
         int id,
         const pathfinding::Graph& graph,
         const pathfinding::Settings& settings,
         const pathfinding::Region& region,
         const pathfinding::State& initial,
-        const int goal_x, const int goal_y,
+        int lookahead,
+        const std::shared_ptr<LearnedTable>& table,
+        Object* object, String method);
+
+    void _reachable_set_async(
+        int id,
+        const pathfinding::Graph& graph,
+        const pathfinding::Settings& settings,
+        const pathfinding::Region& region,
+        const pathfinding::State& initial,
+        const int max_cost,
         Object* object, String method);
         
 
@@ -54,9 +251,62 @@ public:
 
     void _do_callbacks();
 
-    int compute_path(Vector2 initial, Vector2 goal, Ref<CharacterParameters> character_parameters, Rect2 region, Array dynamic_masses_world, Object* object, String method);
+    /*
+     * A registered agent passes its id so its own footprint isn't an obstacle, -1 for anything else.
+     * Queries starting far from lod_focus run on the coarse graph and set "lod" in their result,
+     * registered agents are then signalled with lod_refine once they come close. An empty region
+     * starts around initial and the goals and widens until a path turns up.
+     */
+    int compute_path(Vector2 initial, Vector2 goal, Ref<CharacterParameters> character_parameters, Rect2 region, Array dynamic_masses_world, Object* object, String method, int agent = -1);
+    int compute_path_to_any(Vector2 initial, Array goals, Ref<CharacterParameters> character_parameters, Rect2 region, Array dynamic_masses_world, Object* object, String method, int agent = -1);
+    // One state per time step for each agent, see pathfinding::cooperative_plan. Registered agents aren't obstacles here
+    // since a batch shares one graph, pass the ones outside the batch as dynamic masses
+    int compute_paths_cooperative(Array agents, Rect2 region, Array dynamic_masses_world, Object* object, String method);
+    void advance_reservations(int steps = 1);
+    void clear_reservations();
+
+    // One tick of a realtime search, the path leads to where the next tick should start, see pathfinding::realtime_search.
+    // An empty region searches everything the lookahead can reach
+    int compute_path_realtime(Vector2 initial, Vector2 goal, Ref<CharacterParameters> character_parameters, int lookahead, Rect2 region, Array dynamic_masses_world, Object* object, String method, int agent = -1);
+    void clear_learned_heuristics();
+    int get_learned_state_count();
+
+    /*
+     * Cheapest paths between every pair of points inside the region, built right away. compute_path
+     * answers from it, with "database" set in the result, when both ends are points of the character's database, there are no dynamic
+     * masses, and the query gives no region or one covering the database's. Other agents are walked
+     * through as if they weren't there. Changes to the level rebuild it in the background, queries
+     * search as usual until that is done.
+     */
+    Error build_path_database(Ref<CharacterParameters> character_parameters, PoolVector2Array points, Rect2 region);
+    Error save_path_database(Ref<CharacterParameters> character_parameters, String path);
+    // Taken to be built for the level as it is now
+    Error load_path_database(Ref<CharacterParameters> character_parameters, String path);
+    bool has_path_database(Ref<CharacterParameters> character_parameters);
+    void clear_path_databases();
+
+    // Both run right away, they only touch the tiles around the path. Need a full path handle, see PathResult::is_full
+    int validate_path(Ref<PathResult> path, Ref<CharacterParameters> character_parameters, Array dynamic_masses_world, int agent = -1);
+    bool repair_path(Ref<PathResult> path, Ref<CharacterParameters> character_parameters, Rect2 region, Array dynamic_masses_world, int agent = -1);
+
+    int reachable_set(Vector2 initial, Ref<CharacterParameters> character_parameters, int max_cost, Rect2 region, Array dynamic_masses_world, Object* object, String method, int agent = -1);
     void cancel(int id);
 
+    // Ids are non-negative, changes show up in queries made after the next idle frame. A streamed graph prefetches around them every frame
+    void register_agent(int id, Rect2 world_rect);
+    void update_agent(int id, Rect2 world_rect);
+    void unregister_agent(int id);
+    void clear_agents();
+    int get_agent_count() const { return (int)_agents.size(); }
+    uint64_t get_occupancy_version() const { return _occupancy_version; }
+
+    Dictionary get_statistics();
+    void reset_statistics();
+
+    Error start_trace(String path);
+    void stop_trace();
+    bool is_tracing() const { return _trace.is_open(); }
+
     enum Scenario {
         None = pathfinding::Scenario_None,
         OnFloor = pathfinding::Scenario_OnFloor,
@@ -68,3 +318,4 @@ public:
 };
 
 VARIANT_ENUM_CAST(Pathfinder::Scenario);
+VARIANT_ENUM_CAST(Pathfinder::ResultFormat);
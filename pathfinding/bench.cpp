@@ -0,0 +1,407 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "parallel.hpp"
+#include "search.hpp"
+
+using namespace std;
+
+/*
+ * Generates platformer levels procedurally and runs a fixed set of queries on each one
+ * for every settings variant. Same seed, same levels and queries, so runs before and
+ * after a change to the core can be compared directly.
+ *
+ *   bench.out [--maps cave,tower,field,maze] [--sizes 64,128,256] [--queries 200]
+ *             [--seed 1] [--format text|csv|json] [--lazy 0|1] [--threads 1]
+ */
+
+struct Level {
+    string kind;
+    int size;
+    vector<uint8_t> solid;
+    pathfinding::Graph graph;
+    pathfinding::Region region;
+};
+
+struct Variant {
+    const char* name;
+    pathfinding::Settings settings;
+};
+
+struct Query {
+    pathfinding::State start;
+    int goal_x;
+    int goal_y;
+};
+
+struct Report {
+    string map;
+    int size;
+    string variant;
+    int queries;
+    int found;
+    double seconds;
+    double queries_per_second;
+    double p50_us;
+    double p99_us;
+    double mean_expanded;
+    double mean_generated;
+    double mean_tile_reads;
+    uint64_t frontier_peak;
+    long peak_rss_kb;
+};
+
+// Default costs, only the movement changes between variants
+static pathfinding::Settings _settings(int max_jump_height, unsigned int air_stride, unsigned int width, unsigned int height, bool ledge_hang) {
+    pathfinding::Settings settings;
+    settings.max_jump_height = max_jump_height;
+    settings.air_stride = air_stride;
+    settings.width = width;
+    settings.height = height;
+    settings.ledge_hang = ledge_hang;
+    return settings;
+}
+
+static const Variant _variants[] = {
+    { "small", _settings(3, 2, 1, 1, false) },
+    { "tall", _settings(4, 2, 1, 3, false) },
+    { "wide_ledge", _settings(3, 2, 2, 2, true) },
+};
+
+static inline uint8_t& _at(Level& level, int x, int y) { return level.solid[y * level.size + x]; }
+
+static void _border(Level& level) {
+    for (int i = 0; i < level.size; i++) {
+        _at(level, i, 0) = 1;
+        _at(level, i, level.size - 1) = 1;
+        _at(level, 0, i) = 1;
+        _at(level, level.size - 1, i) = 1;
+    }
+}
+
+// Cellular automaton caves, open pockets connected by rough slopes
+static void _generate_cave(Level& level, mt19937& rng) {
+    for (auto& tile : level.solid) tile = (rng() % 100) < 45;
+
+    vector<uint8_t> next(level.solid.size());
+    for (int step = 0; step < 4; step++) {
+        for (int y = 0; y < level.size; y++) {
+            for (int x = 0; x < level.size; x++) {
+                int walls = 0;
+                for (int dy = -1; dy <= 1; dy++) {
+                    for (int dx = -1; dx <= 1; dx++) {
+                        int nx = x + dx, ny = y + dy;
+                        if (nx < 0 || ny < 0 || nx >= level.size || ny >= level.size) walls++;
+                        else walls += level.solid[ny * level.size + nx];
+                    }
+                }
+                next[y * level.size + x] = walls >= 5;
+            }
+        }
+        level.solid.swap(next);
+    }
+}
+
+// Stacked storeys with a gap in each floor and stepping ledges in between
+static void _generate_tower(Level& level, mt19937& rng) {
+    const int storey = 8;
+    for (int y = storey; y < level.size; y += storey) {
+        int gap = 2 + rng() % (level.size - 8);
+        int gap_width = 3 + rng() % 3;
+        for (int x = 0; x < level.size; x++) {
+            if (x >= gap && x < gap + gap_width) continue;
+            _at(level, x, y) = 1;
+        }
+
+        for (int ledges = 0; ledges < level.size / 16; ledges++) {
+            int ledge_x = 1 + rng() % (level.size - 6);
+            int ledge_y = y - storey / 2;
+            if (ledge_y <= 0) continue;
+            for (int x = ledge_x; x < ledge_x + 4; x++) _at(level, x, ledge_y) = 1;
+        }
+    }
+}
+
+// Flat ground with platforms scattered over it
+static void _generate_open_field(Level& level, mt19937& rng) {
+    int platforms = level.size * level.size / 64;
+    for (int i = 0; i < platforms; i++) {
+        int length = 3 + rng() % 8;
+        int x = rng() % level.size;
+        int y = 2 + rng() % (level.size - 3);
+        for (int dx = 0; dx < length && x + dx < level.size; dx++) _at(level, x + dx, y) = 1;
+    }
+}
+
+// Recursive backtracker over 4x4 cells with one tile thick walls
+static void _generate_maze(Level& level, mt19937& rng) {
+    const int cell = 4;
+    int cells = (level.size - 1) / cell;
+
+    for (auto& tile : level.solid) tile = 1;
+
+    vector<uint8_t> seen(cells * cells, 0);
+    vector<int> stack(1, 0);
+    seen[0] = 1;
+
+    auto carve = [&level](int x0, int y0, int x1, int y1) {
+        for (int y = y0; y <= y1; y++) {
+            for (int x = x0; x <= x1; x++) _at(level, x, y) = 0;
+        }
+    };
+
+    carve(1, 1, cell - 1, cell - 1);
+
+    while (!stack.empty()) {
+        int current = stack.back();
+        int cx = current % cells, cy = current / cells;
+
+        int options[4];
+        int count = 0;
+        if (cx > 0 && !seen[current - 1]) options[count++] = current - 1;
+        if (cx < cells - 1 && !seen[current + 1]) options[count++] = current + 1;
+        if (cy > 0 && !seen[current - cells]) options[count++] = current - cells;
+        if (cy < cells - 1 && !seen[current + cells]) options[count++] = current + cells;
+
+        if (count == 0) {
+            stack.pop_back();
+            continue;
+        }
+
+        int next = options[rng() % count];
+        int nx = next % cells, ny = next / cells;
+        seen[next] = 1;
+        stack.push_back(next);
+
+        carve(nx * cell + 1, ny * cell + 1, nx * cell + cell - 1, ny * cell + cell - 1);
+        carve(min(cx, nx) * cell + 1, min(cy, ny) * cell + 1, max(cx, nx) * cell + cell - 1, max(cy, ny) * cell + cell - 1);
+    }
+}
+
+static bool _generate(const string& kind, int size, unsigned int seed, Level& level) {
+    mt19937 rng(seed);
+
+    level.kind = kind;
+    level.size = size;
+    level.solid.assign(size * size, 0);
+
+    if (kind == "cave") _generate_cave(level, rng);
+    else if (kind == "tower") _generate_tower(level, rng);
+    else if (kind == "field") _generate_open_field(level, rng);
+    else if (kind == "maze") _generate_maze(level, rng);
+    else return false;
+
+    _border(level);
+
+    level.graph.clear();
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            if (_at(level, x, y)) level.graph.set_at(x, y, pathfinding::FLOOR_TILEKIND);
+        }
+    }
+
+    level.region.x = 0;
+    level.region.y = 0;
+    level.region.w = size;
+    level.region.h = size;
+
+    return true;
+}
+
+// Queries go from one standable cell to another so most of them have an answer
+static void _queries(const Level& level, const pathfinding::Settings& settings, int count, unsigned int seed, vector<Query>& queries) {
+    vector<pathfinding::State> standable;
+    for (int y = 0; y < level.size; y++) {
+        for (int x = 0; x < level.size; x++) {
+            if (!level.graph.fits(settings, x, y)) continue;
+            if (!level.graph.on_floor(settings, x, y)) continue;
+            standable.push_back(pathfinding::State::create(x, y));
+        }
+    }
+
+    queries.clear();
+    if (standable.size() < 2) return;
+
+    mt19937 rng(seed);
+    for (int i = 0; i < count; i++) {
+        Query query;
+        query.start = standable[rng() % standable.size()];
+        const pathfinding::State& goal = standable[rng() % standable.size()];
+        query.goal_x = goal.x;
+        query.goal_y = goal.y;
+        queries.push_back(query);
+    }
+}
+
+static long _peak_rss_kb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static double _percentile(vector<double>& values, double percentile) {
+    if (values.empty()) return 0;
+    size_t index = (size_t)(percentile * (values.size() - 1));
+    nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+static void _run(const Level& level, const Variant& variant, const vector<Query>& queries, bool lazy, pathfinding::ParallelWorkers* workers, Report& report) {
+    vector<double> latencies;
+    latencies.reserve(queries.size());
+
+    pathfinding::SearchStats stats;
+    vector<pathfinding::State> path;
+    vector<pathfinding::Region> goals(1);
+    int found = 0;
+
+    auto begin = chrono::steady_clock::now();
+
+    for (const Query& query : queries) {
+        goals[0].x = query.goal_x;
+        goals[0].y = query.goal_y;
+        goals[0].w = 1;
+        goals[0].h = 1;
+
+        auto start = chrono::steady_clock::now();
+        int goal_index;
+        bool success = workers ?
+            pathfinding::parallel_search(level.graph, variant.settings, level.region, query.start, goals, path, goal_index, *workers, &stats, pathfinding::PathOutput_Full, lazy) :
+            pathfinding::search(level.graph, variant.settings, level.region, query.start, goals, path, goal_index, &stats, pathfinding::PathOutput_Full, lazy);
+        if (success) found++;
+        auto end = chrono::steady_clock::now();
+
+        latencies.push_back(chrono::duration<double, micro>(end - start).count());
+    }
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+
+    report.map = level.kind;
+    report.size = level.size;
+    report.variant = variant.name;
+    report.queries = (int)queries.size();
+    report.found = found;
+    report.seconds = seconds;
+    report.queries_per_second = seconds > 0 ? queries.size() / seconds : 0;
+    report.p50_us = _percentile(latencies, 0.50);
+    report.p99_us = _percentile(latencies, 0.99);
+    report.mean_expanded = queries.empty() ? 0 : (double)stats.expanded / queries.size();
+    report.mean_generated = queries.empty() ? 0 : (double)stats.generated / queries.size();
+    report.mean_tile_reads = queries.empty() ? 0 : (double)stats.tile_reads / queries.size();
+    report.frontier_peak = stats.frontier_peak;
+    report.peak_rss_kb = _peak_rss_kb();
+}
+
+static void _print_header(const string& format) {
+    if (format == "csv") {
+        printf("map,size,variant,queries,found,seconds,queries_per_second,p50_us,p99_us,mean_expanded,mean_generated,mean_tile_reads,frontier_peak,peak_rss_kb\n");
+    }
+    else if (format == "text") {
+        printf("%-6s %5s %-11s %7s %6s %10s %10s %10s %12s %10s\n",
+            "map", "size", "variant", "queries", "found", "q/s", "p50 us", "p99 us", "expanded", "rss kB");
+    }
+}
+
+static void _print(const string& format, const Report& report) {
+    if (format == "csv") {
+        printf("%s,%d,%s,%d,%d,%.6f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%llu,%ld\n",
+            report.map.c_str(), report.size, report.variant.c_str(), report.queries, report.found, report.seconds,
+            report.queries_per_second, report.p50_us, report.p99_us, report.mean_expanded, report.mean_generated,
+            report.mean_tile_reads, (unsigned long long)report.frontier_peak, report.peak_rss_kb);
+    }
+    else if (format == "json") {
+        printf("{\"map\":\"%s\",\"size\":%d,\"variant\":\"%s\",\"queries\":%d,\"found\":%d,\"seconds\":%.6f,"
+            "\"queries_per_second\":%.2f,\"p50_us\":%.2f,\"p99_us\":%.2f,\"mean_expanded\":%.2f,\"mean_generated\":%.2f,"
+            "\"mean_tile_reads\":%.2f,\"frontier_peak\":%llu,\"peak_rss_kb\":%ld}\n",
+            report.map.c_str(), report.size, report.variant.c_str(), report.queries, report.found, report.seconds,
+            report.queries_per_second, report.p50_us, report.p99_us, report.mean_expanded, report.mean_generated,
+            report.mean_tile_reads, (unsigned long long)report.frontier_peak, report.peak_rss_kb);
+    }
+    else {
+        printf("%-6s %5d %-11s %7d %6d %10.1f %10.1f %10.1f %12.1f %10ld\n",
+            report.map.c_str(), report.size, report.variant.c_str(), report.queries, report.found,
+            report.queries_per_second, report.p50_us, report.p99_us, report.mean_expanded, report.peak_rss_kb);
+    }
+    fflush(stdout);
+}
+
+static vector<string> _split(const string& list) {
+    vector<string> items;
+    stringstream in(list);
+    string item;
+    while (getline(in, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+int main(int cargs, char** args) {
+    vector<string> maps = _split("cave,tower,field,maze");
+    vector<string> sizes = _split("64,128,256");
+    int query_count = 200;
+    unsigned int seed = 1;
+    string format = "text";
+    bool lazy = false;
+    int threads = 1;
+
+    for (int i = 1; i < cargs; i++) {
+        string arg(args[i]);
+        if (i + 1 >= cargs) {
+            fprintf(stderr, "Missing value for %s\n", arg.c_str());
+            return 1;
+        }
+
+        string value(args[++i]);
+        if (arg == "--maps") maps = _split(value);
+        else if (arg == "--sizes") sizes = _split(value);
+        else if (arg == "--queries") query_count = atoi(value.c_str());
+        else if (arg == "--seed") seed = (unsigned int)atoi(value.c_str());
+        else if (arg == "--format") format = value;
+        else if (arg == "--lazy") lazy = atoi(value.c_str()) != 0;
+        else if (arg == "--threads") threads = atoi(value.c_str());
+        else {
+            fprintf(stderr, "Unknown argument: %s\n", arg.c_str());
+            return 1;
+        }
+    }
+
+    // Started once like Pathfinder does, queries only wake them
+    unique_ptr<pathfinding::ParallelWorkers> workers;
+    if (threads > 1) workers.reset(new pathfinding::ParallelWorkers(threads));
+
+    _print_header(format);
+
+    for (const string& map : maps) {
+        for (const string& size_arg : sizes) {
+            int size = atoi(size_arg.c_str());
+            if (size < 16) continue;
+
+            Level level;
+            if (!_generate(map, size, seed + size, level)) {
+                fprintf(stderr, "Unknown map: %s\n", map.c_str());
+                return 1;
+            }
+
+            for (const Variant& variant : _variants) {
+                vector<Query> queries;
+                _queries(level, variant.settings, query_count, seed * 7919 + size, queries);
+
+                Report report;
+                _run(level, variant, queries, lazy, workers.get(), report);
+                _print(format, report);
+            }
+        }
+    }
+
+    return 0;
+}
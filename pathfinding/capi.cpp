@@ -0,0 +1,222 @@
+#include "capi.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+#include "graph.hpp"
+#include "graph_file.hpp"
+#include "ring.hpp"
+#include "search.hpp"
+#include "state_key.hpp"
+
+// Same bound Pathfinder gives its automatic regions
+#define AUTO_WIDENINGS 4
+
+using namespace pathfinding;
+
+// Loaded graphs keep their file open, their pages point into its mapping
+struct pf_graph {
+    Graph graph;
+    GraphFile file;
+};
+
+struct pf_client {
+    SharedRing ring;
+};
+
+static Settings _settings(const pf_settings& in) {
+    Settings settings;
+    settings.max_jump_height = in.max_jump_height;
+    settings.air_stride = in.air_stride;
+    settings.width = in.width;
+    settings.height = in.height;
+    settings.ledge_hang = in.ledge_hang != 0;
+    settings.costs.up = in.costs.up;
+    settings.costs.down = in.costs.down;
+    settings.costs.level = in.costs.level;
+    settings.costs.ledge_climb = in.costs.ledge_climb;
+    settings.costs.character = in.costs.character;
+    settings.costs.hazard = in.costs.hazard;
+    return settings;
+}
+
+static inline Region _region(const pf_region& in) {
+    return Region { in.x, in.y, std::min(in.w, PF_MAX_REGION_SIZE), std::min(in.h, PF_MAX_REGION_SIZE) };
+}
+
+static inline bool _valid_position(int32_t x, int32_t y) {
+    return x > -PF_MAX_COORDINATE && x < PF_MAX_COORDINATE && y > -PF_MAX_COORDINATE && y < PF_MAX_COORDINATE;
+}
+
+// No search reaches further than a region can be wide, anything further out is rejected before the window math
+static inline bool _within_reach(const pf_request& request, int32_t x, int32_t y) {
+    return std::llabs((int64_t)x - request.initial_x) <= PF_MAX_REGION_SIZE && std::llabs((int64_t)y - request.initial_y) <= PF_MAX_REGION_SIZE;
+}
+
+static inline bool _valid_cost(int32_t cost) {
+    return cost >= 0 && cost <= PF_MAX_COST;
+}
+
+// Requests can come from another process through the ring, nothing in them is trusted
+static bool _valid(const pf_request& request) {
+    const pf_settings& settings = request.settings;
+
+    if (settings.width < 1 || settings.width > PF_MAX_CHARACTER_SIZE) return false;
+    if (settings.height < 1 || settings.height > PF_MAX_CHARACTER_SIZE) return false;
+    if (settings.air_stride < 2 || settings.air_stride > STATE_KEY_MAX_JUMP) return false;
+    if (settings.max_jump_height < 0 || settings.max_jump_height > STATE_KEY_MAX_JUMP) return false;
+
+    const pf_costs& costs = settings.costs;
+    if (!_valid_cost(costs.up) || !_valid_cost(costs.down) || !_valid_cost(costs.level)) return false;
+    if (!_valid_cost(costs.ledge_climb) || !_valid_cost(costs.character) || !_valid_cost(costs.hazard)) return false;
+
+    if (!_valid_position(request.initial_x, request.initial_y)) return false;
+    if (!_valid_position(request.region.x, request.region.y)) return false;
+
+    bool bounded = request.region.w > 0 && request.region.h > 0;
+    if (bounded && !_within_reach(request, request.region.x, request.region.y)) return false;
+
+    int goal_count = std::max(0, std::min(request.goal_count, PF_MAX_GOALS));
+    for (int i = 0; i < goal_count; i++) {
+        if (!_valid_position(request.goals[i].x, request.goals[i].y)) return false;
+        if (!_within_reach(request, request.goals[i].x, request.goals[i].y)) return false;
+    }
+
+    return true;
+}
+
+void pf_settings_default(pf_settings* settings) {
+    CostProfile costs;
+
+    settings->max_jump_height = 0;
+    settings->air_stride = 2;
+    settings->width = 1;
+    settings->height = 1;
+    settings->ledge_hang = 0;
+    settings->costs.up = costs.up;
+    settings->costs.down = costs.down;
+    settings->costs.level = costs.level;
+    settings->costs.ledge_climb = costs.ledge_climb;
+    settings->costs.character = costs.character;
+    settings->costs.hazard = costs.hazard;
+}
+
+pf_graph* pf_graph_create(void) {
+    return new pf_graph();
+}
+
+pf_graph* pf_graph_load(const char* path) {
+    pf_graph* graph = new pf_graph();
+
+    if (!path || !graph->file.open(path)) {
+        delete graph;
+        return nullptr;
+    }
+
+    graph->file.load(graph->graph);
+    return graph;
+}
+
+int32_t pf_graph_save(const pf_graph* graph, const char* path) {
+    if (!graph || !path) return 0;
+    return save_graph(graph->graph, path);
+}
+
+void pf_graph_destroy(pf_graph* graph) {
+    delete graph;
+}
+
+void pf_graph_set_tile(pf_graph* graph, int32_t x, int32_t y, int32_t kind) {
+    if (!graph || kind < PF_TILE_UNTRAVERSABLE || kind > PF_TILE_CHARACTER) return;
+    graph->graph.set_at(x, y, (TileKind)kind);
+}
+
+int32_t pf_graph_get_tile(const pf_graph* graph, int32_t x, int32_t y) {
+    if (!graph) return PF_TILE_AIR;
+    return graph->graph.get_at(x, y);
+}
+
+void pf_graph_set_cost(pf_graph* graph, int32_t x, int32_t y, uint8_t cost) {
+    if (!graph) return;
+    graph->graph.set_cost_at(x, y, cost);
+}
+
+int32_t pf_search(const pf_graph* graph, const pf_request* request, pf_response* response) {
+    response->id = request->id;
+    response->found = 0;
+    response->error = PF_OK;
+    response->goal_index = -1;
+    response->length = 0;
+
+    if (!graph || !_valid(*request)) {
+        response->error = PF_ERROR_INVALID_REQUEST;
+        return 0;
+    }
+
+    Settings settings = _settings(request->settings);
+
+    // Would come back not found from the search without saying why
+    if (Graph::calculate_jump_limit(settings) + (int)settings.air_stride > STATE_KEY_MAX_JUMP) {
+        response->error = PF_ERROR_JUMP_TOO_HIGH;
+        return 0;
+    }
+    State initial = State::create(request->initial_x, request->initial_y);
+
+    std::vector<Region> goals;
+    int goal_count = std::max(0, std::min(request->goal_count, PF_MAX_GOALS));
+    for (int i = 0; i < goal_count; i++) goals.push_back(_region(request->goals[i]));
+
+    PathOutput output = PathOutput_Full;
+    if (request->output == PF_OUTPUT_KEYPOINTS) output = PathOutput_Keypoints;
+    else if (request->output == PF_OUTPUT_SHORTENED) output = PathOutput_Shortened;
+
+    std::vector<State> path;
+    int goal_index;
+    bool found;
+
+    Region region = _region(request->region);
+    if (region.w <= 0 || region.h <= 0) found = search_widening(graph->graph, settings, widen_window(search_window(settings, initial, goals), AUTO_WIDENINGS), initial, goals, path, goal_index, nullptr, output);
+    else found = search(graph->graph, settings, region, initial, goals, path, goal_index, nullptr, output);
+
+    if (!found) return 0;
+
+    response->found = 1;
+    response->goal_index = goal_index;
+    response->length = (int32_t)path.size();
+
+    size_t count = std::min(path.size(), (size_t)PF_MAX_STATES);
+    for (size_t i = 0; i < count; i++) {
+        response->states[i].x = path[i].x;
+        response->states[i].y = path[i].y;
+        response->states[i].jump = path[i].jump;
+        response->states[i].scenario = path[i].scenario_meta;
+    }
+
+    return 1;
+}
+
+pf_client* pf_client_open(const char* name) {
+    pf_client* client = new pf_client();
+
+    if (!name || !client->ring.open(name)) {
+        delete client;
+        return nullptr;
+    }
+
+    return client;
+}
+
+void pf_client_close(pf_client* client) {
+    delete client;
+}
+
+int32_t pf_client_submit(pf_client* client, const pf_request* requests, int32_t count) {
+    if (!client || count <= 0) return 0;
+    return (int32_t)client->ring.ring()->requests.push(requests, (uint32_t)count);
+}
+
+int32_t pf_client_poll(pf_client* client, pf_response* responses, int32_t max_count) {
+    if (!client || max_count <= 0) return 0;
+    return (int32_t)client->ring.ring()->responses.pop(responses, (uint32_t)max_count);
+}
@@ -0,0 +1,151 @@
+#ifndef PATHFINDING_CAPI_H
+#define PATHFINDING_CAPI_H
+
+#include <stdint.h>
+
+/*
+ * C interface to the pathfinding core, for linking it without the engine. Graphs are
+ * opaque, everything else is plain structs so requests can be filled in place, and the
+ * same request and response structs go through the query server's ring buffer.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(_WIN32)
+#define PF_API __declspec(dllexport)
+#else
+#define PF_API __attribute__((visibility("default")))
+#endif
+
+#define PF_TILE_UNTRAVERSABLE 0
+#define PF_TILE_AIR 1
+#define PF_TILE_FLOOR 2
+#define PF_TILE_CHARACTER 3
+
+#define PF_OUTPUT_FULL 0
+#define PF_OUTPUT_KEYPOINTS 1
+#define PF_OUTPUT_SHORTENED 2
+
+// Why a response came back not found when the request was never searched
+#define PF_OK 0
+#define PF_ERROR_INVALID_REQUEST 1
+#define PF_ERROR_JUMP_TOO_HIGH 2
+
+#define PF_MAX_GOALS 8
+#define PF_MAX_STATES 256
+
+// Largest character a request may ask for, in tiles
+#define PF_MAX_CHARACTER_SIZE 64
+
+// Regions and goals are clamped to this many tiles a side, about as far as a search can reach
+#define PF_MAX_REGION_SIZE 0x10000
+
+// Highest any single cost may be, keeps path costs far from overflowing
+#define PF_MAX_COST 1024
+
+// Positions further out than this from the origin are rejected, and so are goals and regions
+// further than PF_MAX_REGION_SIZE from the initial position along either axis
+#define PF_MAX_COORDINATE 0x40000000
+
+typedef struct pf_graph pf_graph;
+typedef struct pf_client pf_client;
+
+typedef struct pf_costs {
+    int32_t up;
+    int32_t down;
+    int32_t level;
+    int32_t ledge_climb;
+    int32_t character;
+    int32_t hazard;
+} pf_costs;
+
+typedef struct pf_settings {
+    int32_t max_jump_height;
+    uint32_t air_stride;
+    uint32_t width;
+    uint32_t height;
+    int32_t ledge_hang;
+    pf_costs costs;
+} pf_settings;
+
+typedef struct pf_region {
+    int32_t x;
+    int32_t y;
+    int32_t w;
+    int32_t h;
+} pf_region;
+
+typedef struct pf_state {
+    int32_t x;
+    int32_t y;
+    int32_t jump;
+    int32_t scenario;
+} pf_state;
+
+// An empty region grows its own window, see pathfinding::search_widening
+typedef struct pf_request {
+    uint32_t id;
+    pf_settings settings;
+    pf_region region;
+    int32_t initial_x;
+    int32_t initial_y;
+    int32_t output;
+    int32_t goal_count;
+    pf_region goals[PF_MAX_GOALS];
+} pf_request;
+
+// length counts every state of the path, only the first PF_MAX_STATES are in states
+typedef struct pf_response {
+    uint32_t id;
+    int32_t found;
+    int32_t error;
+    int32_t goal_index;
+    int32_t length;
+    pf_state states[PF_MAX_STATES];
+} pf_response;
+
+// One tile wide and high, no jump, default costs
+PF_API void pf_settings_default(pf_settings* settings);
+
+PF_API pf_graph* pf_graph_create(void);
+// Maps a file written by pf_graph_save or GriddedGraph.save_graph, null when it can't be read
+PF_API pf_graph* pf_graph_load(const char* path);
+PF_API int32_t pf_graph_save(const pf_graph* graph, const char* path);
+PF_API void pf_graph_destroy(pf_graph* graph);
+
+PF_API void pf_graph_set_tile(pf_graph* graph, int32_t x, int32_t y, int32_t kind);
+PF_API int32_t pf_graph_get_tile(const pf_graph* graph, int32_t x, int32_t y);
+PF_API void pf_graph_set_cost(pf_graph* graph, int32_t x, int32_t y, uint8_t cost);
+
+/*
+ * Safe from any number of threads as long as the graph isn't changed meanwhile, returns
+ * found. Requests outside the limits above, with an air stride under 2 or a jump or
+ * stride over 255 aren't searched and come back not found with PF_ERROR_INVALID_REQUEST.
+ * A jump whose limit plus the air stride goes over 255 doesn't fit the search's state
+ * keys and comes back with PF_ERROR_JUMP_TOO_HIGH.
+ */
+PF_API int32_t pf_search(const pf_graph* graph, const pf_request* request, pf_response* response);
+
+/*
+ * Attaches to a running pathserver by the name it was started with, null when there is
+ * none. A server takes one client at a time, null too while another one is attached.
+ * A client that exits without pf_client_close keeps the server taken until it restarts.
+ */
+PF_API pf_client* pf_client_open(const char* name);
+PF_API void pf_client_close(pf_client* client);
+
+/*
+ * A client is meant for one thread. Submit returns how many requests fit in the ring,
+ * poll how many responses it copied out. Responses come back in any order, match them
+ * by id.
+ */
+PF_API int32_t pf_client_submit(pf_client* client, const pf_request* requests, int32_t count);
+PF_API int32_t pf_client_poll(pf_client* client, pf_response* responses, int32_t max_count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
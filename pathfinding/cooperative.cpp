@@ -0,0 +1,258 @@
+#include "tools/queue.hpp"
+#include "cooperative.hpp"
+#include "search.hpp"
+#include "state_key.hpp"
+
+#include <algorithm>
+
+#define TIME_SHIFT 44
+#define STATE_BITS ((1ULL << TIME_SHIFT) - 1)
+#define MAX_WINDOW 0xFFFF
+
+using namespace pathfinding;
+
+ReservationTable::ReservationTable(int horizon) : _now(0), _horizon(0) {
+    horizon_set(horizon);
+}
+
+void ReservationTable::horizon_set(int horizon) {
+    _horizon = std::max(1, std::min(horizon, MAX_WINDOW - 1));
+    clear();
+}
+
+void ReservationTable::clear() {
+    _cells.clear();
+    _slots.assign(_horizon + 1, std::vector<uint64_t>());
+}
+
+void ReservationTable::advance(int steps) {
+    for (int i = 0; i < steps; i++) {
+        std::vector<uint64_t>& slot = _slots[_now % _slots.size()];
+        for (uint64_t key : slot) _cells.erase(key);
+        slot.clear();
+
+        _now++;
+    }
+}
+
+void ReservationTable::release(int agent) {
+    for (auto it = _cells.begin(); it != _cells.end(); ) {
+        if (it->second == agent) it = _cells.erase(it);
+        else ++it;
+    }
+}
+
+bool ReservationTable::reserve(const Settings& settings, const State& state, int t, int agent) {
+    if (t < 0 || t > _horizon) return false;
+
+    uint32_t time = _now + t;
+    std::vector<uint64_t>& slot = _slots[time % _slots.size()];
+
+    for (int i = 0; i < (int)settings.width; i++) {
+        for (int j = 0; j < (int)settings.height; j++) {
+            uint64_t key = _key(state.x + i, state.y - j, time);
+            _cells[key] = agent;
+            slot.push_back(key);
+        }
+    }
+
+    return true;
+}
+
+bool ReservationTable::is_free(const Settings& settings, const State& state, int t, int agent) const {
+    if (t < 0 || t > _horizon || _cells.empty()) return true;
+
+    uint32_t time = _now + t;
+
+    for (int i = 0; i < (int)settings.width; i++) {
+        for (int j = 0; j < (int)settings.height; j++) {
+            auto it = _cells.find(_key(state.x + i, state.y - j, time));
+            if (it != _cells.end() && it->second != agent) return false;
+        }
+    }
+
+    return true;
+}
+
+struct TimedVisit {
+    uint64_t came_from;
+    int cost;
+    bool closed;
+};
+
+/*
+ * A state is held from the step it is entered until the step after, so two agents can't
+ * swap places or step into a tile the other is leaving.
+ */
+static inline bool _can_hold(const ReservationTable& table, const Settings& settings, const State& state, int t, int agent) {
+    return table.is_free(settings, state, t, agent) && table.is_free(settings, state, t + 1, agent);
+}
+
+// The goal has to stay free until the window ends, or a later agent would run into it
+static bool _can_stay(const ReservationTable& table, const Settings& settings, const State& state, int t, int window, int agent) {
+    for (int i = t; i <= window; i++) {
+        if (!table.is_free(settings, state, i, agent)) return false;
+    }
+
+    return true;
+}
+
+bool pathfinding::cooperative_search(
+    const Graph& graph,
+    const Settings& settings,
+    const Region& region,
+    State initial,
+    const std::vector<Region>& goals,
+    const ReservationTable& table,
+    int agent,
+    int window,
+    std::vector<State>& path,
+    int& goal_index) {
+
+    graph.contextualize(settings, initial);
+
+    goal_index = -1;
+    path.clear();
+
+    if (goals.empty()) return false;
+    if (graph.calculate_jump_limit(settings) + (int)settings.air_stride > STATE_KEY_MAX_JUMP) return false;
+
+    window = std::max(0, std::min(window, table.horizon()));
+
+    StatePacker packer(region, initial);
+    Region bounds = packer.clip(region);
+
+    StepCosts steps = min_step_costs(settings);
+    int wait_cost = std::max(std::min(steps.horizontal, std::min(steps.up, steps.down)), 1);
+
+    std::unordered_map<uint64_t, TimedVisit, StateKeyHash> visited;
+    tool::priority_queue<uint64_t, int> frontier;
+
+    uint64_t initial_key = packer.pack(initial);
+    frontier.put(initial_key, 0);
+    visited[initial_key] = TimedVisit { initial_key, 0, false };
+
+    State neighbors[MAX_NEIGHBORS];
+    uint64_t goal_key = initial_key;
+    bool found_path = false;
+
+    while (!frontier.empty()) {
+        uint64_t current_key = frontier.get();
+
+        TimedVisit& visit = visited[current_key];
+        if (visit.closed) continue;
+        visit.closed = true;
+
+        State current = packer.unpack(current_key & STATE_BITS);
+        int t = (int)(current_key >> TIME_SHIFT);
+        int current_cost = visit.cost;
+
+        goal_index = reached_goal(settings, current, goals);
+        if (goal_index >= 0 && (t >= window || _can_stay(table, settings, current, t, window, agent))) {
+            goal_key = current_key;
+            found_path = true;
+            break;
+        }
+
+        int next_t = std::min(t + 1, window);
+        int n = graph.neighbors(settings, current, neighbors);
+
+        // Waiting only makes sense while reservations still apply, and gravity rules it out in the air
+        if (t < window && !current.is_air_scenario()) neighbors[n++] = current;
+
+        for (int i = 0; i < n; i++) {
+            const State& next = neighbors[i];
+
+            if (next.x < bounds.x) continue;
+            if (next.y < bounds.y) continue;
+            if (next.x >= bounds.x + bounds.w) continue;
+            if (next.y >= bounds.y + bounds.h) continue;
+
+            if (t < window && !_can_hold(table, settings, next, t + 1, agent)) continue;
+
+            // Waiting costs as much as the cheapest move so it never looks better than moving
+            int step = i == n - 1 && next == current && t < window && !current.is_air_scenario() ? wait_cost : graph.cost(settings, current, next);
+            int new_cost = current_cost + step;
+
+            uint64_t next_key = packer.pack(next) | ((uint64_t)next_t << TIME_SHIFT);
+            auto it = visited.find(next_key);
+            if (it == visited.end() || new_cost < it->second.cost) {
+                visited[next_key] = TimedVisit { current_key, new_cost, false };
+                frontier.put(next_key, new_cost + goal_estimate(settings, steps, next, goals));
+            }
+        }
+    }
+
+    // The goal may have been reached without being free to stay in
+    if (!found_path) {
+        goal_index = -1;
+        return false;
+    }
+
+    uint64_t current_key = goal_key;
+    while (current_key != initial_key) {
+        path.push_back(packer.unpack(current_key & STATE_BITS));
+        current_key = visited[current_key].came_from;
+    }
+
+    path.push_back(initial);
+    std::reverse(path.begin(), path.end());
+
+    return true;
+}
+
+// Held states cover their own step and the next one, the last one is held until the window ends
+static void _claim(ReservationTable& table, const CooperativeAgent& agent, const std::vector<State>& states, int window, int shift) {
+    int last = (int)states.size() - 1;
+    for (int t = std::max(shift, 0); t <= window; t++) {
+        table.reserve(agent.settings, states[std::min(t, last)], t - shift, agent.id);
+        if (t > 0 && t <= last) table.reserve(agent.settings, states[t - 1], t - shift, agent.id);
+    }
+}
+
+void pathfinding::cooperative_plan(
+    const Graph& graph,
+    const Region& region,
+    const std::vector<CooperativeAgent>& agents,
+    ReservationTable& table,
+    int window,
+    std::vector<CooperativePath>& paths) {
+
+    window = std::max(0, std::min(window, table.horizon()));
+
+    paths.clear();
+    paths.resize(agents.size());
+
+    // Replanned agents give up what they claimed last time
+    for (const CooperativeAgent& agent : agents) table.release(agent.id);
+
+    for (size_t i = 0; i < agents.size(); i++) {
+        const CooperativeAgent& agent = agents[i];
+        CooperativePath& result = paths[i];
+
+        result.cooperative = cooperative_search(graph, agent.settings, region, agent.initial, agent.goals, table, agent.id, window, result.states, result.goal_index);
+
+        if (!result.cooperative) {
+            search(graph, agent.settings, region, agent.initial, agent.goals, result.states, result.goal_index);
+            continue;
+        }
+
+        _claim(table, agent, result.states, window, 0);
+    }
+}
+
+void pathfinding::cooperative_claim(
+    const std::vector<CooperativeAgent>& agents,
+    const std::vector<CooperativePath>& paths,
+    int window,
+    uint32_t planned_at,
+    ReservationTable& table) {
+
+    window = std::max(0, std::min(window, table.horizon()));
+    int shift = (int)(table.now() - planned_at);
+
+    for (size_t i = 0; i < agents.size(); i++) {
+        table.release(agents[i].id);
+        if (paths[i].cooperative) _claim(table, agents[i], paths[i].states, window, shift);
+    }
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "graph.hpp"
+#include "settings.hpp"
+#include "state.hpp"
+
+namespace pathfinding {
+
+/*
+ * Tiles claimed by agents over a sliding window of time steps, one path state per step.
+ * Times are relative to now, advancing drops every claim that fell out of the window so
+ * the table can be kept across frames.
+ */
+class ReservationTable {
+public:
+    ReservationTable(int horizon = 16);
+
+    // Changing the horizon drops every claim
+    void horizon_set(int horizon);
+    inline int horizon() const { return _horizon; }
+
+    inline uint32_t now() const { return _now; }
+    void advance(int steps);
+
+    void clear();
+    void release(int agent);
+
+    // Claims the tiles the character covers at time t, fails when t is outside the window
+    bool reserve(const Settings& settings, const State& state, int t, int agent);
+
+    // No other agent holds a tile the character would cover at time t, anything past the window is free
+    bool is_free(const Settings& settings, const State& state, int t, int agent) const;
+
+    inline size_t size() const { return _cells.size(); }
+
+private:
+    inline uint64_t _key(int32_t x, int32_t y, uint32_t time) const {
+        return ((uint64_t)((uint32_t)x & 0xFFFFFF)) |
+            ((uint64_t)((uint32_t)y & 0xFFFFFF) << 24) |
+            ((uint64_t)(time & 0xFFFF) << 48);
+    }
+
+    std::unordered_map<uint64_t, int> _cells;
+
+    // Keys claimed at each absolute time, so advancing only touches the step that expired
+    std::vector<std::vector<uint64_t>> _slots;
+
+    uint32_t _now;
+    int _horizon;
+};
+
+struct CooperativeAgent {
+    int id;
+    Settings settings;
+    State initial;
+    std::vector<Region> goals;
+};
+
+struct CooperativePath {
+    std::vector<State> states;
+    int goal_index;
+    // False when the agent couldn't get around the reservations and was planned alone
+    bool cooperative;
+};
+
+/*
+ * A* over (state, time) for the first window steps, waiting in place is allowed on floors
+ * and ledges but never in the air. Past the window reservations are ignored and time stops
+ * counting, so the search finishes like a regular one. States are one time step apart.
+ */
+bool cooperative_search(
+    const Graph& graph,
+    const Settings& settings,
+    const Region& region,
+    State initial,
+    const std::vector<Region>& goals,
+    const ReservationTable& table,
+    int agent,
+    int window,
+    std::vector<State>& path,
+    int& goal_index);
+
+// Plans the agents in order against the claims of the ones before them, then claims their first window steps
+void cooperative_plan(
+    const Graph& graph,
+    const Region& region,
+    const std::vector<CooperativeAgent>& agents,
+    ReservationTable& table,
+    int window,
+    std::vector<CooperativePath>& paths);
+
+/*
+ * Moves the claims of paths planned on a copy of the table, taken when its time was
+ * planned_at, over to the table. Whatever the agents held there before is released,
+ * and steps the table has advanced past since are dropped.
+ */
+void cooperative_claim(
+    const std::vector<CooperativeAgent>& agents,
+    const std::vector<CooperativePath>& paths,
+    int window,
+    uint32_t planned_at,
+    ReservationTable& table);
+
+}
@@ -0,0 +1,405 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "parallel.hpp"
+#include "reference.hpp"
+#include "search.hpp"
+
+using namespace std;
+
+/*
+ * Runs the engine and the frozen reference engine on random levels, settings and queries.
+ * Every case needs the same answer, paths the reference rules allow and the same cost,
+ * and both are timed so a rewrite shows its speedup case by case. A case is built from
+ * the seed and its number alone, so a failure can be replayed with --case.
+ *
+ *   differential.out [--cases 100000] [--seed 1] [--sizes 12,40]
+ *                    [--engines full,keypoints,shortened,widening,lazy,parallel,parallel_lazy] [--case N] [--csv path]
+ */
+
+struct Case {
+    int size;
+    pathfinding::Graph graph;
+    pathfinding::Settings settings;
+    pathfinding::Region region;
+    pathfinding::State initial;
+    vector<pathfinding::Region> goals;
+};
+
+struct Expected {
+    bool found;
+    int cost;
+    vector<pathfinding::State> path;
+    double usec;
+};
+
+struct Engine {
+    const char* name;
+    pathfinding::PathOutput output;
+    bool widening;
+    bool lazy;
+    // Above 1 runs parallel_search with that many threads
+    int threads;
+};
+
+struct Totals {
+    uint64_t cases = 0;
+    uint64_t found = 0;
+    uint64_t failures = 0;
+    uint64_t costlier = 0;
+    vector<double> speedups;
+};
+
+static const Engine _engines[] = {
+    { "full", pathfinding::PathOutput_Full, false, false, 1 },
+    { "keypoints", pathfinding::PathOutput_Keypoints, false, false, 1 },
+    { "shortened", pathfinding::PathOutput_Shortened, false, false, 1 },
+    // Only the cheapest path inside its window, so it may cost more but never less
+    { "widening", pathfinding::PathOutput_Full, true, false, 1 },
+    { "lazy", pathfinding::PathOutput_Full, false, true, 1 },
+    { "parallel", pathfinding::PathOutput_Full, false, false, 4 },
+    { "parallel_lazy", pathfinding::PathOutput_Full, false, true, 4 },
+};
+
+static int _range(mt19937& rng, int low, int high) {
+    return low + (int)(rng() % (unsigned int)(high - low + 1));
+}
+
+static void _generate(unsigned int seed, uint64_t index, int min_size, int max_size, Case& level) {
+    mt19937 rng((unsigned int)(seed * 1000003ULL + index * 7919ULL));
+
+    int size = _range(rng, min_size, max_size);
+    level.size = size;
+    level.graph.clear();
+    level.graph.clear_costs();
+
+    for (int i = 0; i < size; i++) {
+        level.graph.set_at(i, 0, pathfinding::FLOOR_TILEKIND);
+        level.graph.set_at(i, size - 1, pathfinding::FLOOR_TILEKIND);
+        level.graph.set_at(0, i, pathfinding::FLOOR_TILEKIND);
+        level.graph.set_at(size - 1, i, pathfinding::FLOOR_TILEKIND);
+    }
+
+    // Platforms, pillars, loose blocks and a few characters and hazards
+    int platforms = _range(rng, 0, size);
+    for (int i = 0; i < platforms; i++) {
+        int x = _range(rng, 1, size - 2);
+        int y = _range(rng, 2, size - 2);
+        int length = _range(rng, 1, 8);
+        for (int dx = 0; dx < length && x + dx < size - 1; dx++) level.graph.set_at(x + dx, y, pathfinding::FLOOR_TILEKIND);
+    }
+
+    int pillars = _range(rng, 0, size / 4);
+    for (int i = 0; i < pillars; i++) {
+        int x = _range(rng, 1, size - 2);
+        int y = _range(rng, 1, size - 2);
+        int length = _range(rng, 1, 6);
+        pathfinding::TileKind kind = rng() % 2 ? pathfinding::FLOOR_TILEKIND : pathfinding::UNTRAVERSABLE_TILEKIND;
+        for (int dy = 0; dy < length && y + dy < size - 1; dy++) level.graph.set_at(x, y + dy, kind);
+    }
+
+    int blocks = _range(rng, 0, size);
+    for (int i = 0; i < blocks; i++) {
+        pathfinding::TileKind kind = (pathfinding::TileKind)_range(rng, 0, 3);
+        level.graph.set_at(_range(rng, 1, size - 2), _range(rng, 1, size - 2), kind == pathfinding::AIR_TILEKIND ? pathfinding::FLOOR_TILEKIND : kind);
+    }
+
+    int hazards = _range(rng, 0, 3);
+    for (int i = 0; i < hazards; i++) {
+        pathfinding::Region hazard { _range(rng, 1, size - 2), _range(rng, 1, size - 2), _range(rng, 1, 6), _range(rng, 1, 6) };
+        level.graph.set_cost_region(hazard, (uint8_t)_range(rng, 1, 20));
+    }
+
+    pathfinding::Settings& settings = level.settings;
+    settings.max_jump_height = _range(rng, 0, 6);
+    settings.air_stride = (unsigned int)_range(rng, 2, 4);
+    settings.width = (unsigned int)_range(rng, 1, 3);
+    settings.height = (unsigned int)_range(rng, 1, 3);
+    settings.ledge_hang = rng() % 2;
+    settings.costs = pathfinding::CostProfile();
+
+    // Half the cases keep the default costs, the rest get a random profile
+    if (rng() % 2) {
+        settings.costs.up = _range(rng, 1, 6);
+        settings.costs.down = _range(rng, 1, 6);
+        settings.costs.level = _range(rng, 1, 6);
+        settings.costs.ledge_climb = _range(rng, 0, 6);
+        settings.costs.character = _range(rng, 0, 100);
+        settings.costs.hazard = _range(rng, 0, 4);
+    }
+
+    level.region = pathfinding::Region { 0, 0, size, size };
+
+    // Mostly standing starts, some in mid air
+    vector<pathfinding::State> standable;
+    vector<pathfinding::State> fitting;
+    for (int y = 1; y < size - 1; y++) {
+        for (int x = 1; x < size - 1; x++) {
+            if (!level.graph.fits(settings, x, y)) continue;
+            fitting.push_back(pathfinding::State::create(x, y));
+            if (level.graph.on_floor(settings, x, y)) standable.push_back(pathfinding::State::create(x, y));
+        }
+    }
+
+    const vector<pathfinding::State>& starts = standable.empty() || rng() % 8 == 0 ? fitting : standable;
+    level.initial = starts.empty() ? pathfinding::State::create(1, 1) : starts[rng() % starts.size()];
+
+    level.goals.clear();
+    int goal_count = rng() % 4 == 0 ? _range(rng, 2, 3) : 1;
+    for (int i = 0; i < goal_count; i++) {
+        pathfinding::Region goal;
+        if (!standable.empty() && rng() % 4 != 0) {
+            const pathfinding::State& cell = standable[rng() % standable.size()];
+            goal = pathfinding::Region { cell.x, cell.y, 1, 1 };
+        }
+        else goal = pathfinding::Region { _range(rng, 0, size - 1), _range(rng, 0, size - 1), _range(rng, 1, 4), _range(rng, 1, 4) };
+
+        level.goals.push_back(goal);
+    }
+}
+
+static void _print_case(const Case& level) {
+    const pathfinding::Settings& settings = level.settings;
+    printf("size %d jump %d stride %u width %u height %u ledge_hang %d\n",
+        level.size, settings.max_jump_height, settings.air_stride, settings.width, settings.height, settings.ledge_hang);
+    printf("costs up %d down %d level %d ledge_climb %d character %d hazard %d\n",
+        settings.costs.up, settings.costs.down, settings.costs.level, settings.costs.ledge_climb, settings.costs.character, settings.costs.hazard);
+    printf("initial %d %d\n", level.initial.x, level.initial.y);
+    for (const pathfinding::Region& goal : level.goals) printf("goal %d %d %d %d\n", goal.x, goal.y, goal.w, goal.h);
+
+    static const char tiles[] = { 'X', '.', '#', 'c' };
+    for (int y = 0; y < level.size; y++) {
+        for (int x = 0; x < level.size; x++) {
+            char tile = tiles[level.graph.get_at(x, y)];
+            if (x == level.initial.x && y == level.initial.y) tile = 'S';
+            else if (tile == '.' && level.graph.get_cost_at(x, y)) tile = '~';
+            putchar(tile);
+        }
+        putchar('\n');
+    }
+}
+
+static void _print_path(const char* name, const vector<pathfinding::State>& path) {
+    printf("%s:", name);
+    for (const pathfinding::State& state : path) printf(" (%d,%d,%d)", state.x, state.y, state.jump);
+    printf("\n");
+}
+
+// Every state of part shows up in whole in the same order, both ends included
+static bool _is_subsequence(const vector<pathfinding::State>& part, const vector<pathfinding::State>& whole) {
+    if (part.empty() || whole.empty()) return part.empty() == whole.empty();
+    if (part.front() != whole.front() || part.back() != whole.back()) return false;
+
+    size_t i = 0;
+    for (const pathfinding::State& state : whole) {
+        if (i < part.size() && part[i] == state) i++;
+    }
+
+    return i == part.size();
+}
+
+// Empty when the engine agrees with the reference, the reason otherwise
+static string _check(const Case& level, const Engine& engine, const Expected& expected, const vector<pathfinding::State>& full, bool found, int goal_index, const vector<pathfinding::State>& path, int& cost, Totals& totals) {
+    cost = -1;
+
+    if (found != expected.found) return found ? "found a path the reference didn't" : "missed a path the reference found";
+    if (!found) return "";
+
+    if (goal_index < 0 || reached_goal(level.settings, path.back(), level.goals) != goal_index) return "last state isn't in the goal it reported";
+    if (path.front().x != level.initial.x || path.front().y != level.initial.y) return "path doesn't start at initial";
+
+    if (engine.output != pathfinding::PathOutput_Full) {
+        if (!_is_subsequence(path, full)) return "keypoints aren't part of the full path";
+        cost = expected.cost;
+        return "";
+    }
+
+    cost = pathfinding::reference::path_cost(level.graph, level.settings, path);
+    if (cost < 0) return "path has a move the reference doesn't allow";
+    if (cost < expected.cost) return "path is cheaper than the reference";
+
+    if (cost > expected.cost) {
+        if (!engine.widening) return "path costs more than the reference";
+        totals.costlier++;
+    }
+
+    return "";
+}
+
+static double _percentile(vector<double> values, double percentile) {
+    if (values.empty()) return 0;
+    size_t index = (size_t)(percentile * (values.size() - 1));
+    nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+static vector<string> _split(const string& list) {
+    vector<string> items;
+    stringstream in(list);
+    string item;
+    while (getline(in, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+int main(int cargs, char** args) {
+    uint64_t case_count = 100000;
+    unsigned int seed = 1;
+    int min_size = 12;
+    int max_size = 40;
+    vector<string> engine_names = _split("full,keypoints,shortened,widening,lazy,parallel,parallel_lazy");
+    long long only_case = -1;
+    string csv_path;
+
+    for (int i = 1; i < cargs; i++) {
+        string arg(args[i]);
+        if (i + 1 >= cargs) {
+            fprintf(stderr, "Missing value for %s\n", arg.c_str());
+            return 1;
+        }
+
+        string value(args[++i]);
+        if (arg == "--cases") case_count = strtoull(value.c_str(), nullptr, 10);
+        else if (arg == "--seed") seed = (unsigned int)atoi(value.c_str());
+        else if (arg == "--engines") engine_names = _split(value);
+        else if (arg == "--case") only_case = atoll(value.c_str());
+        else if (arg == "--csv") csv_path = value;
+        else if (arg == "--sizes") {
+            vector<string> sizes = _split(value);
+            if (sizes.size() != 2) {
+                fprintf(stderr, "--sizes takes min,max\n");
+                return 1;
+            }
+
+            min_size = max(atoi(sizes[0].c_str()), 4);
+            max_size = max(atoi(sizes[1].c_str()), min_size);
+        }
+        else {
+            fprintf(stderr, "Unknown argument: %s\n", arg.c_str());
+            return 1;
+        }
+    }
+
+    vector<const Engine*> engines;
+    for (const string& name : engine_names) {
+        const Engine* engine = nullptr;
+        for (const Engine& candidate : _engines) {
+            if (name == candidate.name) engine = &candidate;
+        }
+
+        if (!engine) {
+            fprintf(stderr, "Unknown engine: %s\n", name.c_str());
+            return 1;
+        }
+
+        engines.push_back(engine);
+    }
+
+    // Kept for every case, the way Pathfinder keeps them between queries
+    vector<unique_ptr<pathfinding::ParallelWorkers>> parallel_workers;
+    for (const Engine* engine : engines) parallel_workers.emplace_back(engine->threads > 1 ? new pathfinding::ParallelWorkers(engine->threads) : nullptr);
+
+    FILE* csv = nullptr;
+    if (!csv_path.empty()) {
+        csv = fopen(csv_path.c_str(), "w");
+        if (!csv) {
+            fprintf(stderr, "Can't write %s\n", csv_path.c_str());
+            return 1;
+        }
+
+        fprintf(csv, "case,engine,size,found,reference_cost,engine_cost,reference_us,engine_us\n");
+    }
+
+    vector<Totals> totals(engines.size());
+    uint64_t first = only_case >= 0 ? (uint64_t)only_case : 0;
+    uint64_t last = only_case >= 0 ? first + 1 : case_count;
+    int reported = 0;
+
+    Case level;
+    vector<pathfinding::State> full;
+    vector<pathfinding::State> path;
+
+    for (uint64_t index = first; index < last; index++) {
+        _generate(seed, index, min_size, max_size, level);
+        if (only_case >= 0) _print_case(level);
+
+        Expected expected;
+        int reference_goal;
+        auto started = chrono::steady_clock::now();
+        expected.found = pathfinding::reference::search(level.graph, level.settings, level.region, level.initial, level.goals, expected.path, reference_goal, expected.cost);
+        expected.usec = chrono::duration<double, micro>(chrono::steady_clock::now() - started).count();
+
+        if (only_case >= 0) {
+            printf("reference cost %d\n", expected.cost);
+            _print_path("reference", expected.path);
+        }
+
+        // Keypoints are checked against the engine's own full path, the one they are picked from
+        int full_goal;
+        bool full_found = pathfinding::search(level.graph, level.settings, level.region, level.initial, level.goals, full, full_goal);
+
+        for (size_t e = 0; e < engines.size(); e++) {
+            const Engine& engine = *engines[e];
+            int goal_index;
+
+            started = chrono::steady_clock::now();
+            bool found;
+            if (engine.threads > 1) found = pathfinding::parallel_search(level.graph, level.settings, level.region, level.initial, level.goals, path, goal_index, *parallel_workers[e], nullptr, engine.output, engine.lazy);
+            else if (engine.widening) found = pathfinding::search_widening(level.graph, level.settings, level.region, level.initial, level.goals, path, goal_index, nullptr, engine.output, engine.lazy);
+            else found = pathfinding::search(level.graph, level.settings, level.region, level.initial, level.goals, path, goal_index, nullptr, engine.output, engine.lazy);
+            double usec = chrono::duration<double, micro>(chrono::steady_clock::now() - started).count();
+
+            int cost;
+            string failure = _check(level, engine, expected, full_found ? full : vector<pathfinding::State>(), found, goal_index, path, cost, totals[e]);
+
+            Totals& total = totals[e];
+            total.cases++;
+            if (found) total.found++;
+            if (expected.found && usec > 0) total.speedups.push_back(expected.usec / usec);
+
+            if (only_case >= 0) {
+                printf("%s cost %d\n", engine.name, cost);
+                _print_path(engine.name, path);
+            }
+
+            if (!failure.empty()) {
+                total.failures++;
+                if (reported++ < 20) printf("case %llu %s: %s\n", (unsigned long long)index, engine.name, failure.c_str());
+            }
+
+            if (csv) {
+                fprintf(csv, "%llu,%s,%d,%d,%d,%d,%.2f,%.2f\n", (unsigned long long)index, engine.name, level.size,
+                    found, expected.cost, cost, expected.usec, usec);
+            }
+        }
+    }
+
+    if (csv) fclose(csv);
+
+    printf("%-10s %9s %9s %9s %9s %10s %10s %10s\n", "engine", "cases", "found", "failures", "costlier", "geomean x", "p10 x", "p50 x");
+
+    bool failed = false;
+    for (size_t e = 0; e < engines.size(); e++) {
+        const Totals& total = totals[e];
+        failed = failed || total.failures > 0;
+
+        double log_sum = 0;
+        for (double speedup : total.speedups) log_sum += log(speedup);
+        double geomean = total.speedups.empty() ? 0 : exp(log_sum / total.speedups.size());
+
+        printf("%-10s %9llu %9llu %9llu %9llu %10.2f %10.2f %10.2f\n", engines[e]->name,
+            (unsigned long long)total.cases, (unsigned long long)total.found, (unsigned long long)total.failures,
+            (unsigned long long)total.costlier, geomean, _percentile(total.speedups, 0.10), _percentile(total.speedups, 0.50));
+    }
+
+    return failed ? 1 : 0;
+}
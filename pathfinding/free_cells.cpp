@@ -0,0 +1,110 @@
+#include "free_cells.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+using namespace pathfinding;
+
+// Tiles [left, right) of one row
+struct Span {
+    int32_t y;
+    int32_t left;
+    int32_t right;
+};
+
+// Overlapping regions become disjoint row spans so no cell is looked at twice
+static void _merge(const std::vector<Region>& regions, std::vector<Span>& spans) {
+    for (const Region& region : regions) {
+        if (region.w <= 0 || region.h <= 0) continue;
+
+        for (int32_t y = region.y; y < region.y + region.h; y++) {
+            spans.push_back(Span { y, region.x, region.x + region.w });
+        }
+    }
+
+    std::sort(spans.begin(), spans.end(), [](const Span& a, const Span& b) {
+        return a.y != b.y ? a.y < b.y : a.left < b.left;
+    });
+
+    size_t count = 0;
+    for (size_t i = 0; i < spans.size(); i++) {
+        if (count > 0 && spans[count - 1].y == spans[i].y && spans[i].left <= spans[count - 1].right) {
+            spans[count - 1].right = std::max(spans[count - 1].right, spans[i].right);
+            continue;
+        }
+
+        spans[count++] = spans[i];
+    }
+
+    spans.resize(count);
+}
+
+void pathfinding::closest_free_cells(
+    const Graph& graph,
+    const Settings& settings,
+    const std::vector<Region>& regions,
+    int32_t x, int32_t y,
+    bool prefer_floors,
+    int max_count,
+    std::vector<FreeCell>& out) {
+
+    out.clear();
+
+    std::vector<Span> spans;
+    _merge(regions, spans);
+
+    int width = (int)settings.width;
+    int height = (int)settings.height;
+
+    std::vector<uint8_t> row;
+    std::vector<int> blocked;
+    std::vector<int> floors;
+
+    for (const Span& span : spans) {
+        int cells = span.right - span.left;
+        int columns = cells + std::max(width, 1) - 1;
+
+        row.resize(columns);
+
+        // Prefix counts of columns with something solid in the character's rows, and of floors below
+        blocked.assign(columns + 1, 0);
+        floors.assign(columns + 1, 0);
+
+        for (int j = 0; j < height; j++) {
+            graph.get_row(span.left, span.y - j, columns, row.data());
+            for (int c = 0; c < columns; c++) {
+                if (row[c] == FLOOR_TILEKIND || row[c] == UNTRAVERSABLE_TILEKIND) blocked[c + 1] = 1;
+            }
+        }
+
+        if (prefer_floors) {
+            graph.get_row(span.left, span.y + 1, columns, row.data());
+            for (int c = 0; c < columns; c++) floors[c + 1] = row[c] == FLOOR_TILEKIND;
+        }
+
+        for (int c = 0; c < columns; c++) {
+            blocked[c + 1] += blocked[c];
+            floors[c + 1] += floors[c];
+        }
+
+        int distance_y = std::abs(span.y - y);
+        for (int c = 0; c < cells; c++) {
+            if (blocked[c + width] - blocked[c] > 0) continue;
+
+            int32_t cell_x = span.left + c;
+            out.push_back(FreeCell { cell_x, span.y, floors[c + width] - floors[c] > 0, std::abs(cell_x - x) + distance_y });
+        }
+    }
+
+    auto closer = [prefer_floors](const FreeCell& a, const FreeCell& b) {
+        if (prefer_floors && a.on_floor != b.on_floor) return a.on_floor;
+        if (a.distance != b.distance) return a.distance < b.distance;
+        return a.y != b.y ? a.y < b.y : a.x < b.x;
+    };
+
+    if (max_count > 0 && (size_t)max_count < out.size()) {
+        std::partial_sort(out.begin(), out.begin() + max_count, out.end(), closer);
+        out.resize(max_count);
+    }
+    else std::sort(out.begin(), out.end(), closer);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vector>
+
+#include "graph.hpp"
+
+namespace pathfinding {
+
+struct FreeCell {
+    int32_t x;
+    int32_t y;
+    bool on_floor;
+    int distance;
+};
+
+/*
+ * Cells in the union of the regions the character fits in, closest to (x, y) first.
+ * With prefer_floors, cells standing on a floor come before every other cell. A positive
+ * max_count only orders and keeps that many.
+ */
+void closest_free_cells(
+    const Graph& graph,
+    const Settings& settings,
+    const std::vector<Region>& regions,
+    int32_t x, int32_t y,
+    bool prefer_floors,
+    int max_count,
+    std::vector<FreeCell>& out);
+
+}
@@ -1,20 +1,133 @@
 #include "graph.hpp"
 
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
 using namespace pathfinding;
 
 TileKind Graph::get_at(int32_t x, int32_t y) const {
-    int64_t index = ((int64_t)y << 32) | x;
-    auto it = _grid.find(index);
+    auto it = _pages.find(page_key(page_of(x), page_of(y)));
+    TileKind kind = it == _pages.end() ? AIR_TILEKIND : (TileKind)it->second.page->tiles[page_index(x, y)];
+
+    if (kind == AIR_TILEKIND && _occupancy && _occupancy->occupied(x, y, _occupant)) return CHARACTER_TILEKIND;
+    return kind;
+}
+
+void Graph::get_row(int32_t x, int32_t y, int32_t count, uint8_t* out) const {
+    while (count > 0) {
+        int32_t span = std::min(count, PAGE_SIZE - (x & PAGE_MASK));
+
+        auto it = _pages.find(page_key(page_of(x), page_of(y)));
+        if (it == _pages.end()) memset(out, AIR_TILEKIND, span);
+        else memcpy(out, it->second.page->tiles + page_index(x, y), span);
+
+        if (_occupancy && _occupancy->overlaps_row(x, y, span)) {
+            for (int32_t i = 0; i < span; i++) {
+                if (out[i] == AIR_TILEKIND && _occupancy->occupied(x + i, y, _occupant)) out[i] = CHARACTER_TILEKIND;
+            }
+        }
 
-    if (it == _grid.end()) return AIR_TILEKIND;
-    return it->second;
+        x += span;
+        out += span;
+        count -= span;
+    }
 }
 
 bool Graph::set_at(int32_t x, int32_t y, const TileKind kind) {
-    _grid[((int64_t)y << 32) | x] = kind;
+    PageSlot& slot = _pages[page_key(page_of(x), page_of(y))];
+
+    if (!slot.page) {
+        slot.page = create_page();
+        slot.writable = true;
+    }
+    else if (!slot.writable || slot.page.use_count() > 1) {
+        slot.page = std::make_shared<Page>(*slot.page);
+        slot.writable = true;
+    }
+
+    const_cast<Page&>(*slot.page).tiles[page_index(x, y)] = (uint8_t)kind;
     return true;
 }
 
+void Graph::add_dynamic_mass(const Region& mass) {
+    for (int32_t x = mass.x; x < mass.x + mass.w; x++) {
+        for (int32_t y = mass.y; y < mass.y + mass.h; y++) {
+            if (get_at(x, y) != AIR_TILEKIND) continue;
+            set_at(x, y, CHARACTER_TILEKIND);
+        }
+    }
+}
+
+void Graph::set_page(int32_t page_x, int32_t page_y, const PageRef& page) {
+    if (!page) {
+        erase_page(page_x, page_y);
+        return;
+    }
+
+    PageSlot& slot = _pages[page_key(page_x, page_y)];
+    slot.page = page;
+    slot.writable = false;
+}
+
+PageRef Graph::get_page(int32_t page_x, int32_t page_y) const {
+    auto it = _pages.find(page_key(page_x, page_y));
+    if (it == _pages.end()) return PageRef();
+    return it->second.page;
+}
+
+void Graph::erase_page(int32_t page_x, int32_t page_y) {
+    _pages.erase(page_key(page_x, page_y));
+}
+
+std::shared_ptr<Page> Graph::create_page() {
+    auto page = std::make_shared<Page>();
+    memset(page->tiles, AIR_TILEKIND, PAGE_TILES);
+    return page;
+}
+
+void Graph::set_cost_at(int32_t x, int32_t y, uint8_t cost) {
+    int64_t key = page_key(page_of(x), page_of(y));
+
+    auto it = _costs.find(key);
+    if (it == _costs.end()) {
+        if (cost == 0) return;
+
+        auto page = std::make_shared<CostPage>();
+        memset(page->costs, 0, PAGE_TILES);
+        it = _costs.insert(std::make_pair(key, CostSlot { page, true })).first;
+    }
+    else if (!it->second.writable || it->second.page.use_count() > 1) {
+        it->second.page = std::make_shared<CostPage>(*it->second.page);
+        it->second.writable = true;
+    }
+
+    const_cast<CostPage&>(*it->second.page).costs[page_index(x, y)] = cost;
+}
+
+void Graph::set_cost_region(const Region& region, uint8_t cost) {
+    for (int32_t y = region.y; y < region.y + region.h; y++) {
+        for (int32_t x = region.x; x < region.x + region.w; x++) {
+            set_cost_at(x, y, cost);
+        }
+    }
+}
+
+void Graph::set_cost_page(int32_t page_x, int32_t page_y, const CostPageRef& page) {
+    if (!page) {
+        _costs.erase(page_key(page_x, page_y));
+        return;
+    }
+
+    _costs[page_key(page_x, page_y)] = CostSlot { page, false };
+}
+
+CostPageRef Graph::get_cost_page(int32_t page_x, int32_t page_y) const {
+    auto it = _costs.find(page_key(page_x, page_y));
+    if (it == _costs.end()) return CostPageRef();
+    return it->second.page;
+}
+
 void Graph::contextualize(const Settings& settings, State& state) const {
     state.scenario_meta = _get_scenario(settings, state);
 }
@@ -24,18 +137,7 @@ int Graph::neighbors(const Settings& settings, const State& state, State neighbo
     if (kind == UNTRAVERSABLE_TILEKIND) return 0;
 
     int count = 0;
-
-    int num_positions = 4;
-    _right_of(state, neighbors[0]);
-    _left_of(state, neighbors[1]);
-    _above(state, neighbors[2]);
-    _below(state, neighbors[3]);
-
-    if (settings.ledge_hang) {
-        num_positions += 2;
-        _top_of_left_ledge(settings, state, neighbors[4]);
-        _top_of_right_ledge(settings, state, neighbors[5]);
-    }
+    int num_positions = candidates(settings, state, neighbors);
 
     for (int i = 0; i < num_positions; i++) {
         State& adjecent = neighbors[i];
@@ -50,26 +152,45 @@ int Graph::neighbors(const Settings& settings, const State& state, State neighbo
     return count;
 }
 
+bool Graph::transition(const Settings& settings, const State& state, State& next, bool check_fit) const {
+    if (get_at(state.x, state.y) == UNTRAVERSABLE_TILEKIND) return false;
+
+    int dx = std::abs(next.x - state.x);
+    int dy = std::abs(next.y - state.y);
+
+    // Ledge climbs are the only diagonal moves, they go up and over by the character's size
+    bool climb = settings.ledge_hang && next.y < state.y && dx == (int)settings.width && dy == (int)settings.height;
+    if (dx + dy != 1 && !climb) return false;
+
+    if (check_fit && !_can_fit(settings, next)) return false;
+
+    contextualize(settings, next);
+    return _next_state(settings, state, next);
+}
+
 int Graph::cost(const Settings& settings, const State& state, const State& next) const {
+    const CostProfile& costs = settings.costs;
     int base = 0;
 
     // Only ledge hang when the jump can't be reached by a regular jump
-    if (next.x != state.x && next.y != state.y) base += settings.max_jump_height * 3;
+    if (next.x != state.x && next.y != state.y) base += settings.max_jump_height * costs.ledge_climb;
 
     // Moving up takes up the "most" energy
-    else if (next.y < state.y) base += 3;
+    else if (next.y < state.y) base += costs.up;
 
     // Moving down takes up the least energy
-    else if (next.y > state.y) base += 1;
+    else if (next.y > state.y) base += costs.down;
     
     // Everything else is neutral
-    else base += 2;
+    else base += costs.level;
 
     // Other characters are hard to move through
     if (get_at(next.x, next.y) == CHARACTER_TILEKIND) {
-        base += 70;
+        base += costs.character;
     }
 
+    base += get_cost_at(next.x, next.y) * costs.hazard;
+
     return base;
 }
 
@@ -123,15 +244,15 @@ bool Graph::_next_state(const Settings& settings, const State& state, State& nex
 
             if (next_state_with_position.x != state.x) {
                 // Must fall after before being able to move horizontally
-                next_state_with_position.jump = jump_limit % air_stride == 0 ?
-                    jump_limit + 1 : jump_limit;
+                next_state_with_position.jump = _fold_jump(settings, jump_limit, jump_limit % air_stride == 0 ?
+                    jump_limit + 1 : jump_limit);
                 
                 return true;
             }
 
             // Must be moving vertically
             if (next_state_with_position.y < state.y) {
-                next_state_with_position.jump = 2;
+                next_state_with_position.jump = _fold_jump(settings, jump_limit, 2);
                 return true;
             }
 
@@ -157,7 +278,7 @@ bool Graph::_next_state(const Settings& settings, const State& state, State& nex
 
         if (next_state_with_position.is_air_scenario()) {
             if (can_move_sideways && next_state_with_position.x != state.x) {
-                next_state_with_position.jump = state.jump + 1;
+                next_state_with_position.jump = _fold_jump(settings, jump_limit, state.jump + 1);
                 return true;
             }
 
@@ -169,11 +290,11 @@ bool Graph::_next_state(const Settings& settings, const State& state, State& nex
             // Must be moving vertically
             if (can_move_sideways) {
                 // Skips the horizontal detour, so must add 2
-                next_state_with_position.jump = state.jump + 2;
+                next_state_with_position.jump = _fold_jump(settings, jump_limit, state.jump + 2);
                 return true;
             }
 
-            next_state_with_position.jump = state.jump + 1;
+            next_state_with_position.jump = _fold_jump(settings, jump_limit, state.jump + 1);
             return true;
         }
 
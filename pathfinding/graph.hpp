@@ -1,7 +1,11 @@
 #pragma once
 
+#include <cstdint>
 #include <unordered_map>
 
+#include "occupancy.hpp"
+#include "page.hpp"
+#include "region.hpp"
 #include "settings.hpp"
 #include "state.hpp"
 
@@ -9,13 +13,6 @@
 
 namespace pathfinding {
 
-struct Region {
-    int x;
-    int y;
-    int w;
-    int h;
-};
-
 enum TileKind {
     UNTRAVERSABLE_TILEKIND = 0,
     AIR_TILEKIND = 1,
@@ -25,20 +22,105 @@ enum TileKind {
 
 class Graph {
 public:
-    Graph() {}
+    Graph() : _occupant(OCCUPANCY_FREE) {}
 
     TileKind get_at(int32_t x, int32_t y) const;
+
+    // Copies count tiles starting at (x, y) going right, one page lookup per page crossed
+    void get_row(int32_t x, int32_t y, int32_t count, uint8_t* out) const;
+
     bool set_at(int32_t x, int32_t y, const TileKind kind);
 
     int neighbors(const Settings& settings, const State& state, State neighbors[MAX_NEIGHBORS]) const;
 
+    // Where neighbors looks, in the same order and before any tile is read, see transition
+    inline int candidates(const Settings& settings, const State& state, State candidates[MAX_NEIGHBORS]) const {
+        _right_of(state, candidates[0]);
+        _left_of(state, candidates[1]);
+        _above(state, candidates[2]);
+        _below(state, candidates[3]);
+
+        if (!settings.ledge_hang) return 4;
+
+        _top_of_left_ledge(settings, state, candidates[4]);
+        _top_of_right_ledge(settings, state, candidates[5]);
+        return 6;
+    }
+
     int cost(const Settings& settings, const State& state, const State& next) const;
 
+    // Whether one move from state can end at next's position, fills in next's scenario and jump. Without
+    // check_fit the character's body isn't checked against the tiles at next, see fits
+    bool transition(const Settings& settings, const State& state, State& next, bool check_fit = true) const;
+
     void contextualize(const Settings& settings, State& state) const;
 
-    inline void clear() { _grid.clear(); }
+    // Marks the air tiles under a moving obstacle as characters
+    void add_dynamic_mass(const Region& mass);
+
+    /*
+     * Air tiles covered by an agent of the shared layer read as characters, except the
+     * ones only the occupant covers. A null or empty layer turns it off, so reads don't
+     * look for agents that aren't there.
+     */
+    inline void set_occupancy(const OccupancyRef& occupancy, int32_t occupant = OCCUPANCY_FREE) {
+        _occupancy = occupancy && !occupancy->empty() ? occupancy : OccupancyRef();
+        _occupant = occupant;
+    }
+
+    inline const OccupancyRef& occupancy() const { return _occupancy; }
+
+    // Only clears tiles, the cost layer is cleared on its own
+    inline void clear() { _pages.clear(); }
 
-    inline size_t used_tile_count() const { return _grid.size(); }
+    inline size_t used_tile_count() const { return _pages.size() * PAGE_TILES; }
+
+    inline size_t page_count() const { return _pages.size(); }
+
+    // Shares a read only page, a null page is all air
+    void set_page(int32_t page_x, int32_t page_y, const PageRef& page);
+    PageRef get_page(int32_t page_x, int32_t page_y) const;
+    void erase_page(int32_t page_x, int32_t page_y);
+
+    static std::shared_ptr<Page> create_page();
+
+    /*
+     * Extra cost for entering a tile, scaled by the profile's hazard cost. Costs live in
+     * their own pages, shared and cloned on write like tiles, so a level's danger zones
+     * are set once instead of being added to every query.
+     */
+    inline uint8_t get_cost_at(int32_t x, int32_t y) const {
+        if (_costs.empty()) return 0;
+
+        auto it = _costs.find(page_key(page_of(x), page_of(y)));
+        if (it == _costs.end()) return 0;
+        return it->second.page->costs[page_index(x, y)];
+    }
+
+    void set_cost_at(int32_t x, int32_t y, uint8_t cost);
+    void set_cost_region(const Region& region, uint8_t cost);
+
+    void set_cost_page(int32_t page_x, int32_t page_y, const CostPageRef& page);
+    CostPageRef get_cost_page(int32_t page_x, int32_t page_y) const;
+
+    inline void clear_costs() { _costs.clear(); }
+    inline bool has_costs() const { return !_costs.empty(); }
+
+    // Shares the other graph's cost layer, replacing this one's
+    inline void costs_from(const Graph& other) {
+        _costs = other._costs;
+        for (auto& it : _costs) it.second.writable = false;
+    }
+
+    template <typename Callback>
+    inline void for_each_cost_page(Callback callback) const {
+        for (auto& it : _costs) callback(page_key_x(it.first), page_key_y(it.first), it.second.page);
+    }
+
+    template <typename Callback>
+    inline void for_each_page(Callback callback) const {
+        for (auto& it : _pages) callback(page_key_x(it.first), page_key_y(it.first), it.second.page);
+    }
 
     inline bool on_floor(const Settings& settings, int32_t x, int32_t y) const { return _is_on_floor(settings, State::create(x, y)); }
 
@@ -48,6 +130,15 @@ public:
 
     inline bool is_traversable_tile(int32_t x, int32_t y) const;
 
+    static inline int calculate_jump_limit(const Settings& settings) {
+        int air_stride = settings.air_stride;
+
+        int detours = settings.max_jump_height > air_stride ?
+            1 + (settings.max_jump_height - air_stride) / (air_stride - 1) : 0;
+
+        return settings.max_jump_height + detours + 1;
+    }
+
 private:
     int _get_scenario(const Settings& settings, const State& state) const;
     bool _is_on_floor(const Settings& settings, const State& state) const;
@@ -59,13 +150,14 @@ private:
         return (state.jump % settings.air_stride) == 0;
     }
 
-    inline int calculate_jump_limit(const Settings& settings) const {
-        int air_stride = settings.air_stride;
-
-        int detours = settings.max_jump_height > air_stride ?
-            1 + (settings.max_jump_height - air_stride) / (air_stride - 1) : 0;
-
-        return settings.max_jump_height + detours + 1;
+    /*
+     * Once a jump counter passes the jump limit the character can only fall, and the
+     * only thing that still matters is where it is in the air stride. Folding it keeps
+     * the state space finite while hovering sideways in the air.
+     */
+    inline int _fold_jump(const Settings& settings, const int jump_limit, const int jump) const {
+        if (jump <= jump_limit) return jump;
+        return jump_limit + (jump - jump_limit) % settings.air_stride;
     }
 
     bool _next_state(const Settings& settings, const State& state, State& next_state_with_position) const;
@@ -78,7 +170,26 @@ private:
     void _top_of_left_ledge(const Settings& settings, const State& state, State& over_ledge) const { state.translate(-settings.width, -settings.height, over_ledge); }
     void _top_of_right_ledge(const Settings& settings, const State& state, State& over_ledge) const { state.translate(settings.width, -settings.height, over_ledge); }
 
-    std::unordered_map<int64_t, TileKind> _grid;
+    /*
+     * Pages are shared between graph copies and only cloned on write, so copying a graph
+     * for a query costs one pointer per page instead of one entry per tile.
+     */
+    struct PageSlot {
+        PageRef page;
+        bool writable;
+    };
+
+    std::unordered_map<int64_t, PageSlot, PageKeyHash> _pages;
+
+    struct CostSlot {
+        CostPageRef page;
+        bool writable;
+    };
+
+    std::unordered_map<int64_t, CostSlot, PageKeyHash> _costs;
+
+    OccupancyRef _occupancy;
+    int32_t _occupant;
 };
 
 }
\ No newline at end of file
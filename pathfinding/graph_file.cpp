@@ -0,0 +1,222 @@
+#include "graph_file.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#ifdef _WIN32
+#include <cstdlib>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define GRAPH_FILE_ALIGNMENT 64
+
+using namespace pathfinding;
+
+struct GraphFile::Mapping {
+    const uint8_t* data;
+    size_t size;
+
+    Mapping() : data(nullptr), size(0) {}
+
+    ~Mapping() {
+        if (!data) return;
+#ifdef _WIN32
+        free((void*)data);
+#else
+        munmap((void*)data, size);
+#endif
+    }
+};
+
+static inline uint64_t _align(uint64_t offset) {
+    return (offset + GRAPH_FILE_ALIGNMENT - 1) & ~(uint64_t)(GRAPH_FILE_ALIGNMENT - 1);
+}
+
+static bool _write_at(FILE* file, uint64_t offset, const void* data, size_t size) {
+    if (fseek(file, (long)offset, SEEK_SET) != 0) return false;
+    return fwrite(data, 1, size, file) == size;
+}
+
+bool pathfinding::save_graph(const Graph& graph, const std::string& path) {
+    std::vector<std::pair<int64_t, PageRef>> pages;
+    graph.for_each_page([&pages](int32_t page_x, int32_t page_y, const PageRef& page) {
+        pages.push_back(std::make_pair(page_key(page_x, page_y), page));
+    });
+
+    std::sort(pages.begin(), pages.end(), [](const std::pair<int64_t, PageRef>& a, const std::pair<int64_t, PageRef>& b) {
+        return a.first < b.first;
+    });
+
+    GraphFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, GRAPH_FILE_MAGIC, 4);
+    header.version = GRAPH_FILE_VERSION;
+    header.byte_order = GRAPH_FILE_BYTE_ORDER;
+    header.page_shift = PAGE_SHIFT;
+    header.section_count = 2;
+
+    GraphFileSection sections[2];
+    memset(sections, 0, sizeof(sections));
+
+    sections[0].kind = GraphSection_PageIndex;
+    sections[0].offset = _align(sizeof(GraphFileHeader) + sizeof(sections));
+    sections[0].size = pages.size() * sizeof(GraphFilePageEntry);
+
+    sections[1].kind = GraphSection_PageTiles;
+    sections[1].offset = _align(sections[0].offset + sections[0].size);
+    sections[1].size = pages.size() * sizeof(Page);
+
+    header.file_size = sections[1].offset + sections[1].size;
+
+    std::vector<GraphFilePageEntry> index(pages.size());
+    for (size_t i = 0; i < pages.size(); i++) {
+        index[i].key = pages[i].first;
+        index[i].tiles_offset = sections[1].offset + i * sizeof(Page);
+    }
+
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+
+    bool ok = _write_at(file, 0, &header, sizeof(header)) &&
+        _write_at(file, sizeof(header), sections, sizeof(sections)) &&
+        (index.empty() || _write_at(file, sections[0].offset, index.data(), sections[0].size));
+
+    for (size_t i = 0; ok && i < pages.size(); i++) {
+        ok = _write_at(file, index[i].tiles_offset, pages[i].second->tiles, sizeof(Page));
+    }
+
+    // Pads the file out to its full size when the last section is empty
+    if (ok && pages.empty()) {
+        ok = fseek(file, (long)header.file_size - 1, SEEK_SET) == 0 && fputc(0, file) != EOF;
+    }
+
+    return fclose(file) == 0 && ok;
+}
+
+bool GraphFile::open(const std::string& path) {
+    close();
+
+    auto mapping = std::make_shared<Mapping>();
+
+#ifdef _WIN32
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) return false;
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    if (size <= 0) {
+        fclose(file);
+        return false;
+    }
+
+    uint8_t* data = (uint8_t*)malloc(size);
+    bool read = data && fread(data, 1, size, file) == (size_t)size;
+    fclose(file);
+
+    mapping->data = data;
+    mapping->size = (size_t)size;
+    if (!read) return false;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+        ::close(fd);
+        return false;
+    }
+
+    void* data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (data == MAP_FAILED) return false;
+
+    mapping->data = (const uint8_t*)data;
+    mapping->size = (size_t)info.st_size;
+#endif
+
+    if (mapping->size < sizeof(GraphFileHeader)) return false;
+
+    const GraphFileHeader* header = (const GraphFileHeader*)mapping->data;
+    if (memcmp(header->magic, GRAPH_FILE_MAGIC, 4) != 0) return false;
+    if (header->version != GRAPH_FILE_VERSION) return false;
+    if (header->byte_order != GRAPH_FILE_BYTE_ORDER) return false;
+    if (header->page_shift != PAGE_SHIFT) return false;
+    if (header->file_size > mapping->size) return false;
+
+    uint64_t sections_end = sizeof(GraphFileHeader) + (uint64_t)header->section_count * sizeof(GraphFileSection);
+    if (sections_end > mapping->size) return false;
+
+    const GraphFileSection* sections = (const GraphFileSection*)(mapping->data + sizeof(GraphFileHeader));
+    const GraphFileSection* index = nullptr;
+    const GraphFileSection* tiles = nullptr;
+
+    for (uint32_t i = 0; i < header->section_count; i++) {
+        const GraphFileSection& section = sections[i];
+        if (section.offset > mapping->size || section.size > mapping->size - section.offset) return false;
+
+        if (section.kind == GraphSection_PageIndex) index = &section;
+        else if (section.kind == GraphSection_PageTiles) tiles = &section;
+    }
+
+    if (!index || !tiles) return false;
+    if (index->offset % alignof(GraphFilePageEntry) != 0) return false;
+
+    _mapping = mapping;
+    _index = (const GraphFilePageEntry*)(mapping->data + index->offset);
+    _page_count = index->size / sizeof(GraphFilePageEntry);
+    _tiles_begin = tiles->offset;
+    _tiles_end = tiles->offset + tiles->size;
+
+    return true;
+}
+
+void GraphFile::close() {
+    _mapping.reset();
+    _index = nullptr;
+    _page_count = 0;
+}
+
+PageRef GraphFile::page(int32_t page_x, int32_t page_y) const {
+    if (!_mapping) return PageRef();
+
+    int64_t key = page_key(page_x, page_y);
+    const GraphFilePageEntry* end = _index + _page_count;
+    const GraphFilePageEntry* it = std::lower_bound(_index, end, key, [](const GraphFilePageEntry& entry, int64_t key) {
+        return entry.key < key;
+    });
+
+    if (it == end || it->key != key) return PageRef();
+    return _page_at(*it);
+}
+
+PageRef GraphFile::_page_at(const GraphFilePageEntry& entry) const {
+    if (entry.tiles_offset < _tiles_begin || entry.tiles_offset + sizeof(Page) > _tiles_end) return PageRef();
+
+    // Aliases the mapping so it stays alive for as long as any page is in use
+    return PageRef(_mapping, (const Page*)(_mapping->data + entry.tiles_offset));
+}
+
+void GraphFile::load(Graph& graph) const {
+    graph.clear();
+
+    for (size_t i = 0; i < _page_count; i++) {
+        graph.set_page(page_key_x(_index[i].key), page_key_y(_index[i].key), _page_at(_index[i]));
+    }
+}
+
+PageSource GraphFile::source() const {
+    GraphFile file = *this;
+    return [file](int32_t page_x, int32_t page_y, PageRef& page) {
+        page = file.page(page_x, page_y);
+        return true;
+    };
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "graph.hpp"
+#include "paged_graph.hpp"
+
+#define GRAPH_FILE_MAGIC "PFGR"
+#define GRAPH_FILE_VERSION 1
+#define GRAPH_FILE_BYTE_ORDER 0x01020304
+
+namespace pathfinding {
+
+/*
+ * Layout, all in native byte order:
+ *   GraphFileHeader
+ *   GraphFileSection[section_count]
+ *   sections, each aligned to GRAPH_FILE_ALIGNMENT
+ *
+ * Readers skip sections they don't know, so derived data can be added without
+ * bumping the version.
+ */
+enum GraphSection {
+    GraphSection_PageIndex = 1, // GraphFilePageEntry sorted by page key
+    GraphSection_PageTiles = 2, // Page per entry, referenced by the index
+};
+
+struct GraphFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t page_shift;
+    uint32_t section_count;
+    uint32_t reserved;
+    uint64_t file_size;
+};
+
+struct GraphFileSection {
+    uint32_t kind;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct GraphFilePageEntry {
+    int64_t key;
+    uint64_t tiles_offset;
+};
+
+bool save_graph(const Graph& graph, const std::string& path);
+
+/*
+ * A read only view of a saved graph. The file is memory mapped and pages handed out
+ * point straight into the mapping, so processes loading the same file share it.
+ */
+class GraphFile {
+public:
+    GraphFile() : _index(nullptr), _page_count(0) {}
+
+    bool open(const std::string& path);
+    void close();
+
+    inline bool is_open() const { return (bool)_mapping; }
+    inline size_t page_count() const { return _page_count; }
+
+    // Null when the page is not in the file, which means it is all air
+    PageRef page(int32_t page_x, int32_t page_y) const;
+
+    // Shares every page of the file with the graph
+    void load(Graph& graph) const;
+
+    // Page source for streaming the file through a PagedGraph
+    PageSource source() const;
+
+private:
+    struct Mapping;
+
+    PageRef _page_at(const GraphFilePageEntry& entry) const;
+
+    std::shared_ptr<const Mapping> _mapping;
+    const GraphFilePageEntry* _index;
+    size_t _page_count;
+    uint64_t _tiles_begin;
+    uint64_t _tiles_end;
+};
+
+}
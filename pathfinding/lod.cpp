@@ -0,0 +1,139 @@
+#include "lod.hpp"
+
+#include <algorithm>
+
+using namespace pathfinding;
+
+#define BLOCKS_PER_PAGE (PAGE_SIZE / LOD_SCALE)
+
+static TileKind _block_kind(const Page& page, int block_x, int block_y) {
+    bool solid = false;
+    bool character = false;
+
+    for (int j = 0; j < LOD_SCALE; j++) {
+        const uint8_t* row = page.tiles + (((block_y << LOD_SHIFT) + j) << PAGE_SHIFT) + (block_x << LOD_SHIFT);
+
+        for (int i = 0; i < LOD_SCALE; i++) {
+            if (row[i] == FLOOR_TILEKIND) return FLOOR_TILEKIND;
+            if (row[i] == UNTRAVERSABLE_TILEKIND) solid = true;
+            else if (row[i] == CHARACTER_TILEKIND) character = true;
+        }
+    }
+
+    if (solid) return UNTRAVERSABLE_TILEKIND;
+    return character ? CHARACTER_TILEKIND : AIR_TILEKIND;
+}
+
+static uint8_t _block_cost(const CostPage& page, int block_x, int block_y) {
+    uint8_t cost = 0;
+
+    for (int j = 0; j < LOD_SCALE; j++) {
+        const uint8_t* row = page.costs + (((block_y << LOD_SHIFT) + j) << PAGE_SHIFT) + (block_x << LOD_SHIFT);
+        for (int i = 0; i < LOD_SCALE; i++) cost = std::max(cost, row[i]);
+    }
+
+    return cost;
+}
+
+static void _downsample_tiles(const Page* page, int32_t page_x, int32_t page_y, Graph& coarse) {
+    for (int block_y = 0; block_y < BLOCKS_PER_PAGE; block_y++) {
+        for (int block_x = 0; block_x < BLOCKS_PER_PAGE; block_x++) {
+            TileKind kind = page ? _block_kind(*page, block_x, block_y) : AIR_TILEKIND;
+            coarse.set_at(page_x * BLOCKS_PER_PAGE + block_x, page_y * BLOCKS_PER_PAGE + block_y, kind);
+        }
+    }
+}
+
+Region pathfinding::coarse_region(const Region& region) {
+    Region coarse;
+    coarse.x = region.x >> LOD_SHIFT;
+    coarse.y = region.y >> LOD_SHIFT;
+    coarse.w = ((region.x + std::max(region.w, 1) - 1) >> LOD_SHIFT) - coarse.x + 1;
+    coarse.h = ((region.y + std::max(region.h, 1) - 1) >> LOD_SHIFT) - coarse.y + 1;
+    return coarse;
+}
+
+Settings pathfinding::coarse_settings(const Settings& settings) {
+    Settings coarse = settings;
+
+    coarse.width = std::max((settings.width + LOD_SCALE - 1) / LOD_SCALE, 1u);
+    coarse.height = std::max((settings.height + LOD_SCALE - 1) / LOD_SCALE, 1u);
+    coarse.max_jump_height = settings.max_jump_height / LOD_SCALE;
+
+    // The air stride is a ratio of vertical to sideways motion, it holds at any scale
+
+    coarse.costs.up *= LOD_SCALE;
+    coarse.costs.down *= LOD_SCALE;
+    coarse.costs.level *= LOD_SCALE;
+    coarse.costs.character *= LOD_SCALE;
+    coarse.costs.hazard *= LOD_SCALE;
+
+    // Scaled once for the distance and once more for the shorter jump it is multiplied by
+    coarse.costs.ledge_climb *= LOD_SCALE * LOD_SCALE;
+
+    return coarse;
+}
+
+void pathfinding::downsample(const Graph& fine, Graph& coarse) {
+    fine.for_each_page([&](int32_t page_x, int32_t page_y, const PageRef& page) {
+        _downsample_tiles(page.get(), page_x, page_y, coarse);
+    });
+
+    fine.for_each_cost_page([&](int32_t page_x, int32_t page_y, const CostPageRef& page) {
+        for (int block_y = 0; block_y < BLOCKS_PER_PAGE; block_y++) {
+            for (int block_x = 0; block_x < BLOCKS_PER_PAGE; block_x++) {
+                uint8_t cost = page ? _block_cost(*page, block_x, block_y) : 0;
+                coarse.set_cost_at(page_x * BLOCKS_PER_PAGE + block_x, page_y * BLOCKS_PER_PAGE + block_y, cost);
+            }
+        }
+    });
+}
+
+void pathfinding::downsample_page(const Graph& fine, int32_t page_x, int32_t page_y, Graph& coarse) {
+    _downsample_tiles(fine.get_page(page_x, page_y).get(), page_x, page_y, coarse);
+}
+
+bool pathfinding::coarse_search(
+    const Graph& coarse,
+    const Settings& settings,
+    const Region& region,
+    const State& initial,
+    const std::vector<Region>& goals,
+    std::vector<State>& path,
+    int& goal_index,
+    SearchStats* stats,
+    PathOutput output) {
+
+    // A goal cell can be where the feet are or the floor under them
+    std::vector<Region> coarse_goals;
+    for (const Region& goal : goals) {
+        Region block = coarse_region(goal);
+        int top = coarse_y(goal.y);
+        if (top < block.y) {
+            block.h += block.y - top;
+            block.y = top;
+        }
+
+        coarse_goals.push_back(block);
+    }
+
+    State start = State::create(coarse_x(initial.x), coarse_y(initial.y));
+
+    if (!search(coarse, coarse_settings(settings), coarse_region(region), start, coarse_goals, path, goal_index, stats, output)) return false;
+
+    for (State& state : path) {
+        state.x = fine_x(state.x);
+        state.y = fine_y(state.y);
+        state.jump = 0;
+    }
+
+    path.front().x = initial.x;
+    path.front().y = initial.y;
+
+    const Region& goal = goals[goal_index];
+    State& last = path.back();
+    last.x = std::max(goal.x, std::min(last.x, goal.x + goal.w - 1));
+    last.y = std::max(goal.y, std::min(last.y, goal.y + goal.h - 1));
+
+    return true;
+}
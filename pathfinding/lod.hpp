@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+
+#include "graph.hpp"
+#include "region.hpp"
+#include "search.hpp"
+#include "settings.hpp"
+#include "state.hpp"
+
+#define LOD_SHIFT 2
+#define LOD_SCALE (1 << LOD_SHIFT)
+
+namespace pathfinding {
+
+/*
+ * A coarse graph has one tile per LOD_SCALE x LOD_SCALE block of the fine graph. Any
+ * floor in a block can be stood on, anything else solid in it blocks the whole block,
+ * so passages narrower than a block are lost but open space stays open.
+ */
+inline int32_t coarse_x(const int32_t x) { return x >> LOD_SHIFT; }
+inline int32_t fine_x(const int32_t x) { return x << LOD_SHIFT; }
+
+// A character's feet are in the block above the one its floor tile is in, they map back to that block's bottom row
+inline int32_t coarse_y(const int32_t y) { return ((y + 1) >> LOD_SHIFT) - 1; }
+inline int32_t fine_y(const int32_t y) { return ((y + 1) << LOD_SHIFT) - 1; }
+
+// Every block the region touches
+Region coarse_region(const Region& region);
+
+// Sizes round up and jumps round down, costs scale so a coarse path costs about what the fine one would
+Settings coarse_settings(const Settings& settings);
+
+/*
+ * Rewrites the blocks under every page of fine, costs take the highest cost in their
+ * block. Blocks of pages fine doesn't have are left alone, so a streamed graph can keep
+ * a coarse copy of pages it has since evicted.
+ */
+void downsample(const Graph& fine, Graph& coarse);
+
+// Rewrites the blocks under one page of fine, costs are left alone
+void downsample_page(const Graph& fine, int32_t page_x, int32_t page_y, Graph& coarse);
+
+/*
+ * Runs search on a coarse graph with everything given in fine cells, and returns the
+ * path in fine cells again. The first state is initial and the last one lies in the
+ * goal, the ones between are only as good as the blocks they came from.
+ */
+bool coarse_search(
+    const Graph& coarse,
+    const Settings& settings,
+    const Region& region,
+    const State& initial,
+    const std::vector<Region>& goals,
+    std::vector<State>& path,
+    int& goal_index,
+    SearchStats* stats = nullptr,
+    PathOutput output = PathOutput_Keypoints);
+
+}
@@ -0,0 +1,31 @@
+#include "occupancy.hpp"
+
+using namespace pathfinding;
+
+void Occupancy::build(const std::vector<std::pair<int32_t, Region>>& agents) {
+    _pages.clear();
+    _bounds = Region { 0, 0, 0, 0 };
+
+    for (const auto& agent : agents) {
+        int32_t id = agent.first;
+        const Region& region = agent.second;
+        if (region.w <= 0 || region.h <= 0) continue;
+
+        _bounds = _bounds.w > 0 ? region_union(_bounds, region) : region;
+
+        for (int32_t y = region.y; y < region.y + region.h; y++) {
+            for (int32_t x = region.x; x < region.x + region.w; x++) {
+                std::unique_ptr<OccupancyPage>& page = _pages[page_key(page_of(x), page_of(y))];
+
+                if (!page) {
+                    page.reset(new OccupancyPage());
+                    for (int i = 0; i < PAGE_TILES; i++) page->owners[i] = OCCUPANCY_FREE;
+                }
+
+                int32_t& owner = page->owners[page_index(x, y)];
+                if (owner == OCCUPANCY_FREE || owner == id) owner = id;
+                else owner = OCCUPANCY_SHARED;
+            }
+        }
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <climits>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "page.hpp"
+#include "region.hpp"
+
+#define OCCUPANCY_FREE INT32_MIN
+#define OCCUPANCY_SHARED (INT32_MIN + 1)
+
+namespace pathfinding {
+
+// The agent covering each tile of a page, laid out like Page
+struct OccupancyPage {
+    int32_t owners[PAGE_TILES];
+};
+
+/*
+ * Every registered agent rasterized once into pages of owners. Built in one go and never
+ * changed after, so queries on any thread can share it while the next one is built. A
+ * tile covered by several agents is shared and stays occupied for each of them.
+ */
+class Occupancy {
+public:
+    Occupancy() : _bounds { 0, 0, 0, 0 } {}
+
+    void build(const std::vector<std::pair<int32_t, Region>>& agents);
+
+    // Covered by some agent other than exclude
+    inline bool occupied(int32_t x, int32_t y, int32_t exclude) const {
+        if (x < _bounds.x || y < _bounds.y || x >= _bounds.x + _bounds.w || y >= _bounds.y + _bounds.h) return false;
+
+        auto it = _pages.find(page_key(page_of(x), page_of(y)));
+        if (it == _pages.end()) return false;
+
+        int32_t owner = it->second->owners[page_index(x, y)];
+        return owner != OCCUPANCY_FREE && owner != exclude;
+    }
+
+    // Whether any agent could cover a tile of the row, lets whole rows skip the per tile lookup
+    inline bool overlaps_row(int32_t x, int32_t y, int32_t count) const {
+        return y >= _bounds.y && y < _bounds.y + _bounds.h && x + count > _bounds.x && x < _bounds.x + _bounds.w;
+    }
+
+    inline bool empty() const { return _pages.empty(); }
+    inline size_t page_count() const { return _pages.size(); }
+
+private:
+    std::unordered_map<int64_t, std::unique_ptr<OccupancyPage>, PageKeyHash> _pages;
+
+    // Covers every agent, reads outside it never reach the pages
+    Region _bounds;
+};
+
+typedef std::shared_ptr<const Occupancy> OccupancyRef;
+
+}
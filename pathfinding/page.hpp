@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include "state.hpp"
+
+#define PAGE_SHIFT 5
+#define PAGE_SIZE (1 << PAGE_SHIFT)
+#define PAGE_MASK (PAGE_SIZE - 1)
+#define PAGE_TILES (PAGE_SIZE * PAGE_SIZE)
+
+namespace pathfinding {
+
+// A square block of tiles, one TileKind per byte in row major order
+struct Page {
+    uint8_t tiles[PAGE_TILES];
+};
+
+typedef std::shared_ptr<const Page> PageRef;
+
+// Extra cost for entering each tile of a page, laid out like Page
+struct CostPage {
+    uint8_t costs[PAGE_TILES];
+};
+
+typedef std::shared_ptr<const CostPage> CostPageRef;
+
+inline int32_t page_of(const int32_t tile) { return tile >> PAGE_SHIFT; }
+
+inline int page_index(const int32_t x, const int32_t y) { return ((y & PAGE_MASK) << PAGE_SHIFT) | (x & PAGE_MASK); }
+
+inline int64_t page_key(const int32_t page_x, const int32_t page_y) {
+    return (int64_t)(((uint64_t)(uint32_t)page_y << 32) | (uint32_t)page_x);
+}
+
+inline int32_t page_key_x(const int64_t key) { return (int32_t)(uint32_t)((uint64_t)key & 0xFFFFFFFF); }
+inline int32_t page_key_y(const int64_t key) { return (int32_t)(uint32_t)((uint64_t)key >> 32); }
+
+struct PageKeyHash {
+    inline std::size_t operator()(const int64_t key) const noexcept { return (std::size_t)mix_key((uint64_t)key); }
+};
+
+}
@@ -0,0 +1,174 @@
+#include "paged_graph.hpp"
+
+#include <algorithm>
+#include <climits>
+
+using namespace pathfinding;
+
+#define FOR_EACH_PAGE(region, page_x, page_y) \
+    for (int32_t page_y = page_of(region.y); page_y <= page_of(region.y + region.h - 1); page_y++) \
+        for (int32_t page_x = page_of(region.x); page_x <= page_of(region.x + region.w - 1); page_x++)
+
+void PagedGraph::source_set(const PageSource& source) {
+    _source = source;
+    clear();
+}
+
+void PagedGraph::budget_set(size_t pages) {
+    _budget = pages > 0 ? pages : 1;
+    _evict();
+}
+
+void PagedGraph::clear() {
+    _version++;
+    _graph.clear();
+    _lru.clear();
+    _resident.clear();
+    _pending.clear();
+    _pending_set.clear();
+    _loaded.clear();
+}
+
+void PagedGraph::take_loaded(std::vector<int64_t>& keys) {
+    keys.assign(_loaded.begin(), _loaded.end());
+    _loaded.clear();
+}
+
+bool PagedGraph::acquire(const Region& region, const PageMiss miss) {
+    if (region.w <= 0 || region.h <= 0) return true;
+
+    // The whole region has to stay resident at once
+    if (_page_span(region) > _budget) return false;
+
+    bool complete = true;
+
+    FOR_EACH_PAGE(region, page_x, page_y) {
+        int64_t key = page_key(page_x, page_y);
+        if (_resident.find(key) != _resident.end()) {
+            _touch(key);
+            continue;
+        }
+
+        if (miss == PageMiss_Fail) {
+            if (_pending_set.insert(key).second) _pending.push_back(key);
+            complete = false;
+            continue;
+        }
+
+        if (!_load(page_x, page_y)) complete = false;
+    }
+
+    // Pages of the region were touched last, so only older ones get evicted
+    _evict();
+
+    return complete;
+}
+
+void PagedGraph::prefetch(const Region& region) {
+    if (region.w <= 0 || region.h <= 0) return;
+    if (_page_span(region) > _budget) return;
+
+    FOR_EACH_PAGE(region, page_x, page_y) {
+        int64_t key = page_key(page_x, page_y);
+        if (_resident.find(key) != _resident.end()) continue;
+        if (_pending_set.insert(key).second) _pending.push_back(key);
+    }
+}
+
+int PagedGraph::pump(int max_loads) {
+    int loaded = 0;
+
+    while (loaded < max_loads && !_pending.empty()) {
+        int64_t key = _pending.front();
+        _pending.pop_front();
+        _pending_set.erase(key);
+
+        if (_resident.find(key) != _resident.end()) continue;
+
+        if (_load(page_key_x(key), page_key_y(key))) loaded++;
+    }
+
+    _evict();
+
+    return loaded;
+}
+
+bool PagedGraph::is_resident(const Region& region) const {
+    if (region.w <= 0 || region.h <= 0) return true;
+    if (_page_span(region) > _resident.size()) return false;
+
+    FOR_EACH_PAGE(region, page_x, page_y) {
+        if (_resident.find(page_key(page_x, page_y)) == _resident.end()) return false;
+    }
+
+    return true;
+}
+
+void PagedGraph::snapshot(const Region& region, Graph& out) const {
+    out.clear();
+    out.clear_costs();
+    if (region.w <= 0 || region.h <= 0) return;
+
+    // Never more than the budget is resident, so walk those instead of a possibly huge region
+    int64_t first_x = page_of(region.x), last_x = page_of((int32_t)std::min<int64_t>((int64_t)region.x + region.w - 1, INT32_MAX));
+    int64_t first_y = page_of(region.y), last_y = page_of((int32_t)std::min<int64_t>((int64_t)region.y + region.h - 1, INT32_MAX));
+
+    for (auto& resident : _resident) {
+        int32_t page_x = page_key_x(resident.first);
+        int32_t page_y = page_key_y(resident.first);
+        if (page_x < first_x || page_x > last_x || page_y < first_y || page_y > last_y) continue;
+
+        PageRef page = _graph.get_page(page_x, page_y);
+        if (page) out.set_page(page_x, page_y, page);
+    }
+
+    // Costs aren't streamed, the few pages that have any stay put
+    _graph.for_each_cost_page([&](int32_t page_x, int32_t page_y, const CostPageRef& page) {
+        if (page_x < first_x || page_x > last_x || page_y < first_y || page_y > last_y) return;
+        out.set_cost_page(page_x, page_y, page);
+    });
+}
+
+void PagedGraph::set_cost_region(const Region& region, uint8_t cost) {
+    _graph.set_cost_region(region, cost);
+}
+
+void PagedGraph::clear_costs() {
+    _graph.clear_costs();
+}
+
+bool PagedGraph::_load(int32_t page_x, int32_t page_y) {
+    if (!_source) return false;
+
+    PageRef page;
+    if (!_source(page_x, page_y, page)) return false;
+
+    int64_t key = page_key(page_x, page_y);
+    _graph.set_page(page_x, page_y, page);
+    _version++;
+
+    _lru.push_front(key);
+    _resident[key] = _lru.begin();
+    _loaded.insert(key);
+
+    return true;
+}
+
+void PagedGraph::_touch(int64_t key) {
+    auto it = _resident.find(key);
+    if (it == _resident.end()) return;
+
+    _lru.splice(_lru.begin(), _lru, it->second);
+}
+
+void PagedGraph::_evict() {
+    while (_resident.size() > _budget) {
+        int64_t key = _lru.back();
+        _lru.pop_back();
+        _resident.erase(key);
+        _loaded.erase(key);
+
+        _graph.erase_page(page_key_x(key), page_key_y(key));
+        _version++;
+    }
+}
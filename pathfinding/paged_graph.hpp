@@ -0,0 +1,95 @@
+#pragma once
+
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "graph.hpp"
+
+namespace pathfinding {
+
+enum PageMiss {
+    PageMiss_Block = 0,
+    PageMiss_Fail = 1,
+};
+
+// Fills in the page at the given page coordinates, leaving it null means the page is all air
+typedef std::function<bool(int32_t page_x, int32_t page_y, PageRef& page)> PageSource;
+
+/*
+ * Keeps the pages of a world that is too big to hold at once. Pages come from the
+ * source on demand and the least recently used ones are dropped once more than the
+ * budget are resident. Not thread safe, queries should run on snapshots.
+ */
+class PagedGraph {
+public:
+    PagedGraph() : _budget(1024), _version(0) {}
+
+    void source_set(const PageSource& source);
+
+    void budget_set(size_t pages);
+    inline size_t budget_get() const { return _budget; }
+
+    void clear();
+
+    // Makes every page overlapping the region resident, loading or failing on misses
+    bool acquire(const Region& region, const PageMiss miss);
+
+    // Queues the missing pages overlapping the region for pump
+    void prefetch(const Region& region);
+
+    // Loads up to max_loads queued pages and returns how many were loaded
+    int pump(int max_loads);
+
+    bool is_resident(const Region& region) const;
+
+    // Shares the resident pages overlapping the region with the output graph
+    void snapshot(const Region& region, Graph& out) const;
+
+    // Costs stay resident, evicting and reloading tiles keeps them
+    void set_cost_region(const Region& region, uint8_t cost);
+    void clear_costs();
+
+    inline const Graph& graph() const { return _graph; }
+
+    inline size_t resident_count() const { return _resident.size(); }
+    inline size_t pending_count() const { return _pending.size(); }
+
+    // Changes whenever a page is loaded or dropped
+    inline uint64_t version() const { return _version; }
+
+    // Moves out the pages loaded since the last call that are still resident
+    void take_loaded(std::vector<int64_t>& keys);
+
+private:
+    bool _load(int32_t page_x, int32_t page_y);
+    void _touch(int64_t key);
+    void _evict();
+
+    static inline size_t _page_span(const Region& region) {
+        if (region.w <= 0 || region.h <= 0) return 0;
+        int64_t w = (((int64_t)region.x + region.w - 1) >> PAGE_SHIFT) - (region.x >> PAGE_SHIFT) + 1;
+        int64_t h = (((int64_t)region.y + region.h - 1) >> PAGE_SHIFT) - (region.y >> PAGE_SHIFT) + 1;
+        return (size_t)w * (size_t)h;
+    }
+
+    PageSource _source;
+    size_t _budget;
+    uint64_t _version;
+
+    // Pages with content, empty pages are only tracked as resident
+    Graph _graph;
+
+    // Most recently used at the front
+    std::list<int64_t> _lru;
+    std::unordered_map<int64_t, std::list<int64_t>::iterator, PageKeyHash> _resident;
+
+    std::list<int64_t> _pending;
+    std::unordered_set<int64_t, PageKeyHash> _pending_set;
+
+    std::unordered_set<int64_t, PageKeyHash> _loaded;
+};
+
+}
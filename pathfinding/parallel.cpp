@@ -0,0 +1,364 @@
+#include "parallel.hpp"
+#include "ring.hpp"
+#include "state_key.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <memory>
+#include <queue>
+#include <unordered_map>
+
+// States a worker expands between looks at its queues
+#define PARALLEL_EXPANSIONS 64
+
+// Messages taken off one queue at a time
+#define PARALLEL_BATCH 64
+
+using namespace pathfinding;
+
+struct Visit {
+    StateKey came_from;
+    int cost;
+    bool closed;
+};
+
+// A move into a state of the receiving worker
+struct Message {
+    StateKey key;
+    StateKey came_from;
+    int cost;
+};
+
+struct Entry {
+    int priority;
+    int cost;
+    StateKey key;
+};
+
+// Ties go to the state furthest along, it is the one closer to a goal
+struct Later {
+    inline bool operator()(const Entry& a, const Entry& b) const {
+        return a.priority > b.priority || (a.priority == b.priority && a.cost < b.cost);
+    }
+};
+
+struct Partition {
+    std::unordered_map<StateKey, Visit, StateKeyHash> visited;
+    std::priority_queue<Entry, std::vector<Entry>, Later> frontier;
+
+    // Moves for other workers that didn't fit in their queues yet, one per worker
+    std::vector<std::vector<Message>> outboxes;
+
+    SearchStats stats;
+};
+
+// Bits 0-39 of a key are the position and the jump counter, scenarios come with the position
+static inline int _owner(StateKey key, int threads) {
+    return (int)(mix_key(key & 0xFFFFFFFFFFULL) % (uint64_t)threads);
+}
+
+static inline bool _contains(const Region& region, const State& state) {
+    return state.x >= region.x && state.y >= region.y && state.x < region.x + region.w && state.y < region.y + region.h;
+}
+
+bool pathfinding::parallel_search(
+    const Graph& graph,
+    const Settings& settings,
+    const Region& region,
+    State initial,
+    const std::vector<Region>& goals,
+    std::vector<State>& path,
+    int& goal_index,
+    ParallelWorkers& workers,
+    SearchStats* stats,
+    PathOutput output,
+    bool lazy) {
+
+    int threads = workers.threads();
+    if (threads <= 1) return search(graph, settings, region, initial, goals, path, goal_index, stats, output, lazy);
+
+    auto started = std::chrono::steady_clock::now();
+
+    graph.contextualize(settings, initial);
+
+    goal_index = -1;
+
+    path.clear();
+
+    if (goals.empty()) return false;
+
+    // Packed keys only have room for an 8 bit jump counter
+    if (graph.calculate_jump_limit(settings) + (int)settings.air_stride > STATE_KEY_MAX_JUMP) return false;
+
+    StatePacker packer(region, initial);
+    Region bounds = packer.clip(region);
+
+    StepCosts steps = min_step_costs(settings);
+
+    std::vector<Partition> partitions(threads);
+    for (Partition& partition : partitions) partition.outboxes.resize(threads);
+
+    // Queue from worker s to worker r at r * threads + s
+    std::vector<std::unique_ptr<RingQueue<Message>>> queues(threads * threads);
+    for (auto& queue : queues) {
+        queue.reset(new RingQueue<Message>());
+        queue->head.store(0);
+        queue->tail.store(0);
+    }
+
+    // Busy workers plus messages sent and not yet received, nothing can make it grow again once it is 0
+    std::atomic<int64_t> active(threads);
+    std::atomic<bool> finished(false);
+
+    // Best path found so far, anything that can't beat it is dropped
+    std::atomic<int> best(INT_MAX);
+    std::mutex best_lock;
+    StateKey best_key = 0;
+    int best_goal = -1;
+
+    StateKey initial_key = packer.pack(initial);
+    Partition& first = partitions[_owner(initial_key, threads)];
+    first.visited[initial_key] = Visit { initial_key, 0, false };
+    first.frontier.push(Entry { goal_estimate(settings, steps, initial, goals), 0, initial_key });
+
+    std::function<void(int)> run = [&](int index) {
+        Partition& worker = partitions[index];
+        State neighbors[MAX_NEIGHBORS];
+        Message batch[PARALLEL_BATCH];
+        bool busy = true;
+
+        auto relax = [&](StateKey key, const State& state, StateKey came_from, int cost) {
+            auto it = worker.visited.find(key);
+            if (it != worker.visited.end() && cost >= it->second.cost) return;
+
+            if (it != worker.visited.end() && it->second.closed) worker.stats.reopened++;
+
+            worker.visited[key] = Visit { came_from, cost, false };
+            worker.frontier.push(Entry { cost + goal_estimate(settings, steps, state, goals), cost, key });
+
+            if (worker.frontier.size() > worker.stats.frontier_peak) worker.stats.frontier_peak = worker.frontier.size();
+        };
+
+        // False once nothing left on the frontier can beat the best path
+        auto expand = [&]() {
+            while (!worker.frontier.empty()) {
+                Entry entry = worker.frontier.top();
+                worker.frontier.pop();
+
+                if (entry.priority >= best.load(std::memory_order_relaxed)) {
+                    worker.frontier = decltype(worker.frontier)();
+                    return false;
+                }
+
+                // Stale entry left behind by a cheaper path to the same state
+                Visit& visit = worker.visited[entry.key];
+                if (visit.closed || entry.cost != visit.cost) continue;
+                visit.closed = true;
+
+                State current = packer.unpack(entry.key);
+
+                // Checked once here instead of once per move into it, a cost of -1 keeps it from being reached again
+                if (lazy && entry.key != initial_key) {
+                    worker.stats.fit_checks++;
+                    worker.stats.tile_reads += fit_tiles(settings);
+                    if (!graph.fits(settings, current.x, current.y)) {
+                        visit.cost = -1;
+                        continue;
+                    }
+                }
+
+                int reached = reached_goal(settings, current, goals);
+                if (reached >= 0) {
+                    std::unique_lock<std::mutex> lock(best_lock);
+                    if (entry.cost < best.load(std::memory_order_relaxed)) {
+                        best.store(entry.cost, std::memory_order_relaxed);
+                        best_key = entry.key;
+                        best_goal = reached;
+                    }
+                    return true;
+                }
+
+                int n = lazy ? graph.candidates(settings, current, neighbors) : graph.neighbors(settings, current, neighbors);
+
+                worker.stats.expanded++;
+                worker.stats.generated += n;
+                if (lazy) worker.stats.tile_reads += n;
+                else {
+                    worker.stats.fit_checks += settings.ledge_hang ? 6 : 4;
+                    worker.stats.tile_reads += (settings.ledge_hang ? 6 : 4) * fit_tiles(settings);
+                }
+
+                for (int i = 0; i < n; i++) {
+                    State& next = neighbors[i];
+                    if (!_contains(bounds, next)) continue;
+
+                    // Only the tile the character stands in is read, see search
+                    if (lazy) {
+                        TileKind kind = graph.get_at(next.x, next.y);
+                        if (kind == FLOOR_TILEKIND || kind == UNTRAVERSABLE_TILEKIND) continue;
+                        if (!graph.transition(settings, current, next, false)) continue;
+                    }
+
+                    int new_cost = entry.cost + graph.cost(settings, current, next);
+                    if (new_cost + goal_estimate(settings, steps, next, goals) >= best.load(std::memory_order_relaxed)) continue;
+
+                    StateKey next_key = packer.pack(next);
+                    int owner = _owner(next_key, threads);
+
+                    if (owner == index) relax(next_key, next, entry.key, new_cost);
+                    else {
+                        worker.outboxes[owner].push_back(Message { next_key, entry.key, new_cost });
+                        active.fetch_add(1);
+                    }
+                }
+
+                return true;
+            }
+
+            return false;
+        };
+
+        while (!finished.load(std::memory_order_acquire)) {
+            for (int sender = 0; sender < threads; sender++) {
+                RingQueue<Message>& queue = *queues[index * threads + sender];
+
+                uint32_t count;
+                while ((count = queue.pop(batch, PARALLEL_BATCH)) > 0) {
+                    // Counted busy before the messages stop counting, so the total can't touch 0 in between
+                    if (!busy) {
+                        active.fetch_add(1);
+                        busy = true;
+                    }
+
+                    for (uint32_t i = 0; i < count; i++) {
+                        const Message& message = batch[i];
+                        relax(message.key, packer.unpack(message.key), message.came_from, message.cost);
+                    }
+
+                    active.fetch_sub(count);
+                }
+            }
+
+            // Whatever doesn't fit waits for the next round, the receiver keeps draining meanwhile
+            bool backed_up = false;
+            for (int receiver = 0; receiver < threads; receiver++) {
+                std::vector<Message>& outbox = worker.outboxes[receiver];
+                if (outbox.empty()) continue;
+
+                uint32_t sent = queues[receiver * threads + index]->push(outbox.data(), (uint32_t)std::min(outbox.size(), (size_t)RING_SLOTS));
+                outbox.erase(outbox.begin(), outbox.begin() + sent);
+                if (!outbox.empty()) backed_up = true;
+            }
+
+            // A receiver that can't keep up is behind on cheaper states, expanding further ahead of it is mostly wasted
+            if (backed_up) {
+                std::this_thread::yield();
+                continue;
+            }
+
+            bool expanded = false;
+            for (int i = 0; i < PARALLEL_EXPANSIONS && expand(); i++) expanded = true;
+            if (expanded) continue;
+
+            if (busy) {
+                busy = false;
+                active.fetch_sub(1);
+            }
+            else if (active.load() == 0) finished.store(true, std::memory_order_release);
+            else std::this_thread::yield();
+        }
+    };
+
+    if (!workers.try_run(run)) return search(graph, settings, region, initial, goals, path, goal_index, stats, output, lazy);
+
+    if (stats) {
+        for (const Partition& worker : partitions) {
+            stats->expanded += worker.stats.expanded;
+            stats->generated += worker.stats.generated;
+            stats->reopened += worker.stats.reopened;
+            stats->frontier_peak = std::max(stats->frontier_peak, worker.stats.frontier_peak);
+            stats->tile_reads += worker.stats.tile_reads;
+            stats->fit_checks += worker.stats.fit_checks;
+        }
+
+        stats->search_usec += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count();
+    }
+
+    if (best_goal < 0) return false;
+
+    goal_index = best_goal;
+
+    // Reconstruct path, each state is kept by its owner
+    StateKey current_key = best_key;
+    while (current_key != initial_key) {
+        path.push_back(packer.unpack(current_key));
+        current_key = partitions[_owner(current_key, threads)].visited[current_key].came_from;
+    }
+
+    path.push_back(initial);
+
+    std::reverse(path.begin(), path.end());
+
+    if (output != PathOutput_Full) filter(graph, path);
+    if (output == PathOutput_Shortened) shorten(graph, settings, path);
+
+    return true;
+}
+
+ParallelWorkers::ParallelWorkers(int threads) : _job(nullptr), _generation(0), _pending(0), _stopped(false) {
+    for (int i = 1; i < threads; i++) _threads.emplace_back(&ParallelWorkers::_loop, this, i);
+}
+
+ParallelWorkers::~ParallelWorkers() {
+    {
+        std::unique_lock<std::mutex> lock(_lock);
+        _stopped = true;
+    }
+
+    _wake.notify_all();
+    for (std::thread& thread : _threads) thread.join();
+}
+
+bool ParallelWorkers::try_run(const std::function<void(int)>& job) {
+    std::unique_lock<std::mutex> running(_run_lock, std::try_to_lock);
+    if (!running.owns_lock()) return false;
+
+    {
+        std::unique_lock<std::mutex> lock(_lock);
+        _job = &job;
+        _pending = (int)_threads.size();
+        _generation++;
+    }
+
+    _wake.notify_all();
+    job(0);
+
+    std::unique_lock<std::mutex> lock(_lock);
+    _done.wait(lock, [this]() { return _pending == 0; });
+    _job = nullptr;
+    return true;
+}
+
+void ParallelWorkers::_loop(int index) {
+    uint64_t generation = 0;
+
+    while (true) {
+        const std::function<void(int)>* job;
+
+        {
+            std::unique_lock<std::mutex> lock(_lock);
+            _wake.wait(lock, [this, generation]() { return _stopped || _generation != generation; });
+            if (_stopped) return;
+
+            generation = _generation;
+            job = _job;
+        }
+
+        (*job)(index);
+
+        std::unique_lock<std::mutex> lock(_lock);
+        if (--_pending == 0) _done.notify_one();
+    }
+}
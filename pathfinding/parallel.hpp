@@ -0,0 +1,81 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "graph.hpp"
+#include "search.hpp"
+#include "settings.hpp"
+#include "state.hpp"
+
+namespace pathfinding {
+
+/*
+ * Threads kept around for parallel_search, so a query only wakes them instead of
+ * starting its own. The thread running a search is one of the workers, the others wait
+ * here between searches. One search at a time, a second one finds them busy.
+ */
+class ParallelWorkers {
+public:
+    explicit ParallelWorkers(int threads);
+    ~ParallelWorkers();
+
+    ParallelWorkers(const ParallelWorkers&) = delete;
+    ParallelWorkers& operator=(const ParallelWorkers&) = delete;
+
+    inline int threads() const { return (int)_threads.size() + 1; }
+
+    // Runs job once per worker index, 0 on the calling thread, and returns once all are done. False when busy
+    bool try_run(const std::function<void(int)>& job);
+
+private:
+    void _loop(int index);
+
+    std::mutex _run_lock;
+
+    std::mutex _lock;
+    std::condition_variable _wake;
+    std::condition_variable _done;
+    const std::function<void(int)>* _job;
+    uint64_t _generation;
+    int _pending;
+    bool _stopped;
+
+    std::vector<std::thread> _threads;
+};
+
+/*
+ * Experimental. It has only been measured on a single core, where the differential
+ * harness puts it at about 0.28x the reference engine, a tenth of the speed of search.
+ * Keep it off unless a benchmark on the target machine shows a win.
+ *
+ * Hash distributed A* for single long queries, one worker per thread. Every state belongs
+ * to the worker its position and jump counter hash to, only that worker expands it, and
+ * moves into another worker's states are sent there through a lock free queue per pair of
+ * workers. The first goal reached isn't necessarily the cheapest, so workers keep going
+ * until nothing on any frontier or in any queue could still beat the best path found. The
+ * path is as cheap as search's, though it can be a different one.
+ *
+ * Searches the whole region like search without a window, floor runs aren't walked in
+ * place. Lazy checks fits when a state is expanded like search does. Falls back to search
+ * on the calling thread when the workers are busy or there is only one. Every state passes
+ * through the queues, only worth it for queries that take milliseconds. The frontier peak
+in stats is the largest of any one worker's.
+ */
+bool parallel_search(
+    const Graph& graph,
+    const Settings& settings,
+    const Region& region,
+    State initial,
+    const std::vector<Region>& goals,
+    std::vector<State>& path,
+    int& goal_index,
+    ParallelWorkers& workers,
+    SearchStats* stats = nullptr,
+    PathOutput output = PathOutput_Full,
+    bool lazy = false);
+
+}
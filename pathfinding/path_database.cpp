@@ -0,0 +1,323 @@
+#include "tools/queue.hpp"
+#include "path_database.hpp"
+#include "state_key.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+#define PATH_DATABASE_BYTE_ORDER 0x01020304
+
+using namespace pathfinding;
+
+struct Flood {
+    StateKey came_from;
+    int cost;
+    bool closed;
+};
+
+static inline uint64_t _cell_key(int x, int y) {
+    return ((uint64_t)(uint32_t)y << 32) | (uint32_t)x;
+}
+
+static inline bool _contains(const Region& region, const State& state) {
+    return state.x >= region.x && state.y >= region.y && state.x < region.x + region.w && state.y < region.y + region.h;
+}
+
+PathDatabase::PathDatabase() : _region { 0, 0, 0, 0 } {
+    _settings.max_jump_height = 0;
+    _settings.air_stride = 2;
+    _settings.width = 1;
+    _settings.height = 1;
+    _settings.ledge_hang = false;
+}
+
+void PathDatabase::clear() {
+    _points.clear();
+    _point_indices.clear();
+    _ends.clear();
+    _costs.clear();
+    _nodes.clear();
+}
+
+void PathDatabase::build(const Graph& graph, const Settings& settings, const Region& region, const std::vector<State>& points) {
+    clear();
+
+    _settings = settings;
+    _region = region;
+    _region.w = std::min(std::max(_region.w, 0), STATE_KEY_SPAN);
+    _region.h = std::min(std::max(_region.h, 0), STATE_KEY_SPAN);
+
+    size_t count = points.size();
+    _ends.assign(count * count, PATH_DATABASE_NONE);
+    _costs.assign(count * count, -1);
+
+    // Several points can share a cell, and a wide character stands on several cells at once
+    std::unordered_map<uint64_t, std::vector<int>> targets;
+    for (size_t i = 0; i < count; i++) {
+        _points.push_back(State::create(points[i].x, points[i].y));
+        targets[_cell_key(points[i].x, points[i].y)].push_back((int)i);
+    }
+
+    _index_points();
+
+    if (graph.calculate_jump_limit(settings) + (int)settings.air_stride > STATE_KEY_MAX_JUMP) return;
+
+    std::unordered_map<StateKey, Flood, StateKeyHash> flooded;
+    std::unordered_map<StateKey, uint32_t, StateKeyHash> branches;
+    std::vector<StateKey> ends(count);
+    std::vector<StateKey> chain;
+
+    State neighbors[MAX_NEIGHBORS];
+
+    for (size_t from = 0; from < count; from++) {
+        State initial = _points[from];
+        if (!_contains(_region, initial)) continue;
+
+        graph.contextualize(settings, initial);
+
+        StatePacker packer(_region, initial);
+        Region bounds = packer.clip(_region);
+
+        flooded.clear();
+        tool::priority_queue<StateKey, int> frontier;
+
+        StateKey initial_key = packer.pack(initial);
+        frontier.put(initial_key, 0);
+        flooded[initial_key] = Flood { initial_key, 0, false };
+
+        size_t remaining = count;
+        std::vector<bool> reached(count, false);
+
+        // Stops once every point is reached, the first time a point is reached is the cheapest
+        while (!frontier.empty() && remaining > 0) {
+            StateKey current_key = frontier.get();
+
+            Flood& flood = flooded[current_key];
+            if (flood.closed) continue;
+            flood.closed = true;
+
+            int current_cost = flood.cost;
+            State current = packer.unpack(current_key);
+
+            for (int dx = 0; dx < (int)std::max(settings.width, 1u); dx++) {
+                auto it = targets.find(_cell_key(current.x + dx, current.y));
+                if (it == targets.end()) continue;
+
+                for (int to : it->second) {
+                    if (reached[to]) continue;
+                    reached[to] = true;
+                    remaining--;
+                    ends[to] = current_key;
+                    _costs[from * count + to] = current_cost;
+                }
+            }
+
+            int n = graph.neighbors(settings, current, neighbors);
+
+            for (int i = 0; i < n; i++) {
+                const State& next = neighbors[i];
+                if (!_contains(bounds, next)) continue;
+
+                int new_cost = current_cost + graph.cost(settings, current, next);
+
+                StateKey next_key = packer.pack(next);
+                auto it = flooded.find(next_key);
+                if (it == flooded.end() || (!it->second.closed && new_cost < it->second.cost)) {
+                    flooded[next_key] = Flood { current_key, new_cost, false };
+                    frontier.put(next_key, new_cost);
+                }
+            }
+        }
+
+        // Only the branches leading to a point are kept, each one ends where it joins the tree so far
+        branches.clear();
+        uint32_t root = (uint32_t)_nodes.size();
+        branches[initial_key] = root;
+        _nodes.push_back(Node { (uint16_t)(initial.x - _region.x), (uint16_t)(initial.y - _region.y), (uint8_t)initial.jump, (uint8_t)initial.scenario_meta, 0, root });
+
+        for (size_t to = 0; to < count; to++) {
+            if (!reached[to]) continue;
+
+            chain.clear();
+            StateKey key = ends[to];
+            while (branches.find(key) == branches.end()) {
+                chain.push_back(key);
+                key = flooded[key].came_from;
+            }
+
+            uint32_t parent = branches[key];
+            for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+                State state = packer.unpack(*it);
+                uint32_t index = (uint32_t)_nodes.size();
+                _nodes.push_back(Node { (uint16_t)(state.x - _region.x), (uint16_t)(state.y - _region.y), (uint8_t)state.jump, (uint8_t)state.scenario_meta, 0, parent });
+                branches[*it] = index;
+                parent = index;
+            }
+
+            _ends[from * count + to] = branches[ends[to]];
+        }
+    }
+}
+
+void PathDatabase::_index_points() {
+    _point_indices.clear();
+    for (size_t i = 0; i < _points.size(); i++) _point_indices.emplace(_cell_key(_points[i].x, _points[i].y), (int)i);
+}
+
+int PathDatabase::point_index(int x, int y) const {
+    auto it = _point_indices.find(_cell_key(x, y));
+    return it == _point_indices.end() ? -1 : it->second;
+}
+
+int PathDatabase::path_cost(int from, int to) const {
+    size_t count = _points.size();
+    if (from < 0 || to < 0 || (size_t)from >= count || (size_t)to >= count) return -1;
+    return _costs[from * count + to];
+}
+
+bool PathDatabase::find(const Graph& graph, int from, int to, std::vector<State>& path, PathOutput output) const {
+    path.clear();
+
+    size_t count = _points.size();
+    if (from < 0 || to < 0 || (size_t)from >= count || (size_t)to >= count) return false;
+
+    uint32_t index = _ends[from * count + to];
+    if (index == PATH_DATABASE_NONE) return false;
+
+    while (true) {
+        const Node& node = _nodes[index];
+        path.push_back(_unpack(node));
+        if (node.parent == index) break;
+        index = node.parent;
+    }
+
+    std::reverse(path.begin(), path.end());
+
+    if (output != PathOutput_Full) filter(graph, path);
+    if (output == PathOutput_Shortened) shorten(graph, _settings, path);
+
+    return true;
+}
+
+template <typename T>
+static inline bool _write(FILE* file, const T* values, size_t count) {
+    return count == 0 || fwrite(values, sizeof(T), count, file) == count;
+}
+
+template <typename T>
+static inline bool _read(FILE* file, T* values, size_t count) {
+    return count == 0 || fread(values, sizeof(T), count, file) == count;
+}
+
+bool PathDatabase::save(const std::string& path) const {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+
+    uint32_t header[2] = { PATH_DATABASE_VERSION, PATH_DATABASE_BYTE_ORDER };
+    int32_t settings[11] = {
+        _settings.max_jump_height,
+        (int32_t)_settings.air_stride,
+        (int32_t)_settings.width,
+        (int32_t)_settings.height,
+        _settings.ledge_hang ? 1 : 0,
+        _settings.costs.up,
+        _settings.costs.down,
+        _settings.costs.level,
+        _settings.costs.ledge_climb,
+        _settings.costs.character,
+        _settings.costs.hazard
+    };
+    int32_t region[4] = { _region.x, _region.y, _region.w, _region.h };
+    uint32_t counts[2] = { (uint32_t)_points.size(), (uint32_t)_nodes.size() };
+
+    std::vector<int32_t> points;
+    for (const State& point : _points) {
+        points.push_back(point.x);
+        points.push_back(point.y);
+    }
+
+    bool ok = _write(file, PATH_DATABASE_MAGIC, 4) && _write(file, header, 2) &&
+        _write(file, settings, 11) && _write(file, region, 4) && _write(file, counts, 2) &&
+        _write(file, points.data(), points.size()) &&
+        _write(file, _ends.data(), _ends.size()) &&
+        _write(file, _costs.data(), _costs.size()) &&
+        _write(file, _nodes.data(), _nodes.size());
+
+    return fclose(file) == 0 && ok;
+}
+
+bool PathDatabase::load(const std::string& path) {
+    clear();
+
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) return false;
+
+    char magic[4];
+    uint32_t header[2];
+    int32_t settings[11];
+    int32_t region[4];
+    uint32_t counts[2];
+
+    bool ok = _read(file, magic, 4) && memcmp(magic, PATH_DATABASE_MAGIC, 4) == 0 &&
+        _read(file, header, 2) && header[0] == PATH_DATABASE_VERSION && header[1] == PATH_DATABASE_BYTE_ORDER &&
+        _read(file, settings, 11) && _read(file, region, 4) && _read(file, counts, 2) &&
+        counts[0] <= STATE_KEY_SPAN;
+
+    // The rest of the file has to hold exactly what the counts say before anything is allocated for it
+    if (ok) {
+        uint64_t count = counts[0];
+        uint64_t payload = count * 2 * sizeof(int32_t) + count * count * (sizeof(uint32_t) + sizeof(int32_t)) + (uint64_t)counts[1] * sizeof(Node);
+
+        long start = ftell(file);
+        ok = start >= 0 && fseek(file, 0, SEEK_END) == 0;
+
+        long end = ok ? ftell(file) : -1;
+        ok = ok && end >= start && (uint64_t)(end - start) == payload && fseek(file, start, SEEK_SET) == 0;
+    }
+
+    std::vector<int32_t> points;
+    if (ok) {
+        size_t count = counts[0];
+        points.resize(count * 2);
+        _ends.resize(count * count);
+        _costs.resize(count * count);
+        _nodes.resize(counts[1]);
+
+        ok = _read(file, points.data(), points.size()) &&
+            _read(file, _ends.data(), _ends.size()) &&
+            _read(file, _costs.data(), _costs.size()) &&
+            _read(file, _nodes.data(), _nodes.size());
+    }
+
+    fclose(file);
+
+    // Every index has to stay inside the nodes, a lookup follows them without checking
+    for (size_t i = 0; ok && i < _ends.size(); i++) ok = _ends[i] == PATH_DATABASE_NONE || _ends[i] < _nodes.size();
+    for (size_t i = 0; ok && i < _nodes.size(); i++) ok = _nodes[i].parent <= i;
+
+    if (!ok) {
+        clear();
+        return false;
+    }
+
+    _settings.max_jump_height = settings[0];
+    _settings.air_stride = settings[1];
+    _settings.width = settings[2];
+    _settings.height = settings[3];
+    _settings.ledge_hang = settings[4] != 0;
+    _settings.costs.up = settings[5];
+    _settings.costs.down = settings[6];
+    _settings.costs.level = settings[7];
+    _settings.costs.ledge_climb = settings[8];
+    _settings.costs.character = settings[9];
+    _settings.costs.hazard = settings[10];
+
+    _region = Region { region[0], region[1], region[2], region[3] };
+
+    for (size_t i = 0; i + 1 < points.size(); i += 2) _points.push_back(State::create(points[i], points[i + 1]));
+    _index_points();
+
+    return true;
+}
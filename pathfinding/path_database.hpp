@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "graph.hpp"
+#include "region.hpp"
+#include "search.hpp"
+#include "settings.hpp"
+#include "state.hpp"
+#include "state_key.hpp"
+
+#define PATH_DATABASE_MAGIC "PFPD"
+#define PATH_DATABASE_VERSION 1
+#define PATH_DATABASE_NONE 0xFFFFFFFF
+
+namespace pathfinding {
+
+/*
+ * Cheapest paths between every ordered pair of a set of points, for characters that
+ * keep travelling between the same places. Each point keeps the tree of cheapest moves
+ * out of it, cut down to the branches that end at the other points, so paths leaving
+ * the same point share their common start. A lookup walks one branch back to its root.
+ *
+ * Paths are the ones search would find inside the region on the graph the database was
+ * built from, dynamic masses and other characters aren't part of it.
+ */
+class PathDatabase {
+public:
+    PathDatabase();
+
+    // One Dijkstra per point, points are the cells a character stands in like the initial cell of a search
+    void build(const Graph& graph, const Settings& settings, const Region& region, const std::vector<State>& points);
+    void clear();
+
+    inline const Settings& settings() const { return _settings; }
+    inline const Region& region() const { return _region; }
+    inline const std::vector<State>& points() const { return _points; }
+    inline size_t node_count() const { return _nodes.size(); }
+
+    // Index of the point in the cell, or -1
+    int point_index(int x, int y) const;
+
+    // -1 when there is no path
+    int path_cost(int from, int to) const;
+
+    // False when there is no path. The graph is only read to pick keypoints
+    bool find(const Graph& graph, int from, int to, std::vector<State>& path, PathOutput output = PathOutput_Full) const;
+
+    /*
+     * Layout, all in native byte order:
+     *   magic, version, byte order
+     *   settings, region, point count, node count
+     *   points, path ends and costs per pair of points, nodes
+     */
+    bool save(const std::string& path) const;
+    bool load(const std::string& path);
+
+private:
+    // Coordinates are relative to the region, which a search can't have wider than 16 bits anyway
+    struct Node {
+        uint16_t x;
+        uint16_t y;
+        uint8_t jump;
+        uint8_t scenario_meta;
+        uint16_t reserved;
+        uint32_t parent;
+    };
+
+    inline State _unpack(const Node& node) const {
+        State state;
+        state.x = _region.x + node.x;
+        state.y = _region.y + node.y;
+        state.jump = node.jump;
+        state.scenario_meta = node.scenario_meta;
+        return state;
+    }
+
+    void _index_points();
+
+    Settings _settings;
+    Region _region;
+    std::vector<State> _points;
+
+    // First point in each cell, keyed by its absolute position
+    std::unordered_map<StateKey, int, StateKeyHash> _point_indices;
+
+    // Last node of the path for each pair, from * point count + to, PATH_DATABASE_NONE when unreachable
+    std::vector<uint32_t> _ends;
+    std::vector<int32_t> _costs;
+
+    // Roots point at themselves
+    std::vector<Node> _nodes;
+};
+
+}
@@ -0,0 +1,91 @@
+#include "rasterize.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <unordered_map>
+
+using namespace pathfinding;
+
+static void _fill(Page& page, const Region& mass, int32_t page_x, int32_t page_y) {
+    int32_t origin_x = page_x * PAGE_SIZE;
+    int32_t origin_y = page_y * PAGE_SIZE;
+
+    int32_t left = std::max(mass.x, origin_x);
+    int32_t top = std::max(mass.y, origin_y);
+    int32_t right = std::min(mass.x + mass.w, origin_x + PAGE_SIZE);
+    int32_t bottom = std::min(mass.y + mass.h, origin_y + PAGE_SIZE);
+    if (left >= right) return;
+
+    // Rows are contiguous within a page
+    for (int32_t y = top; y < bottom; y++) {
+        memset(page.tiles + page_index(left, y), FLOOR_TILEKIND, right - left);
+    }
+}
+
+std::shared_ptr<Page> pathfinding::rasterize_page(const std::vector<Region>& masses, int32_t page_x, int32_t page_y) {
+    std::shared_ptr<Page> page;
+
+    int32_t origin_x = page_x * PAGE_SIZE;
+    int32_t origin_y = page_y * PAGE_SIZE;
+
+    for (const Region& mass : masses) {
+        if (mass.w <= 0 || mass.h <= 0) continue;
+        if (mass.x >= origin_x + PAGE_SIZE || mass.x + mass.w <= origin_x) continue;
+        if (mass.y >= origin_y + PAGE_SIZE || mass.y + mass.h <= origin_y) continue;
+
+        if (!page) page = Graph::create_page();
+        _fill(*page, mass, page_x, page_y);
+    }
+
+    return page;
+}
+
+bool pathfinding::rasterize(const std::vector<Region>& masses, Graph& out, int threads, const std::atomic<bool>* cancelled) {
+    std::unordered_map<int64_t, std::vector<size_t>, PageKeyHash> buckets;
+
+    for (size_t i = 0; i < masses.size(); i++) {
+        const Region& mass = masses[i];
+        if (mass.w <= 0 || mass.h <= 0) continue;
+
+        for (int32_t page_y = page_of(mass.y); page_y <= page_of(mass.y + mass.h - 1); page_y++) {
+            for (int32_t page_x = page_of(mass.x); page_x <= page_of(mass.x + mass.w - 1); page_x++) {
+                buckets[page_key(page_x, page_y)].push_back(i);
+            }
+        }
+    }
+
+    std::vector<std::pair<int64_t, const std::vector<size_t>*>> work;
+    work.reserve(buckets.size());
+    for (auto& it : buckets) work.push_back(std::make_pair(it.first, &it.second));
+
+    std::vector<std::shared_ptr<Page>> pages(work.size());
+    std::atomic<size_t> next(0);
+
+    auto worker = [&]() {
+        for (size_t i = next++; i < work.size(); i = next++) {
+            if (cancelled && *cancelled) return;
+
+            int32_t page_x = page_key_x(work[i].first);
+            int32_t page_y = page_key_y(work[i].first);
+
+            pages[i] = Graph::create_page();
+            for (size_t mass : *work[i].second) _fill(*pages[i], masses[mass], page_x, page_y);
+        }
+    };
+
+    int helpers = std::min(std::max(threads, 1), (int)work.size()) - 1;
+    std::vector<std::thread> pool;
+    for (int i = 0; i < helpers; i++) pool.emplace_back(worker);
+    worker();
+    for (std::thread& thread : pool) thread.join();
+
+    if (cancelled && *cancelled) return false;
+
+    out.clear();
+    for (size_t i = 0; i < work.size(); i++) {
+        out.set_page(page_key_x(work[i].first), page_key_y(work[i].first), pages[i]);
+    }
+
+    return true;
+}
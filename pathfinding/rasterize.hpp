@@ -0,0 +1,21 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+#include "graph.hpp"
+
+namespace pathfinding {
+
+// Fills the tiles of one page covered by any of the masses, null when none of them are
+std::shared_ptr<Page> rasterize_page(const std::vector<Region>& masses, int32_t page_x, int32_t page_y);
+
+/*
+ * Replaces the graph with the masses as floor tiles. Masses are bucketed by the pages
+ * they overlap and each page is filled by exactly one of up to `threads` threads, so
+ * no locking is needed until the finished pages are handed to the graph.
+ * Returns false and leaves the graph untouched when cancelled.
+ */
+bool rasterize(const std::vector<Region>& masses, Graph& out, int threads, const std::atomic<bool>* cancelled = nullptr);
+
+}
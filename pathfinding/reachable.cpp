@@ -0,0 +1,80 @@
+#include "tools/queue.hpp"
+#include "reachable.hpp"
+#include "state_key.hpp"
+
+#include <unordered_set>
+
+using namespace pathfinding;
+
+struct Flood {
+    int cost;
+    bool closed;
+};
+
+void pathfinding::reachable_set(
+    const Graph& graph,
+    const Settings& settings,
+    const Region& region,
+    State initial,
+    const int max_cost,
+    std::vector<Reach>& cells) {
+
+    graph.contextualize(settings, initial);
+
+    cells.clear();
+
+    if (max_cost < 0) return;
+    if (graph.calculate_jump_limit(settings) + (int)settings.air_stride > STATE_KEY_MAX_JUMP) return;
+
+    StatePacker packer(region, initial);
+    Region bounds = packer.clip(region);
+
+    std::unordered_map<StateKey, Flood, StateKeyHash> flooded;
+
+    // The lower 32 bits of a key are the cell
+    std::unordered_set<StateKey, StateKeyHash> reported;
+
+    tool::priority_queue<StateKey, int> frontier;
+
+    StateKey initial_key = packer.pack(initial);
+    frontier.put(initial_key, 0);
+    flooded[initial_key] = Flood { 0, false };
+
+    State neighbors[MAX_NEIGHBORS];
+
+    while (!frontier.empty()) {
+        StateKey current_key = frontier.get();
+
+        Flood& flood = flooded[current_key];
+        if (flood.closed) continue;
+        flood.closed = true;
+
+        int current_cost = flood.cost;
+        State current = packer.unpack(current_key);
+
+        if (reported.insert(current_key & 0xFFFFFFFF).second) {
+            cells.push_back(Reach { current.x, current.y, current_cost, current.scenario_meta });
+        }
+
+        int n = graph.neighbors(settings, current, neighbors);
+
+        for (int i = 0; i < n; i++) {
+            const State& next = neighbors[i];
+
+            if (next.x < bounds.x) continue;
+            if (next.y < bounds.y) continue;
+            if (next.x >= bounds.x + bounds.w) continue;
+            if (next.y >= bounds.y + bounds.h) continue;
+
+            int new_cost = current_cost + graph.cost(settings, current, next);
+            if (new_cost > max_cost) continue;
+
+            StateKey next_key = packer.pack(next);
+            auto it = flooded.find(next_key);
+            if (it == flooded.end() || (!it->second.closed && new_cost < it->second.cost)) {
+                flooded[next_key] = Flood { new_cost, false };
+                frontier.put(next_key, new_cost);
+            }
+        }
+    }
+}
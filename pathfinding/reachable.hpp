@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vector>
+
+#include "graph.hpp"
+#include "settings.hpp"
+#include "state.hpp"
+
+namespace pathfinding {
+
+struct Reach {
+    int x;
+    int y;
+    int cost;
+    int scenario_meta;
+};
+
+/*
+ * Floods out from initial with a Dijkstra bounded by max_cost and the region.
+ * Every cell is reported once with the cheapest cost to stand in it, in order of cost.
+ */
+void reachable_set(
+    const Graph& graph,
+    const Settings& settings,
+    const Region& region,
+    State initial,
+    const int max_cost,
+    std::vector<Reach>& cells);
+
+}
@@ -0,0 +1,201 @@
+#include "tools/queue.hpp"
+#include "realtime.hpp"
+#include "state_key.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+
+// Learned for states the lookahead can't get out of, large but still safe to add costs to
+#define DEAD_END (INT_MAX / 4)
+
+using namespace pathfinding;
+
+struct Lookahead {
+    StateKey came_from;
+    int cost;
+    bool closed;
+};
+
+struct Edge {
+    StateKey from;
+    int cost;
+};
+
+/*
+ * Dijkstra from the frontier back through the closed states, each closed state learns
+ * the cheapest cost through it to some frontier state plus that state's heuristic.
+ */
+static void _learn(
+    const StatePacker& packer,
+    const Settings& settings,
+    const StepCosts& steps,
+    const std::unordered_map<StateKey, Lookahead, StateKeyHash>& states,
+    const std::unordered_map<StateKey, std::vector<Edge>, StateKeyHash>& incoming,
+    LearnedHeuristic& heuristic) {
+
+    std::unordered_map<StateKey, int, StateKeyHash> values;
+    tool::priority_queue<StateKey, int> queue;
+
+    for (auto& it : states) {
+        if (it.second.closed) {
+            values[it.first] = DEAD_END;
+            continue;
+        }
+
+        int value = heuristic.get(settings, steps, packer.unpack(it.first));
+        values[it.first] = value;
+        queue.put(it.first, value);
+    }
+
+    while (!queue.empty()) {
+        StateKey key = queue.get();
+        int value = values[key];
+
+        auto edges = incoming.find(key);
+        if (edges == incoming.end()) continue;
+
+        for (const Edge& edge : edges->second) {
+            int& learned = values[edge.from];
+            if (learned <= edge.cost + value) continue;
+
+            learned = edge.cost + value;
+            queue.put(edge.from, learned);
+        }
+    }
+
+    for (auto& it : states) {
+        if (it.second.closed) heuristic.raise(packer.unpack(it.first), values[it.first]);
+    }
+}
+
+bool pathfinding::realtime_search(
+    const Graph& graph,
+    const Settings& settings,
+    const Region& region,
+    State current,
+    int lookahead,
+    LearnedHeuristic& heuristic,
+    std::vector<State>& moves,
+    int& goal_index,
+    SearchStats* stats) {
+
+    auto started = std::chrono::steady_clock::now();
+
+    graph.contextualize(settings, current);
+
+    moves.clear();
+    goal_index = -1;
+
+    if (heuristic.goals().empty()) return false;
+    if (graph.calculate_jump_limit(settings) + (int)settings.air_stride > STATE_KEY_MAX_JUMP) return false;
+
+    StatePacker packer(region, current);
+    Region bounds = packer.clip(region);
+
+    StepCosts steps = min_step_costs(settings);
+
+    std::unordered_map<StateKey, Lookahead, StateKeyHash> states;
+    std::unordered_map<StateKey, std::vector<Edge>, StateKeyHash> incoming;
+    tool::priority_queue<StateKey, int> frontier;
+
+    StateKey current_key = packer.pack(current);
+    frontier.put(current_key, 0);
+    states[current_key] = Lookahead { current_key, 0, false };
+
+    State neighbors[MAX_NEIGHBORS];
+    StateKey target_key = current_key;
+    int expanded = 0;
+
+    lookahead = std::max(lookahead, 1);
+
+    while (!frontier.empty() && expanded < lookahead) {
+        StateKey key = frontier.get();
+
+        Lookahead& visit = states[key];
+        if (visit.closed) continue;
+
+        State state = packer.unpack(key);
+
+        // Popped like in search, so no goal reachable within the lookahead is cheaper
+        goal_index = reached_goal(settings, state, heuristic.goals());
+        if (goal_index >= 0) {
+            target_key = key;
+            break;
+        }
+
+        visit.closed = true;
+        expanded++;
+
+        int cost = visit.cost;
+        int n = graph.neighbors(settings, state, neighbors);
+
+        if (stats) {
+            stats->expanded++;
+            stats->generated += n;
+            stats->fit_checks += settings.ledge_hang ? 6 : 4;
+            stats->tile_reads += (settings.ledge_hang ? 6 : 4) * fit_tiles(settings);
+        }
+
+        for (int i = 0; i < n; i++) {
+            const State& next = neighbors[i];
+
+            if (next.x < bounds.x) continue;
+            if (next.y < bounds.y) continue;
+            if (next.x >= bounds.x + bounds.w) continue;
+            if (next.y >= bounds.y + bounds.h) continue;
+
+            int step = graph.cost(settings, state, next);
+            StateKey next_key = packer.pack(next);
+
+            // Every edge out of a closed state counts for learning, not just the improving ones
+            incoming[next_key].push_back(Edge { key, step });
+
+            auto it = states.find(next_key);
+            if (it != states.end() && (it->second.closed || cost + step >= it->second.cost)) continue;
+
+            states[next_key] = Lookahead { key, cost + step, false };
+            frontier.put(next_key, cost + step + heuristic.get(settings, steps, next));
+        }
+    }
+
+    bool moving = true;
+
+    if (goal_index < 0) {
+        // Move toward the frontier state that looks cheapest to finish from
+        int best = INT_MAX;
+        int best_estimate = INT_MAX;
+
+        for (auto& it : states) {
+            if (it.second.closed) continue;
+
+            int estimate = heuristic.get(settings, steps, packer.unpack(it.first));
+            int total = it.second.cost + estimate;
+            if (total < best || (total == best && estimate < best_estimate)) {
+                best = total;
+                best_estimate = estimate;
+                target_key = it.first;
+            }
+        }
+
+        // Everything in reach was closed without finding a goal
+        moving = best != INT_MAX;
+
+        _learn(packer, settings, steps, states, incoming, heuristic);
+    }
+
+    if (moving) {
+        for (StateKey key = target_key; key != current_key; key = states[key].came_from) {
+            moves.push_back(packer.unpack(key));
+        }
+
+        moves.push_back(current);
+        std::reverse(moves.begin(), moves.end());
+    }
+
+    if (stats) {
+        stats->search_usec += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count();
+    }
+
+    return moving;
+}
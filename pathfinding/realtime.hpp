@@ -0,0 +1,64 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "graph.hpp"
+#include "search.hpp"
+#include "settings.hpp"
+#include "state.hpp"
+
+namespace pathfinding {
+
+/*
+ * Heuristic values learned for one goal by realtime_search, kept between ticks. States
+ * that were never learned fall back to goal_estimate. Values only ever grow, so an agent
+ * circling a dead end raises it until leaving looks cheaper.
+ */
+class LearnedHeuristic {
+public:
+    LearnedHeuristic() {}
+    LearnedHeuristic(const std::vector<Region>& goals) : _goals(goals) {}
+
+    inline const std::vector<Region>& goals() const { return _goals; }
+
+    inline int get(const Settings& settings, const StepCosts& steps, const State& state) const {
+        auto it = _values.find(state);
+        if (it != _values.end()) return it->second;
+        return goal_estimate(settings, steps, state, _goals);
+    }
+
+    inline void raise(const State& state, int value) {
+        auto it = _values.find(state);
+        if (it == _values.end()) _values[state] = value;
+        else if (value > it->second) it->second = value;
+    }
+
+    inline void clear() { _values.clear(); }
+    inline size_t size() const { return _values.size(); }
+
+private:
+    std::vector<Region> _goals;
+    std::unordered_map<State, int> _values;
+};
+
+/*
+ * One tick of LSS-LRTA*. Runs an A* of at most lookahead expansions from current, learns
+ * new heuristic values for every state it closed, and returns the moves from current to
+ * the most promising state on its frontier, or to the goal once it is in reach.
+ *
+ * The work per tick is bounded by lookahead no matter how large the map is. Returns
+ * false when nothing is left to move to, goal_index is set once moves end at the goal.
+ */
+bool realtime_search(
+    const Graph& graph,
+    const Settings& settings,
+    const Region& region,
+    State current,
+    int lookahead,
+    LearnedHeuristic& heuristic,
+    std::vector<State>& moves,
+    int& goal_index,
+    SearchStats* stats = nullptr);
+
+}
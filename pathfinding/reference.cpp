@@ -0,0 +1,290 @@
+#include "reference.hpp"
+#include "search.hpp"
+#include "state_key.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <queue>
+#include <unordered_map>
+
+using namespace pathfinding;
+
+static bool _is_traversable(const Graph& graph, int x, int y) {
+    TileKind kind = graph.get_at(x, y);
+    return kind == AIR_TILEKIND || kind == CHARACTER_TILEKIND;
+}
+
+static bool _is_on_floor(const Graph& graph, const Settings& settings, const State& state) {
+    for (int i = 0; i < (int)settings.width; i++) {
+        if (graph.get_at(state.x + i, state.y + 1) == FLOOR_TILEKIND) return true;
+    }
+
+    return false;
+}
+
+static bool _can_fit(const Graph& graph, const Settings& settings, const State& state) {
+    for (int i = 0; i < (int)settings.width; i++) {
+        for (int j = 0; j < (int)settings.height; j++) {
+            TileKind kind = graph.get_at(state.x + i, state.y - j);
+            if (kind == FLOOR_TILEKIND || kind == UNTRAVERSABLE_TILEKIND) return false;
+        }
+    }
+
+    return true;
+}
+
+static bool _is_on_left_ledge(const Graph& graph, const Settings& settings, const State& state) {
+    int x = state.x;
+    int y = state.y - ((int)settings.height - 1);
+
+    return graph.get_at(x - 1, y) == FLOOR_TILEKIND && _is_traversable(graph, x - 1, y - 1) && _is_traversable(graph, x, y - 1);
+}
+
+static bool _is_on_right_ledge(const Graph& graph, const Settings& settings, const State& state) {
+    int x = state.x + (int)settings.width - 1;
+    int y = state.y - ((int)settings.height - 1);
+
+    return graph.get_at(x + 1, y) == FLOOR_TILEKIND && _is_traversable(graph, x + 1, y - 1) && _is_traversable(graph, x, y - 1);
+}
+
+static int _jump_limit(const Settings& settings) {
+    int air_stride = settings.air_stride;
+
+    int detours = settings.max_jump_height > air_stride ?
+        1 + (settings.max_jump_height - air_stride) / (air_stride - 1) : 0;
+
+    return settings.max_jump_height + detours + 1;
+}
+
+static int _fold_jump(const Settings& settings, int jump_limit, int jump) {
+    if (jump <= jump_limit) return jump;
+    return jump_limit + (jump - jump_limit) % settings.air_stride;
+}
+
+// Fills in the jump counter of next, false when the move isn't allowed
+static bool _next_state(const Settings& settings, const State& state, State& next) {
+    bool diagonal = state.x != next.x && state.y != next.y;
+
+    if (settings.ledge_hang && diagonal) {
+        if (next.x < state.x && !state.is_ledge_hang_left()) return false;
+        if (next.x > state.x && !state.is_ledge_hang_right()) return false;
+        if (!next.is_floor_scenario()) return false;
+
+        next.jump = 0;
+        return true;
+    }
+
+    int air_stride = settings.air_stride;
+    int jump_limit = 0;
+    bool can_move_up = false;
+
+    if (settings.max_jump_height) {
+        jump_limit = _jump_limit(settings);
+        can_move_up = jump_limit - state.jump > 0;
+    }
+
+    if (state.is_floor_scenario()) {
+        if (next.is_floor_scenario()) {
+            next.jump = 0;
+            return true;
+        }
+
+        if (!next.is_air_scenario()) return false;
+        if (next.y < state.y && !can_move_up) return false;
+
+        // Walking off an edge starts a fall that can't drift sideways right away
+        if (next.x != state.x) next.jump = _fold_jump(settings, jump_limit, jump_limit % air_stride == 0 ? jump_limit + 1 : jump_limit);
+        else if (next.y < state.y) next.jump = _fold_jump(settings, jump_limit, 2);
+        else next.jump = jump_limit;
+
+        return true;
+    }
+
+    if (!state.is_air_scenario()) return false;
+    if (next.y < state.y && !can_move_up) return false;
+
+    bool can_move_sideways = (state.jump % air_stride) == 0;
+    if (next.x != state.x && !can_move_sideways) return false;
+
+    if (next.is_floor_scenario()) {
+        next.jump = 0;
+        return true;
+    }
+
+    if (!next.is_air_scenario()) return false;
+
+    if (can_move_sideways && next.x != state.x) next.jump = _fold_jump(settings, jump_limit, state.jump + 1);
+    else if (next.y > state.y && can_move_up) next.jump = jump_limit;
+    else if (can_move_sideways) next.jump = _fold_jump(settings, jump_limit, state.jump + 2);
+    else next.jump = _fold_jump(settings, jump_limit, state.jump + 1);
+
+    return true;
+}
+
+void reference::contextualize(const Graph& graph, const Settings& settings, State& state) {
+    if (_is_on_floor(graph, settings, state)) {
+        state.scenario_meta = Scenario_OnFloor;
+        return;
+    }
+
+    state.scenario_meta = Scenario_InAir;
+    if (!settings.ledge_hang) return;
+
+    if (_is_on_left_ledge(graph, settings, state)) state.scenario_meta |= Scenario_OnLedgeLeft;
+    if (_is_on_right_ledge(graph, settings, state)) state.scenario_meta |= Scenario_OnLedgeRight;
+}
+
+int reference::neighbors(const Graph& graph, const Settings& settings, const State& state, State neighbors[MAX_NEIGHBORS]) {
+    if (graph.get_at(state.x, state.y) == UNTRAVERSABLE_TILEKIND) return 0;
+
+    State candidates[6];
+    int candidate_count = 0;
+
+    state.translate(1, 0, candidates[candidate_count++]);
+    state.translate(-1, 0, candidates[candidate_count++]);
+    state.translate(0, -1, candidates[candidate_count++]);
+    state.translate(0, 1, candidates[candidate_count++]);
+
+    if (settings.ledge_hang) {
+        state.translate(-(int)settings.width, -(int)settings.height, candidates[candidate_count++]);
+        state.translate((int)settings.width, -(int)settings.height, candidates[candidate_count++]);
+    }
+
+    int count = 0;
+    for (int i = 0; i < candidate_count; i++) {
+        State next = candidates[i];
+        if (!_can_fit(graph, settings, next)) continue;
+
+        contextualize(graph, settings, next);
+        if (!_next_state(settings, state, next)) continue;
+
+        neighbors[count++] = next;
+    }
+
+    return count;
+}
+
+int reference::cost(const Graph& graph, const Settings& settings, const State& state, const State& next) {
+    const CostProfile& costs = settings.costs;
+    int base;
+
+    if (next.x != state.x && next.y != state.y) base = settings.max_jump_height * costs.ledge_climb;
+    else if (next.y < state.y) base = costs.up;
+    else if (next.y > state.y) base = costs.down;
+    else base = costs.level;
+
+    if (graph.get_at(next.x, next.y) == CHARACTER_TILEKIND) base += costs.character;
+
+    return base + graph.get_cost_at(next.x, next.y) * costs.hazard;
+}
+
+bool reference::search(
+    const Graph& graph,
+    const Settings& settings,
+    const Region& region,
+    State initial,
+    const std::vector<Region>& goals,
+    std::vector<State>& path,
+    int& goal_index,
+    int& path_cost) {
+
+    contextualize(graph, settings, initial);
+
+    path.clear();
+    goal_index = -1;
+    path_cost = -1;
+
+    if (goals.empty()) return false;
+
+    // The engine packs jump counters into 8 bits and gives up on anything that needs more
+    if (_jump_limit(settings) + (int)settings.air_stride > STATE_KEY_MAX_JUMP) return false;
+
+    struct Visit {
+        State came_from;
+        int cost;
+        bool closed;
+    };
+
+    std::unordered_map<State, Visit> visited;
+
+    // Ties go to the state queued first, the order doesn't change costs
+    typedef std::pair<std::pair<int, uint64_t>, State> Entry;
+    auto later = [](const Entry& a, const Entry& b) { return a.first > b.first; };
+    std::priority_queue<Entry, std::vector<Entry>, decltype(later)> frontier(later);
+    uint64_t order = 0;
+
+    visited[initial] = Visit { initial, 0, false };
+    frontier.push(Entry(std::make_pair(0, order++), initial));
+
+    State neighbors[MAX_NEIGHBORS];
+
+    while (!frontier.empty()) {
+        State current = frontier.top().second;
+        frontier.pop();
+
+        Visit& visit = visited[current];
+        if (visit.closed) continue;
+        visit.closed = true;
+
+        goal_index = reached_goal(settings, current, goals);
+        if (goal_index >= 0) {
+            path_cost = visit.cost;
+
+            while (current != initial) {
+                path.push_back(current);
+                current = visited[current].came_from;
+            }
+
+            path.push_back(initial);
+            std::reverse(path.begin(), path.end());
+            return true;
+        }
+
+        int current_cost = visit.cost;
+        int n = reference::neighbors(graph, settings, current, neighbors);
+
+        for (int i = 0; i < n; i++) {
+            const State& next = neighbors[i];
+
+            if (next.x < region.x || next.y < region.y) continue;
+            if (next.x >= region.x + region.w || next.y >= region.y + region.h) continue;
+
+            int new_cost = current_cost + cost(graph, settings, current, next);
+
+            auto it = visited.find(next);
+            if (it != visited.end() && new_cost >= it->second.cost) continue;
+
+            visited[next] = Visit { current, new_cost, false };
+            frontier.push(Entry(std::make_pair(new_cost, order++), next));
+        }
+    }
+
+    return false;
+}
+
+int reference::path_cost(const Graph& graph, const Settings& settings, const std::vector<State>& path) {
+    if (path.empty()) return -1;
+
+    State current = path[0];
+    contextualize(graph, settings, current);
+
+    State neighbors[MAX_NEIGHBORS];
+    int total = 0;
+
+    for (size_t i = 1; i < path.size(); i++) {
+        int n = reference::neighbors(graph, settings, current, neighbors);
+
+        int found = -1;
+        for (int j = 0; j < n; j++) {
+            if (neighbors[j] == path[i]) found = j;
+        }
+
+        if (found < 0) return -1;
+
+        total += cost(graph, settings, current, neighbors[found]);
+        current = neighbors[found];
+    }
+
+    return total;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+
+#include "graph.hpp"
+#include "region.hpp"
+#include "settings.hpp"
+#include "state.hpp"
+
+namespace pathfinding {
+
+/*
+ * A frozen copy of the movement rules and a plain uniform cost search, kept as they were
+ * before the engine was optimized. Only Graph::get_at and Graph::get_cost_at are shared
+ * with the engine, so rewrites of neighbors, costs or search can be checked against it.
+ * Never optimize anything in here, its only job is to stay obviously right.
+ */
+namespace reference {
+
+void contextualize(const Graph& graph, const Settings& settings, State& state);
+
+int neighbors(const Graph& graph, const Settings& settings, const State& state, State neighbors[MAX_NEIGHBORS]);
+
+int cost(const Graph& graph, const Settings& settings, const State& state, const State& next);
+
+// Cheapest full path to any goal and its cost, states outside region are never entered
+bool search(
+    const Graph& graph,
+    const Settings& settings,
+    const Region& region,
+    State initial,
+    const std::vector<Region>& goals,
+    std::vector<State>& path,
+    int& goal_index,
+    int& path_cost);
+
+// Cost of a full path under the reference rules, -1 when a move isn't one they allow
+int path_cost(const Graph& graph, const Settings& settings, const std::vector<State>& path);
+
+}
+
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <climits>
+#include <cstdint>
+
+namespace pathfinding {
+
+struct Region {
+    int x;
+    int y;
+    int w;
+    int h;
+};
+
+// Edges and sizes are worked out in 64 bits, far apart regions saturate instead of wrapping
+inline int region_clamp(int64_t value) {
+    return value > INT_MAX ? INT_MAX : (value < INT_MIN ? INT_MIN : (int)value);
+}
+
+// Smallest region covering both
+inline Region region_union(const Region& a, const Region& b) {
+    Region out;
+    out.x = a.x < b.x ? a.x : b.x;
+    out.y = a.y < b.y ? a.y : b.y;
+
+    int64_t right = (int64_t)a.x + a.w > (int64_t)b.x + b.w ? (int64_t)a.x + a.w : (int64_t)b.x + b.w;
+    int64_t bottom = (int64_t)a.y + a.h > (int64_t)b.y + b.h ? (int64_t)a.y + a.h : (int64_t)b.y + b.h;
+    out.w = region_clamp(right - out.x);
+    out.h = region_clamp(bottom - out.y);
+    return out;
+}
+
+// Overlap of both, empty regions have no width or height
+inline Region region_intersection(const Region& a, const Region& b) {
+    Region out;
+    out.x = a.x > b.x ? a.x : b.x;
+    out.y = a.y > b.y ? a.y : b.y;
+
+    int64_t right = (int64_t)a.x + a.w < (int64_t)b.x + b.w ? (int64_t)a.x + a.w : (int64_t)b.x + b.w;
+    int64_t bottom = (int64_t)a.y + a.h < (int64_t)b.y + b.h ? (int64_t)a.y + a.h : (int64_t)b.y + b.h;
+    out.w = right > out.x ? region_clamp(right - out.x) : 0;
+    out.h = bottom > out.y ? region_clamp(bottom - out.y) : 0;
+    return out;
+}
+
+}
@@ -0,0 +1,224 @@
+#include "tools/queue.hpp"
+#include "repair.hpp"
+#include "state_key.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <unordered_map>
+
+using namespace pathfinding;
+
+struct Visit {
+    StateKey came_from;
+    int cost;
+    bool closed;
+};
+
+static bool _overlaps_character(const Graph& graph, const Settings& settings, const State& state) {
+    for (int i = 0; i < (int)settings.width; i++) {
+        for (int j = 0; j < (int)settings.height; j++) {
+            if (graph.get_at(state.x + i, state.y - j) == CHARACTER_TILEKIND) return true;
+        }
+    }
+
+    return false;
+}
+
+// The move from the previous state still lands on exactly this state
+static bool _holds(const Graph& graph, const Settings& settings, const State& previous, const State& state, bool characters_block) {
+    State next = State::create(state.x, state.y);
+    if (!graph.transition(settings, previous, next)) return false;
+    if (next.jump != state.jump || next.scenario_meta != state.scenario_meta) return false;
+
+    return !characters_block || !_overlaps_character(graph, settings, state);
+}
+
+int pathfinding::validate_path(
+    const Graph& graph,
+    const Settings& settings,
+    const std::vector<State>& path,
+    bool characters_block,
+    size_t first) {
+
+    if (first == 0 && !path.empty()) {
+        State initial = path[0];
+        graph.contextualize(settings, initial);
+        if (initial.scenario_meta != path[0].scenario_meta) return 0;
+
+        first = 1;
+    }
+
+    for (size_t i = first; i < path.size(); i++) {
+        if (!_holds(graph, settings, path[i - 1], path[i], characters_block)) return (int)i;
+    }
+
+    return -1;
+}
+
+// Cheapest states from start to exactly target, both included, staying inside bounds
+static bool _bridge(
+    const Graph& graph,
+    const Settings& settings,
+    const Region& bounds,
+    const State& start,
+    const State& target,
+    std::vector<State>& bridge,
+    SearchStats* stats) {
+
+    StatePacker packer(bounds, start);
+    Region clipped = packer.clip(bounds);
+
+    StepCosts steps = min_step_costs(settings);
+
+    std::unordered_map<StateKey, Visit, StateKeyHash> visited;
+    tool::priority_queue<StateKey, int> frontier;
+
+    StateKey start_key = packer.pack(start);
+    StateKey target_key = packer.pack(target);
+
+    frontier.put(start_key, 0);
+    visited[start_key] = Visit { start_key, 0, false };
+
+    State neighbors[MAX_NEIGHBORS];
+    bool found = false;
+
+    while (!frontier.empty()) {
+        StateKey current_key = frontier.get();
+
+        Visit& visit = visited[current_key];
+        if (visit.closed) continue;
+        visit.closed = true;
+
+        if (current_key == target_key) {
+            found = true;
+            break;
+        }
+
+        State current = packer.unpack(current_key);
+        int current_cost = visit.cost;
+
+        int n = graph.neighbors(settings, current, neighbors);
+
+        if (stats) {
+            stats->expanded++;
+            stats->generated += n;
+            stats->fit_checks += settings.ledge_hang ? 6 : 4;
+            stats->tile_reads += (settings.ledge_hang ? 6 : 4) * fit_tiles(settings);
+        }
+
+        for (int i = 0; i < n; i++) {
+            const State& next = neighbors[i];
+
+            if (next.x < clipped.x) continue;
+            if (next.y < clipped.y) continue;
+            if (next.x >= clipped.x + clipped.w) continue;
+            if (next.y >= clipped.y + clipped.h) continue;
+
+            int new_cost = current_cost + graph.cost(settings, current, next);
+
+            StateKey next_key = packer.pack(next);
+            auto it = visited.find(next_key);
+            if (it == visited.end() || new_cost < it->second.cost) {
+                visited[next_key] = Visit { current_key, new_cost, false };
+                int estimate = std::abs(next.x - target.x) * steps.horizontal;
+                estimate += next.y < target.y ? (target.y - next.y) * steps.down : (next.y - target.y) * steps.up;
+                frontier.put(next_key, new_cost + estimate);
+            }
+        }
+    }
+
+    if (!found) return false;
+
+    bridge.clear();
+    for (StateKey key = target_key; key != start_key; key = visited[key].came_from) {
+        bridge.push_back(packer.unpack(key));
+    }
+
+    bridge.push_back(start);
+    std::reverse(bridge.begin(), bridge.end());
+
+    return true;
+}
+
+bool pathfinding::repair_path(
+    const Graph& graph,
+    const Settings& settings,
+    const Region& region,
+    std::vector<State>& path,
+    bool characters_block,
+    int margin,
+    SearchStats* stats) {
+
+    auto started = std::chrono::steady_clock::now();
+    bool repaired = true;
+
+    std::vector<State> bridge;
+    size_t first = 0;
+
+    while (true) {
+        int broken = validate_path(graph, settings, path, characters_block, first);
+        if (broken < 0) break;
+
+        // Nothing to search from when the character itself is out of place
+        if (broken == 0) {
+            repaired = false;
+            break;
+        }
+
+        // Rejoin at the first floor state past the break that holds, landings are reachable from anywhere
+        size_t rejoin = path.size();
+        for (size_t i = broken + 1; i < path.size(); i++) {
+            if (!path[i].is_floor_scenario()) continue;
+
+            State current = path[i];
+            graph.contextualize(settings, current);
+            if (current.scenario_meta != path[i].scenario_meta) continue;
+            if (!graph.fits(settings, current.x, current.y)) continue;
+            if (characters_block && _overlaps_character(graph, settings, current)) continue;
+
+            rejoin = i;
+            break;
+        }
+
+        // The path ends mid-air, aim for its last state as it is
+        if (rejoin == path.size()) rejoin = path.size() - 1;
+
+        const State& start = path[broken - 1];
+        int left = start.x, right = start.x, top = start.y, bottom = start.y;
+        for (size_t i = broken; i <= rejoin; i++) {
+            left = std::min(left, path[i].x);
+            right = std::max(right, path[i].x);
+            top = std::min(top, path[i].y);
+            bottom = std::max(bottom, path[i].y);
+        }
+
+        Region window;
+        if (region.w > 0 && region.h > 0) {
+            window.x = std::max(left - margin, region.x);
+            window.y = std::max(top - margin, region.y);
+            window.w = std::min(right + margin + 1, region.x + region.w) - window.x;
+            window.h = std::min(bottom + margin + 1, region.y + region.h) - window.y;
+        }
+        else {
+            Region stretch { left, top, right - left + 1, bottom - top + 1 };
+            window = widen_window(search_window(settings, start, std::vector<Region>(1, stretch)));
+        }
+
+        if (window.w <= 0 || window.h <= 0 || !_bridge(graph, settings, window, start, path[rejoin], bridge, stats)) {
+            repaired = false;
+            break;
+        }
+
+        // The bridge may pass through characters when that was cheapest, so checking resumes after it
+        path.erase(path.begin() + broken, path.begin() + rejoin + 1);
+        path.insert(path.begin() + broken, bridge.begin() + 1, bridge.end());
+        first = broken + bridge.size() - 1;
+    }
+
+    if (stats) {
+        stats->search_usec += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count();
+    }
+
+    return repaired;
+}
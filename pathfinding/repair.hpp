@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+
+#include "graph.hpp"
+#include "region.hpp"
+#include "search.hpp"
+#include "settings.hpp"
+#include "state.hpp"
+
+namespace pathfinding {
+
+/*
+ * Re-checks a full path, one state per move, against the graph as it is now. Only the
+ * tiles along the path are read. With characters_block a state overlapping another
+ * character counts as broken even though the search would walk through it. The first
+ * state is where the character already is, so only its scenario is checked.
+ *
+ * Returns the index of the first state that no longer holds, or -1.
+ */
+int validate_path(
+    const Graph& graph,
+    const Settings& settings,
+    const std::vector<State>& path,
+    bool characters_block = true,
+    size_t first = 0);
+
+/*
+ * Fixes each broken stretch of a full path with a search from the state before it to
+ * the first state after it that still holds, kept to margin tiles around the stretch.
+ * An empty region keeps it to search_window around the stretch widened once instead.
+ * Returns false when a stretch can't be bridged locally, the path is then only partly
+ * repaired and needs a full search.
+ */
+bool repair_path(
+    const Graph& graph,
+    const Settings& settings,
+    const Region& region,
+    std::vector<State>& path,
+    bool characters_block = true,
+    int margin = 8,
+    SearchStats* stats = nullptr);
+
+}
@@ -0,0 +1,165 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "parallel.hpp"
+#include "search.hpp"
+#include "trace.hpp"
+
+using namespace std;
+
+/*
+ * Re-runs the queries of a trace recorded by Pathfinder.start_trace against the graphs
+ * they saw in game. Graphs are rebuilt with their dynamic masses before the clock starts
+ * so only the searches are timed.
+ *
+ *   replay.out trace [--threads 1] [--repeat 1] [--format text|csv|json]
+ */
+
+struct Replay {
+    pathfinding::Graph graph;
+    const pathfinding::TraceQuery* query;
+    double latency_us;
+    bool found;
+    pathfinding::SearchStats stats;
+};
+
+static double _percentile(vector<double>& values, double percentile) {
+    if (values.empty()) return 0;
+    size_t index = (size_t)(percentile * (values.size() - 1));
+    nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+// Each replay thread keeps its own workers for parallel queries, one set per thread count
+typedef map<int, unique_ptr<pathfinding::ParallelWorkers>> Workers;
+
+static void _run(Replay& replay, Workers& workers) {
+    const pathfinding::TraceQuery& query = *replay.query;
+    auto initial = pathfinding::State::create(query.initial_x, query.initial_y);
+
+    vector<pathfinding::State> path;
+    int goal_index;
+    replay.stats = pathfinding::SearchStats();
+
+    bool lazy = (query.mode & TRACE_MODE_LAZY) != 0;
+    int threads = (query.mode >> TRACE_MODE_THREADS_SHIFT) & TRACE_MODE_THREADS_MASK;
+
+    unique_ptr<pathfinding::ParallelWorkers>& parallel = workers[threads];
+    if (threads > 1 && !parallel) parallel.reset(new pathfinding::ParallelWorkers(threads));
+
+    auto start = chrono::steady_clock::now();
+    if (threads > 1) replay.found = pathfinding::parallel_search(replay.graph, query.settings, query.region, initial, query.goals, path, goal_index, *parallel, &replay.stats, pathfinding::PathOutput_Full, lazy);
+    else if (query.mode & TRACE_MODE_WIDENING) replay.found = pathfinding::search_widening(replay.graph, query.settings, query.region, initial, query.goals, path, goal_index, &replay.stats, pathfinding::PathOutput_Full, lazy);
+    else replay.found = pathfinding::search(replay.graph, query.settings, query.region, initial, query.goals, path, goal_index, &replay.stats, pathfinding::PathOutput_Full, lazy);
+    auto end = chrono::steady_clock::now();
+
+    replay.latency_us = chrono::duration<double, micro>(end - start).count();
+}
+
+int main(int cargs, char** args) {
+    if (cargs < 2) {
+        fprintf(stderr, "Usage: %s trace [--threads 1] [--repeat 1] [--format text|csv|json]\n", args[0]);
+        return 1;
+    }
+
+    string path(args[1]);
+    int threads = 1;
+    int repeat = 1;
+    string format = "text";
+
+    for (int i = 2; i < cargs; i++) {
+        string arg(args[i]);
+        if (i + 1 >= cargs) {
+            fprintf(stderr, "Missing value for %s\n", arg.c_str());
+            return 1;
+        }
+
+        string value(args[++i]);
+        if (arg == "--threads") threads = max(1, atoi(value.c_str()));
+        else if (arg == "--repeat") repeat = max(1, atoi(value.c_str()));
+        else if (arg == "--format") format = value;
+        else {
+            fprintf(stderr, "Unknown argument: %s\n", arg.c_str());
+            return 1;
+        }
+    }
+
+    pathfinding::Trace trace;
+    if (!pathfinding::read_trace(path, trace)) {
+        fprintf(stderr, "Could not read trace: %s\n", path.c_str());
+        return 1;
+    }
+
+    // Graphs share their pages with the trace, only the tiles under dynamic masses get copied
+    vector<Replay> replays(trace.queries.size() * repeat);
+    for (size_t i = 0; i < replays.size(); i++) {
+        const pathfinding::TraceQuery& query = trace.queries[i % trace.queries.size()];
+        replays[i].graph = trace.graphs[query.graph];
+        replays[i].query = &query;
+
+        for (const pathfinding::Region& mass : query.dynamic_masses) {
+            replays[i].graph.add_dynamic_mass(mass);
+        }
+    }
+
+    atomic<size_t> next(0);
+    auto worker = [&replays, &next]() {
+        Workers workers;
+        for (size_t i = next++; i < replays.size(); i = next++) _run(replays[i], workers);
+    };
+
+    auto begin = chrono::steady_clock::now();
+
+    vector<thread> pool;
+    for (int i = 1; i < threads; i++) pool.emplace_back(worker);
+    worker();
+    for (thread& t : pool) t.join();
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+
+    vector<double> latencies;
+    int found = 0;
+    double total_us = 0;
+    uint64_t expanded = 0;
+    for (const Replay& replay : replays) {
+        latencies.push_back(replay.latency_us);
+        total_us += replay.latency_us;
+        expanded += replay.stats.expanded;
+        if (replay.found) found++;
+    }
+
+    size_t count = replays.size();
+    double queries_per_second = seconds > 0 ? count / seconds : 0;
+    double mean_us = count ? total_us / count : 0;
+    double mean_expanded = count ? (double)expanded / count : 0;
+    double p50_us = _percentile(latencies, 0.50);
+    double p99_us = _percentile(latencies, 0.99);
+    double max_us = latencies.empty() ? 0 : *max_element(latencies.begin(), latencies.end());
+
+    if (format == "csv") {
+        printf("queries,found,graphs,threads,seconds,queries_per_second,mean_us,p50_us,p99_us,max_us,mean_expanded\n");
+        printf("%zu,%d,%zu,%d,%.6f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f\n",
+            count, found, trace.graphs.size(), threads, seconds, queries_per_second, mean_us, p50_us, p99_us, max_us, mean_expanded);
+    }
+    else if (format == "json") {
+        printf("{\"queries\":%zu,\"found\":%d,\"graphs\":%zu,\"threads\":%d,\"seconds\":%.6f,\"queries_per_second\":%.2f,"
+            "\"mean_us\":%.2f,\"p50_us\":%.2f,\"p99_us\":%.2f,\"max_us\":%.2f,\"mean_expanded\":%.2f}\n",
+            count, found, trace.graphs.size(), threads, seconds, queries_per_second, mean_us, p50_us, p99_us, max_us, mean_expanded);
+    }
+    else {
+        printf("%7s %6s %6s %7s %10s %10s %10s %10s %10s %12s\n",
+            "queries", "found", "graphs", "threads", "q/s", "mean us", "p50 us", "p99 us", "max us", "expanded");
+        printf("%7zu %6d %6zu %7d %10.1f %10.1f %10.1f %10.1f %10.1f %12.1f\n",
+            count, found, trace.graphs.size(), threads, queries_per_second, mean_us, p50_us, p99_us, max_us, mean_expanded);
+    }
+
+    return 0;
+}
@@ -0,0 +1,104 @@
+#include "ring.hpp"
+
+#include <cstring>
+#include <new>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace pathfinding;
+
+// POSIX names start with a slash and have no other
+static std::string _shm_name(const std::string& name) {
+    return name.empty() || name[0] != '/' ? "/" + name : name;
+}
+
+bool SharedRing::create(const std::string& name) {
+    close();
+
+    std::string shm_name = _shm_name(name);
+    shm_unlink(shm_name.c_str());
+
+    int fd = shm_open(shm_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) return false;
+
+    if (ftruncate(fd, sizeof(Ring)) != 0) {
+        ::close(fd);
+        shm_unlink(shm_name.c_str());
+        return false;
+    }
+
+    void* memory = mmap(nullptr, sizeof(Ring), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (memory == MAP_FAILED) {
+        shm_unlink(shm_name.c_str());
+        return false;
+    }
+
+    Ring* ring = new (memory) Ring();
+    memcpy(ring->magic, RING_MAGIC, 4);
+    ring->version = RING_VERSION;
+    ring->request_size = sizeof(pf_request);
+    ring->response_size = sizeof(pf_response);
+    ring->requests.head = 0;
+    ring->requests.tail = 0;
+    ring->responses.head = 0;
+    ring->responses.tail = 0;
+
+    ring->ready.store(1, std::memory_order_release);
+
+    _ring = ring;
+    _owner = true;
+    _name = shm_name;
+    return true;
+}
+
+bool SharedRing::open(const std::string& name) {
+    close();
+
+    std::string shm_name = _shm_name(name);
+    int fd = shm_open(shm_name.c_str(), O_RDWR, 0);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(Ring)) {
+        ::close(fd);
+        return false;
+    }
+
+    void* memory = mmap(nullptr, sizeof(Ring), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (memory == MAP_FAILED) return false;
+
+    Ring* ring = (Ring*)memory;
+
+    bool valid = ring->ready.load(std::memory_order_acquire) == 1 && memcmp(ring->magic, RING_MAGIC, 4) == 0 && ring->version == RING_VERSION &&
+        ring->request_size == sizeof(pf_request) && ring->response_size == sizeof(pf_response);
+
+    uint32_t free = 0;
+    if (!valid || !ring->attached.compare_exchange_strong(free, 1, std::memory_order_acq_rel)) {
+        munmap(memory, sizeof(Ring));
+        return false;
+    }
+
+    _ring = ring;
+    _owner = false;
+    _name = shm_name;
+    return true;
+}
+
+void SharedRing::close() {
+    if (!_ring) return;
+
+    if (!_owner) _ring->attached.store(0, std::memory_order_release);
+    munmap(_ring, sizeof(Ring));
+    if (_owner) shm_unlink(_name.c_str());
+
+    _ring = nullptr;
+    _owner = false;
+    _name.clear();
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "capi.h"
+
+#define RING_MAGIC "PFRB"
+#define RING_VERSION 4
+#define RING_SLOTS 1024
+
+namespace pathfinding {
+
+/*
+ * One producer and one consumer, each on their own side of a process boundary. Head and
+ * tail only ever grow and wrap around as unsigned numbers, so a full ring and an empty
+ * one can be told apart without a spare slot.
+ */
+template <typename T>
+struct RingQueue {
+    alignas(64) std::atomic<uint32_t> head;
+    alignas(64) std::atomic<uint32_t> tail;
+    T slots[RING_SLOTS];
+
+    // Publishes all of them at once, returns how many fit
+    inline uint32_t push(const T* items, uint32_t count) {
+        uint32_t at = head.load(std::memory_order_relaxed);
+        uint32_t free = RING_SLOTS - (at - tail.load(std::memory_order_acquire));
+        if (count > free) count = free;
+
+        for (uint32_t i = 0; i < count; i++) slots[(at + i) % RING_SLOTS] = items[i];
+        head.store(at + count, std::memory_order_release);
+        return count;
+    }
+
+    // Exact for the consumer, a lower bound for anyone else
+    inline uint32_t size() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_relaxed);
+    }
+
+    inline uint32_t pop(T* items, uint32_t max_count) {
+        uint32_t at = tail.load(std::memory_order_relaxed);
+        uint32_t used = head.load(std::memory_order_acquire) - at;
+        if (max_count > used) max_count = used;
+
+        for (uint32_t i = 0; i < max_count; i++) items[i] = slots[(at + i) % RING_SLOTS];
+        tail.store(at + max_count, std::memory_order_release);
+        return max_count;
+    }
+};
+
+// Shared between processes, only lock free atomics work there
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "ring atomics must be lock free");
+
+/*
+ * Requests go from the client to the server, responses back. The sizes catch a client
+ * built against another layout. Ready is set last, clients read nothing else before it.
+ * Both queues have one end per side, so the one client claims attached for as long as it
+ * is open.
+ */
+struct Ring {
+    std::atomic<uint32_t> ready;
+    std::atomic<uint32_t> attached;
+    char magic[4];
+    uint32_t version;
+    uint32_t request_size;
+    uint32_t response_size;
+
+    RingQueue<pf_request> requests;
+    RingQueue<pf_response> responses;
+};
+
+// A Ring in POSIX shared memory, the server creates it under a name and clients attach to it
+class SharedRing {
+public:
+    SharedRing() : _ring(nullptr), _owner(false) {}
+    ~SharedRing() { close(); }
+
+    SharedRing(const SharedRing&) = delete;
+    SharedRing& operator=(const SharedRing&) = delete;
+
+    // Replaces whatever ring was left under the name, it is unlinked again on close
+    bool create(const std::string& name);
+
+    // Fails while another client has the ring open
+    bool open(const std::string& name);
+    void close();
+
+    inline Ring* ring() const { return _ring; }
+
+private:
+    Ring* _ring;
+    bool _owner;
+    std::string _name;
+};
+
+}
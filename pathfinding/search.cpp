@@ -1,11 +1,144 @@
 #include "tools/queue.hpp"
 #include "search.hpp"
+#include "state_key.hpp"
 #include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
 
 using namespace pathfinding;
 
-inline int _heuristic(const Settings& settings, const State& state, const int goal_x, const int goal_y) {
-    return abs(goal_x - state.x) + abs(goal_y - state.y);
+struct Visit {
+    StateKey came_from;
+    int cost;
+    bool closed;
+};
+
+/*
+ * Picks keypoints while a path is walked from its last state to its first, the order
+ * reconstruction visits them in. A state is decided once the two states before it are
+ * known, so only four states are ever held. Tiles are only read for the few states
+ * whose scenarios leave the decision open.
+ */
+class KeypointEmitter {
+public:
+    KeypointEmitter(const Graph& graph, std::vector<State>& out) : _graph(graph), _out(out), _count(0) {}
+
+    void push(const State& state) {
+        _window[_count & 3] = state;
+
+        // Always add last
+        if (_count == 0) _out.push_back(state);
+        else if (_count >= 3) _decide(_at(_count - 2), _at(_count - 3), _at(_count - 1), _at(_count));
+
+        _count++;
+    }
+
+    void finish() {
+        // The second state peeks past the first, which clamps to the first
+        if (_count >= 3) _decide(_at(_count - 2), _at(_count - 3), _at(_count - 1), _at(_count - 1));
+
+        // Always add first
+        if (_count >= 2) _out.push_back(_at(_count - 1));
+    }
+
+private:
+    inline const State& _at(size_t index) const { return _window[index & 3]; }
+
+    void _decide(const State& current, const State& after, const State& before, const State& before_before) {
+        if (_keep(current, after, before, before_before)) _out.push_back(current);
+    }
+
+    bool _keep(const State& current, const State& after, const State& before, const State& before_before) const {
+        bool in_air = current.is_air_scenario();
+
+        bool on_floor = current.is_floor_scenario();
+        if (!on_floor && (after.is_air_scenario() || before.is_air_scenario())) {
+            on_floor = _graph.get_at(current.x, current.y) == CHARACTER_TILEKIND;
+        }
+
+        // Floor before air
+        if (on_floor && after.is_air_scenario()) return true;
+
+        // Floor after air
+        if (on_floor && before.is_air_scenario()) return true;
+
+        // Air before floor and moving upwards (prevent bonking from the bottom)
+        if (in_air && current.y < before.y && after.is_floor_scenario()) return true;
+
+        // Air before floor and moving downwards (prevent bonking from the top)
+        if (in_air && current.y < after.y && before.is_floor_scenario()) return true;
+
+        // Jump peaks
+        if (in_air && current.y < before_before.y && current.y < after.y) return true;
+
+        // Falling and moving around a corner
+        if (in_air && current.y > before.y && current.y == after.y) {
+            TileKind tile = _graph.get_at(after.x, after.y - 1);
+            if (tile == FLOOR_TILEKIND || tile == UNTRAVERSABLE_TILEKIND) return true;
+        }
+
+        // Adjacent states are only diagonal around a ledge climb, keep both ends
+        if (current.x != before.x && current.y != before.y) return true;
+        if (current.x != after.x && current.y != after.y) return true;
+
+        return false;
+    }
+
+    const Graph& _graph;
+    std::vector<State>& _out;
+    State _window[4];
+    size_t _count;
+};
+
+/*
+ * Steps through every cell the segment crosses, never diagonally, so the character can't
+ * clip a corner. Level segments also need a floor the whole way, a fall doesn't.
+ */
+static bool _line_of_sight(const Graph& graph, const Settings& settings, const State& from, const State& to) {
+    int dx = std::abs(to.x - from.x);
+    int dy = std::abs(to.y - from.y);
+    int step_x = from.x < to.x ? 1 : -1;
+    int step_y = from.y < to.y ? 1 : -1;
+    bool level = from.y == to.y;
+
+    int x = from.x;
+    int y = from.y;
+
+    for (int ix = 0, iy = 0; ; ) {
+        if (!graph.fits(settings, x, y)) return false;
+        if (level && !graph.on_floor(settings, x, y)) return false;
+        if (ix == dx && iy == dy) return true;
+
+        if ((1 + 2 * ix) * dy < (1 + 2 * iy) * dx) {
+            x += step_x;
+            ix++;
+        }
+        else {
+            y += step_y;
+            iy++;
+        }
+    }
+}
+
+// Only runs that never go up can be shortened, anything else needs its jump keypoints
+void pathfinding::shorten(const Graph& graph, const Settings& settings, std::vector<State>& keypoints) {
+    if (keypoints.size() < 3) return;
+
+    size_t count = 1;
+    for (size_t i = 1; i + 1 < keypoints.size(); i++) {
+        const State& anchor = keypoints[count - 1];
+        const State& current = keypoints[i];
+        const State& next = keypoints[i + 1];
+
+        bool descending = anchor.y <= current.y && current.y <= next.y;
+        if (descending && _line_of_sight(graph, settings, anchor, next)) continue;
+
+        keypoints[count++] = current;
+    }
+
+    keypoints[count++] = keypoints.back();
+    keypoints.resize(count);
 }
 
 bool pathfinding::search(
@@ -16,181 +149,398 @@ bool pathfinding::search(
     const int goal_x, const int goal_y,
     std::vector<State>& path) {
 
+    Region goal;
+    goal.x = goal_x;
+    goal.y = goal_y;
+    goal.w = 1;
+    goal.h = 1;
+
+    int goal_index;
+    return search(graph, settings, region, initial, std::vector<Region>(1, goal), path, goal_index);
+}
+
+static inline bool _contains(const Region& region, const State& state) {
+    return state.x >= region.x && state.y >= region.y && state.x < region.x + region.w && state.y < region.y + region.h;
+}
+
+// Without a window the whole region is searched at once
+static bool _search(
+    const Graph& graph,
+    const Settings& settings,
+    const Region& region,
+    const Region* start_window,
+    State initial,
+    const std::vector<Region>& goals,
+    std::vector<State>& path,
+    int& goal_index,
+    SearchStats* stats,
+    PathOutput output,
+    bool lazy) {
+
+    auto started = std::chrono::steady_clock::now();
+    size_t frontier_size = 0;
+
     graph.contextualize(settings, initial);
 
+    goal_index = -1;
+
     path.clear();
 
+    if (goals.empty()) return false;
+
+    // Packed keys only have room for an 8 bit jump counter
+    if (graph.calculate_jump_limit(settings) + (int)settings.air_stride > STATE_KEY_MAX_JUMP) return false;
+
     bool found_path = false;
 
-    std::unordered_map<State, State> came_from;
-    std::unordered_map<State, int> cost_so_far;
+    StatePacker packer(region, initial);
+    Region bounds = packer.clip(region);
+    Region window = start_window ? region_intersection(*start_window, bounds) : bounds;
+
+    // Reached outside the window, queued once it grows over them
+    std::vector<StateKey> deferred;
+
+    StepCosts steps = min_step_costs(settings);
+
+    std::unordered_map<StateKey, Visit, StateKeyHash> visited;
 
-    tool::priority_queue<State, int> frontier;
-    frontier.put(initial, 0);
+    tool::priority_queue<StateKey, int> frontier;
 
+    StateKey initial_key = packer.pack(initial);
+    frontier.put(initial_key, 0);
+    frontier_size++;
 
-    came_from[initial] = initial;
-    cost_so_far[initial] = 0;
+    visited[initial_key] = Visit { initial_key, 0, false };
 
     State neighbors[MAX_NEIGHBORS];
 
-    State goal_state;
+    auto queue = [&](StateKey key, const State& state, int cost) {
+        frontier.put(key, cost + goal_estimate(settings, steps, state, goals));
+        frontier_size++;
 
-    // Search for shortest path
-    while (!frontier.empty()) {
-        State current = frontier.get();
+        if (stats && frontier_size > stats->frontier_peak) stats->frontier_peak = frontier_size;
+    };
 
-        if (graph.bottom_row_contains(settings, current, goal_x, goal_y)) {
-            goal_state = current;
-            found_path = true;
-            break;
-        }
+    // Queues next unless it is walked in place or deferred, true when next got cheaper inside the window
+    auto relax = [&](StateKey current_key, const State& current, int current_cost, const State& next, bool queued) {
+        if (next.x < bounds.x) return false;
+        if (next.y < bounds.y) return false;
+        if (next.x >= bounds.x + bounds.w) return false;
+        if (next.y >= bounds.y + bounds.h) return false;
 
-        int n = graph.neighbors(settings, current, neighbors);
+        int new_cost = current_cost + graph.cost(settings, current, next);
 
-        for (int i = 0; i < n; i++) {
-            State next = neighbors[i];
-
-            if (next.x < region.x) continue;
-            if (next.y < region.y) continue;
-            if (next.x >= region.x + region.w) continue;
-            if (next.y >= region.y + region.h) continue;
-
-            double new_cost = cost_so_far[current] + graph.cost(settings, current, next);
-            if (cost_so_far.find(next) == cost_so_far.end() || new_cost < cost_so_far[next]) {
-                cost_so_far[next] = new_cost;
-                double priority = new_cost + _heuristic(settings, next, goal_x, goal_y);
-                frontier.put(next, priority);
-                came_from[next] = current;
-            }
+        StateKey next_key = packer.pack(next);
+        auto it = visited.find(next_key);
+        if (it != visited.end() && new_cost >= it->second.cost) return false;
+
+        if (stats && it != visited.end() && it->second.closed) stats->reopened++;
+
+        visited[next_key] = Visit { current_key, new_cost, false };
+
+        if (!_contains(window, next)) {
+            deferred.push_back(next_key);
+            return false;
         }
-    }
 
-    if (!found_path) { return false; }
+        if (queued) queue(next_key, next, new_cost);
 
-    // Reconstruct path
-    State current = goal_state;
+        return true;
+    };
 
-    while (current != initial) {
-        path.push_back(current);
-        current = came_from[current];
-    }
+    // Grows the window until it covers a deferred state, false once nothing is left to grow into
+    auto widen = [&]() {
+        while (frontier.empty()) {
+            if (deferred.empty()) return false;
+            if (window.w >= bounds.w && window.h >= bounds.h) return false;
 
-    path.push_back(initial);
-    std::reverse(path.begin(), path.end());
+            window = region_intersection(widen_window(window), bounds);
+            if (stats) stats->widened++;
 
-    return true;
-}
+            size_t kept = 0;
+            for (StateKey key : deferred) {
+                State state = packer.unpack(key);
+                if (!_contains(window, state)) {
+                    deferred[kept++] = key;
+                    continue;
+                }
 
-const State& _peek(const std::vector<State>& path, const int current, const int distance) {
-    int peek_index = current + distance;
-    if (peek_index < 0) {
-        return path.at(0);
-    }
+                // A state deferred more than once is queued once per entry, the extra ones are skipped as stale
+                const Visit& visit = visited[key];
+                if (!visit.closed) queue(key, state, visit.cost);
+            }
 
-    if (peek_index >= path.size()) {
-        return path.at(path.size()-1);
-    }
+            deferred.resize(kept);
+        }
 
-    return path.at(peek_index);
-}
+        return true;
+    };
+
+    // Floor to floor steps sideways, the goal is always queued so it is found the usual way
+    auto along_run = [&](const State& current, const State& next, int direction) {
+        return current.is_floor_scenario() && next.is_floor_scenario() &&
+            next.y == current.y && next.x == current.x + direction &&
+            reached_goal(settings, next, goals) < 0;
+    };
+
+    /*
+     * Walks a floor run the way JPS jumps along a straight line. Tiles the frontier would
+     * hand out next anyway, no worse than the bound, are expanded in place instead of
+     * going through the queue. Their jumps, drops and ledge moves are queued with the
+     * cost they would have had, so the search stays optimal. The walk stops at walls,
+     * edges, the goal, or once the estimate grows, where the tile is queued as usual.
+     */
+    auto walk = [&](State current, int direction, int bound) {
+        while (true) {
+            StateKey current_key = packer.pack(current);
+            int current_cost = visited[current_key].cost;
+
+            if (current_cost + goal_estimate(settings, steps, current, goals) > bound) {
+                queue(current_key, current, current_cost);
+                return;
+            }
+
+            int n = graph.neighbors(settings, current, neighbors);
 
-void pathfinding::filter(const Graph& graph, const Settings& settings, std::vector<State>& path)  {
-    int size = path.size();
-    int count = 0;
+            if (stats) {
+                stats->walked++;
+                stats->generated += n;
+                stats->fit_checks += settings.ledge_hang ? 6 : 4;
+                stats->tile_reads += (settings.ledge_hang ? 6 : 4) * fit_tiles(settings);
+            }
 
-    State filtered[path.size()];
+            bool onwards = false;
+            State forward;
 
-    for (int i = 0; i < size; i++) {
-        const State& current = path.at(i);
+            for (int i = 0; i < n; i++) {
+                const State& next = neighbors[i];
 
-        // Always add first
-        if (i == 0) {
-            filtered[count++] = current;
-            continue;
-        }
+                bool run = along_run(current, next, direction);
+                if (!relax(current_key, current, current_cost, next, !run) || !run) continue;
 
-        // Always add last
-        if (i == size - 1) {
-            filtered[count++] = current;
-            continue;
+                onwards = true;
+                forward = next;
+            }
+
+            if (!onwards) return;
+            current = forward;
         }
+    };
 
-        bool on_floor = current.is_floor_scenario() || graph.get_at(current.x, current.y) == CHARACTER_TILEKIND;
-        bool in_air = current.is_air_scenario();
-            
+    // Queues every move without checking the character fits there, the tile it stands in is the only part read
+    auto expand_lazily = [&](StateKey current_key, const State& current, int current_cost) {
+        int n = graph.candidates(settings, current, neighbors);
 
-        // Floor before air
-        if (on_floor && _peek(path, i, 1).is_air_scenario()) {
-            filtered[count++] =  current;
-            continue;
+        if (stats) {
+            stats->expanded++;
+            stats->generated += n;
+            stats->tile_reads += n;
         }
 
-        // Floor after air
-        if (on_floor && _peek(path, i, -1).is_air_scenario()) { 
-            filtered[count++] = current;
-            continue;
+        for (int i = 0; i < n; i++) {
+            State& next = neighbors[i];
+
+            TileKind kind = graph.get_at(next.x, next.y);
+            if (kind == FLOOR_TILEKIND || kind == UNTRAVERSABLE_TILEKIND) continue;
+            if (!graph.transition(settings, current, next, false)) continue;
+
+            relax(current_key, current, current_cost, next, true);
         }
+    };
 
-        // Air before floor and moving upwards (prevent bonking from the bottom)
-        if (in_air && current.y < _peek(path, i, -1).y && _peek(path, i, 1).is_floor_scenario()) {
-            filtered[count++] = current;
-            continue;
+    StateKey goal_key = initial_key;
+
+    // Search for shortest path
+    while (!frontier.empty() || widen()) {
+        StateKey current_key = frontier.get();
+        frontier_size--;
+
+        // Stale entry left behind by a cheaper path to the same state
+        Visit& visit = visited[current_key];
+        if (visit.closed) continue;
+        visit.closed = true;
+
+        State current = packer.unpack(current_key);
+
+        // Checked once here instead of once per move into it, a cost of -1 keeps it from being reached again
+        if (lazy && current_key != initial_key) {
+            if (stats) {
+                stats->fit_checks++;
+                stats->tile_reads += fit_tiles(settings);
+            }
+
+            if (!graph.fits(settings, current.x, current.y)) {
+                visit.cost = -1;
+                continue;
+            }
         }
 
-        // Air before floor and moving downwards (prevent bonking from the top)
-        if (in_air && current.y < _peek(path, i, 1).y && _peek(path, i, -1).is_floor_scenario()) {
-            filtered[count++] = current;
-            continue;
+        goal_index = reached_goal(settings, current, goals);
+        if (goal_index >= 0) {
+            goal_key = current_key;
+            found_path = true;
+            break;
         }
-        
-        //Jump Peaks
-        if (in_air && current.y < _peek(path, i, -2).y && (current.y < _peek(path, i, 1).y)) {
-            filtered[count++] = current;
+
+        int current_cost = visit.cost;
+
+        if (lazy) {
+            expand_lazily(current_key, current, current_cost);
             continue;
         }
 
-        // Falling and moving around a corner
-        {
-            const State& before = _peek(path, i, -1);
-            const State& after = _peek(path, i, 1);
-            TileKind tile = graph.get_at(after.x, after.y - 1);
-            if (in_air && current.y > before.y && current.y == after.y &&
-                (tile == TileKind::FLOOR_TILEKIND || tile == TileKind::UNTRAVERSABLE_TILEKIND)) {
-                    filtered[count++] = current;
-                    continue;
-                }
+        int n = graph.neighbors(settings, current, neighbors);
 
+        if (stats) {
+            stats->expanded++;
+            stats->generated += n;
+            stats->fit_checks += settings.ledge_hang ? 6 : 4;
+            stats->tile_reads += (settings.ledge_hang ? 6 : 4) * fit_tiles(settings);
         }
 
-        /* 
-         * For now, the only possible way that two adjecent states can be diagonal
-         * is with ledge hang. So I'm just checking keeping the "misaligned" adjecent states.
-         */
+        // Runs only take tiles that would come off the frontier before anything costlier
+        int bound = current_cost + goal_estimate(settings, steps, current, goals);
 
-        // Keep state directly after a ledge climb
-        {
-            const State& before = _peek(path, i, -1);
-            if (current.x != before.x && current.y != before.y) {
-                filtered[count++] = current;
-                continue;
-            }
+        // walk reuses the neighbor buffer
+        State runs[2];
+        int run_count = 0;
+
+        for (int i = 0; i < n; i++) {
+            const State& next = neighbors[i];
+
+            int direction = next.x - current.x;
+            bool run = direction != 0 && along_run(current, next, direction);
+            if (!relax(current_key, current, current_cost, next, !run) || !run) continue;
+
+            runs[run_count++] = next;
         }
 
-        // Keep state directly before a ledge climb
-        {
-            const State& after = _peek(path, i, 1);
-            if (current.x != after.x && current.y != after.y) {
-                filtered[count++] = current;
-                continue;
-            }
+        for (int i = 0; i < run_count; i++) walk(runs[i], runs[i].x - current.x, bound);
+    }
+
+    if (stats) {
+        stats->search_usec += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count();
+    }
+
+    if (!found_path) { return false; }
+
+    // Reconstruct path
+    StateKey current_key = goal_key;
+
+    if (output == PathOutput_Full) {
+        while (current_key != initial_key) {
+            path.push_back(packer.unpack(current_key));
+            current_key = visited[current_key].came_from;
         }
 
+        path.push_back(initial);
+    }
+    else {
+        KeypointEmitter emitter(graph, path);
+
+        while (current_key != initial_key) {
+            emitter.push(packer.unpack(current_key));
+            current_key = visited[current_key].came_from;
+        }
 
+        emitter.push(initial);
+        emitter.finish();
     }
 
-    path.resize(count);
-    for (int i = 0; i < count ; i++) {
-        path[i] = filtered[i];
+    std::reverse(path.begin(), path.end());
+
+    if (output == PathOutput_Shortened) shorten(graph, settings, path);
+
+    return true;
+}
+
+bool pathfinding::search(
+    const Graph& graph,
+    const Settings& settings,
+    const Region& region,
+    State initial,
+    const std::vector<Region>& goals,
+    std::vector<State>& path,
+    int& goal_index,
+    SearchStats* stats,
+    PathOutput output,
+    bool lazy) {
+
+    return _search(graph, settings, region, nullptr, initial, goals, path, goal_index, stats, output, lazy);
+}
+
+Region pathfinding::search_window(const Settings& settings, const State& initial, const std::vector<Region>& goals) {
+    Region window;
+    window.x = initial.x;
+    window.y = initial.y;
+    window.w = (int)settings.width;
+    window.h = 1;
+
+    for (const Region& goal : goals) window = region_union(window, goal);
+
+    // Enough to go over or around a wall as high as a jump on either side
+    int64_t margin = 2 * (int64_t)settings.max_jump_height + settings.width + settings.height;
+    window.x = region_clamp(window.x - margin);
+    window.y = region_clamp(window.y - margin);
+    window.w = region_clamp(window.w + 2 * margin);
+    window.h = region_clamp(window.h + 2 * margin);
+    return window;
+}
+
+Region pathfinding::widen_window(const Region& window, int count) {
+    Region wider = window;
+
+    for (int i = 0; i < count; i++) {
+        int64_t grow_x = wider.w / 2 + 1;
+        int64_t grow_y = wider.h / 2 + 1;
+        wider.x = region_clamp(wider.x - grow_x);
+        wider.y = region_clamp(wider.y - grow_y);
+        wider.w = region_clamp(wider.w + 2 * grow_x);
+        wider.h = region_clamp(wider.h + 2 * grow_y);
     }
+
+    return wider;
+}
+
+bool pathfinding::search_widening(
+    const Graph& graph,
+    const Settings& settings,
+    const Region& region,
+    State initial,
+    const std::vector<Region>& goals,
+    std::vector<State>& path,
+    int& goal_index,
+    SearchStats* stats,
+    PathOutput output,
+    bool lazy) {
+
+    Region window = search_window(settings, initial, goals);
+    return _search(graph, settings, region, &window, initial, goals, path, goal_index, stats, output, lazy);
+}
+
+Region pathfinding::search_footprint(const Settings& settings, const Region& region, const State& initial) {
+    int64_t left = std::min(region.x, initial.x);
+    int64_t top = std::min(region.y, initial.y);
+    int64_t right = std::max((int64_t)region.x + region.w, (int64_t)initial.x + 1);
+    int64_t bottom = std::max((int64_t)region.y + region.h, (int64_t)initial.y + 1);
+
+    // Ledge checks look one tile to each side and above the head, floor checks one tile below
+    Region footprint;
+    footprint.x = region_clamp(left - 1);
+    footprint.y = region_clamp(top - settings.height);
+    footprint.w = region_clamp(right + settings.width - footprint.x);
+    footprint.h = region_clamp(bottom + 1 - footprint.y);
+
+    return footprint;
+}
+
+void pathfinding::filter(const Graph& graph, std::vector<State>& path) {
+    std::vector<State> keypoints;
+    KeypointEmitter emitter(graph, keypoints);
+
+    for (auto it = path.rbegin(); it != path.rend(); ++it) emitter.push(*it);
+    emitter.finish();
+
+    std::reverse(keypoints.begin(), keypoints.end());
+    path.swap(keypoints);
 }
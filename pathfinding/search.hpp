@@ -1,5 +1,6 @@
 #pragma once
 
+#include <climits>
 #include <vector>
 
 #include "settings.hpp"
@@ -8,7 +9,86 @@
 
 namespace pathfinding {
 
-void filter(const Graph& graph, const Settings& settings, std::vector<State>& path);
+// Optional counters a search adds to, so one instance can sum up many searches
+struct SearchStats {
+    // Taken off the frontier, walked states were expanded in place along a floor run
+    uint64_t expanded;
+    uint64_t walked;
+    uint64_t generated;
+    uint64_t reopened;
+    uint64_t frontier_peak;
+
+    // Tiles the fit checks and lazy moves read at most, counted per check instead of per read
+    uint64_t tile_reads;
+    uint64_t search_usec;
+
+    // Times search_widening had to grow its window
+    uint64_t widened;
+
+    // Whole body checks against the tiles, eager searches make one per move and lazy ones one per state
+    uint64_t fit_checks;
+
+    SearchStats() : expanded(0), walked(0), generated(0), reopened(0), frontier_peak(0), tile_reads(0), search_usec(0), widened(0), fit_checks(0) {}
+};
+
+// Tiles one fit check reads when the character fits
+inline uint64_t fit_tiles(const Settings& settings) {
+    return (uint64_t)settings.width * settings.height;
+}
+
+// Which states of the found path a search returns
+enum PathOutput {
+    PathOutput_Full = 0,
+    // Jump starts, peaks, landings, corners and ledge climbs, the same states filter keeps
+    PathOutput_Keypoints = 1,
+    // Keypoints, minus the ones a walk or fall can skip by going straight to the next
+    PathOutput_Shortened = 2,
+};
+
+/*
+ * Lower bound on the cost to reach the closest goal. Every move pays at least the step
+ * cost of each tile it covers along each axis, and the character's bottom row only has
+ * to overlap a goal.
+ */
+inline int goal_estimate(const Settings& settings, const StepCosts& steps, const State& state, const std::vector<Region>& goals) {
+    // In 64 bits so goals far from the state can't wrap it around, the result saturates instead
+    int64_t best = INT_MAX;
+    for (const Region& goal : goals) {
+        int64_t right = (int64_t)state.x + settings.width;
+        int64_t dx = 0;
+        if (right <= goal.x) dx = goal.x - (right - 1);
+        else if (state.x >= (int64_t)goal.x + goal.w) dx = state.x - ((int64_t)goal.x + goal.w - 1);
+
+        int64_t estimate = dx * steps.horizontal;
+        if (state.y < goal.y) estimate += ((int64_t)goal.y - state.y) * steps.down;
+        else if (state.y >= (int64_t)goal.y + goal.h) estimate += (state.y - ((int64_t)goal.y + goal.h - 1)) * steps.up;
+
+        if (estimate < best) best = estimate;
+    }
+
+    return (int)best;
+}
+
+// Index of the first goal the bottom row of the character overlaps, or -1
+inline int reached_goal(const Settings& settings, const State& state, const std::vector<Region>& goals) {
+    for (size_t i = 0; i < goals.size(); i++) {
+        const Region& goal = goals[i];
+        if (state.y < goal.y || state.y >= goal.y + goal.h) continue;
+        if (state.x + (int)settings.width <= goal.x || state.x >= goal.x + goal.w) continue;
+        return (int)i;
+    }
+
+    return -1;
+}
+
+// Every tile the search can read when it is bounded by the region and starts at initial
+Region search_footprint(const Settings& settings, const Region& region, const State& initial);
+
+// Keeps the keypoints of a full path, searches can emit them directly instead
+void filter(const Graph& graph, std::vector<State>& path);
+
+// Drops the keypoints of a filtered path that PathOutput_Shortened leaves out
+void shorten(const Graph& graph, const Settings& settings, std::vector<State>& keypoints);
 
 bool search(
     const Graph& graph,
@@ -18,4 +98,49 @@ bool search(
     const int goal_x, const int goal_y,
     std::vector<State>& path);
 
+/*
+ * Stops at the cheapest goal to reach, goal_index is the one that was reached or -1.
+ *
+ * A lazy search queues moves before checking the character's whole body fits where they
+ * end, and checks it once the state comes off the frontier. A state reached from several
+ * sides is then checked once instead of once per side, and the ones still queued when the
+ * goal turns up never are. The path is just as cheap. Pays off for tall or wide characters,
+ * floor runs aren't walked in place so small ones are better off without it.
+ */
+bool search(
+    const Graph& graph,
+    const Settings& settings,
+    const Region& region,
+    State initial,
+    const std::vector<Region>& goals,
+    std::vector<State>& path,
+    int& goal_index,
+    SearchStats* stats = nullptr,
+    PathOutput output = PathOutput_Full,
+    bool lazy = false);
+
+// Bounding box of initial and the goals, with room to jump around whatever is between them
+Region search_window(const Settings& settings, const State& initial, const std::vector<Region>& goals);
+
+// Twice as wide and high for each count, around the same center
+Region widen_window(const Region& window, int count = 1);
+
+/*
+ * Searches search_window first and widens it whenever the search runs dry inside it,
+ * never past region. States reached outside the window wait until it grows over them,
+ * so a wider window picks up where the last one stopped instead of starting over. The
+ * path is the cheapest one inside the window it was found in.
+ */
+bool search_widening(
+    const Graph& graph,
+    const Settings& settings,
+    const Region& region,
+    State initial,
+    const std::vector<Region>& goals,
+    std::vector<State>& path,
+    int& goal_index,
+    SearchStats* stats = nullptr,
+    PathOutput output = PathOutput_Full,
+    bool lazy = false);
+
 }
\ No newline at end of file
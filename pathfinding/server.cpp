@@ -0,0 +1,184 @@
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "capi.h"
+#include "ring.hpp"
+
+using namespace std;
+
+/*
+ * Answers path requests from other processes on the same machine. Loads a graph saved by
+ * GriddedGraph.save_graph, creates a shared memory ring under the name and serves it until
+ * interrupted. One client at a time attaches with pf_client_open and batches requests with
+ * pf_client_submit.
+ *
+ *   pathserver.out graph name [--threads 1] [--cpus 2,3]
+ *
+ * Idle workers back off from spinning to short sleeps, so the first request after a quiet
+ * spell waits up to a millisecond longer than the ones behind it.
+ */
+
+#define BATCH_SIZE 32
+#define IDLE_SPINS 1000
+#define MAX_SLEEP_USEC 1000
+
+static atomic<bool> _stopped(false);
+
+static void _stop(int) {
+    _stopped = true;
+}
+
+struct Server {
+    const pf_graph* graph;
+    pathfinding::Ring* ring;
+    int threads;
+
+    // Each end of the ring has one owner on this side, workers take turns at it
+    mutex requests_lock;
+    mutex responses_lock;
+
+    atomic<uint64_t> served;
+};
+
+static void _pin(int cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) fprintf(stderr, "Can't pin a worker to cpu %d\n", cpu);
+#else
+    (void)cpu;
+#endif
+}
+
+static void _serve(Server& server, int cpu) {
+    if (cpu >= 0) _pin(cpu);
+
+    vector<pf_request> requests(BATCH_SIZE);
+    vector<pf_response> responses(BATCH_SIZE);
+    int idle = 0;
+
+    while (!_stopped) {
+        uint32_t count;
+        {
+            // An even share of what is waiting, so one worker doesn't take a whole batch while the rest idle
+            lock_guard<mutex> lock(server.requests_lock);
+            uint32_t share = (server.ring->requests.size() + server.threads - 1) / server.threads;
+            count = server.ring->requests.pop(requests.data(), min(share, (uint32_t)BATCH_SIZE));
+        }
+
+        if (count == 0) {
+            idle++;
+            if (idle > IDLE_SPINS) this_thread::sleep_for(chrono::microseconds(min(idle - IDLE_SPINS, MAX_SLEEP_USEC)));
+            else this_thread::yield();
+            continue;
+        }
+
+        idle = 0;
+
+        for (uint32_t i = 0; i < count; i++) pf_search(server.graph, &requests[i], &responses[i]);
+
+        // A client that stops polling stalls its responses here, never drops them
+        uint32_t sent = 0;
+        while (sent < count && !_stopped) {
+            {
+                lock_guard<mutex> lock(server.responses_lock);
+                sent += server.ring->responses.push(responses.data() + sent, count - sent);
+            }
+
+            if (sent < count) this_thread::sleep_for(chrono::microseconds(50));
+        }
+
+        server.served += count;
+    }
+}
+
+static vector<int> _cpus(const string& list) {
+    vector<int> cpus;
+    stringstream in(list);
+    string item;
+    while (getline(in, item, ',')) {
+        if (!item.empty()) cpus.push_back(atoi(item.c_str()));
+    }
+    return cpus;
+}
+
+int main(int cargs, char** args) {
+    if (cargs < 3) {
+        fprintf(stderr, "Usage: %s graph name [--threads 1] [--cpus 2,3]\n", args[0]);
+        return 1;
+    }
+
+    string graph_path(args[1]);
+    string name(args[2]);
+    int threads = 1;
+    vector<int> cpus;
+
+    for (int i = 3; i < cargs; i++) {
+        string arg(args[i]);
+        if (i + 1 >= cargs) {
+            fprintf(stderr, "Missing value for %s\n", arg.c_str());
+            return 1;
+        }
+
+        string value(args[++i]);
+        if (arg == "--threads") threads = max(atoi(value.c_str()), 1);
+        else if (arg == "--cpus") cpus = _cpus(value);
+        else {
+            fprintf(stderr, "Unknown argument: %s\n", arg.c_str());
+            return 1;
+        }
+    }
+
+    pf_graph* graph = pf_graph_load(graph_path.c_str());
+    if (!graph) {
+        fprintf(stderr, "Can't load %s\n", graph_path.c_str());
+        return 1;
+    }
+
+    pathfinding::SharedRing ring;
+    if (!ring.create(name)) {
+        fprintf(stderr, "Can't create the ring %s\n", name.c_str());
+        pf_graph_destroy(graph);
+        return 1;
+    }
+
+    signal(SIGINT, _stop);
+    signal(SIGTERM, _stop);
+
+    Server server;
+    server.graph = graph;
+    server.ring = ring.ring();
+    server.threads = threads;
+    server.served = 0;
+
+    // Workers go round the cpus given, or wherever the scheduler puts them
+    vector<thread> workers;
+    for (int i = 0; i < threads; i++) {
+        int cpu = cpus.empty() ? -1 : cpus[i % cpus.size()];
+        workers.emplace_back(_serve, ref(server), cpu);
+    }
+
+    fprintf(stderr, "Serving %s as %s with %d threads\n", graph_path.c_str(), name.c_str(), threads);
+
+    for (thread& worker : workers) worker.join();
+
+    fprintf(stderr, "Served %llu requests\n", (unsigned long long)server.served.load());
+
+    ring.close();
+    pf_graph_destroy(graph);
+    return 0;
+}
@@ -2,6 +2,22 @@
 
 namespace pathfinding {
 
+// Cost of each class of move, the defaults are the original cost model
+struct CostProfile {
+    int up = 3;
+    int down = 1;
+    int level = 2;
+
+    // Per tile of max_jump_height
+    int ledge_climb = 3;
+
+    // Entering a tile taken by another character
+    int character = 70;
+
+    // Multiplies the graph's cost layer
+    int hazard = 1;
+};
+
 struct Settings {
     int max_jump_height;
 
@@ -12,6 +28,35 @@ struct Settings {
     unsigned int height;
 
     bool ledge_hang;
+
+    CostProfile costs;
 };
 
+// The cheapest a tile of movement along each axis can be, heuristics built on them stay lower bounds
+struct StepCosts {
+    int horizontal;
+    int up;
+    int down;
+};
+
+inline StepCosts min_step_costs(const Settings& settings) {
+    const CostProfile& costs = settings.costs;
+
+    // Sideways moves never change height, so they always cost a level move
+    StepCosts steps { costs.level, costs.up, costs.down };
+
+    // A ledge climb covers the character's width and height in one move
+    if (settings.ledge_hang) {
+        int tiles = (int)(settings.width + settings.height);
+        int climb = tiles > 0 ? (settings.max_jump_height * costs.ledge_climb) / tiles : 0;
+        steps.horizontal = steps.horizontal < climb ? steps.horizontal : climb;
+        steps.up = steps.up < climb ? steps.up : climb;
+    }
+
+    steps.horizontal = steps.horizontal > 0 ? steps.horizontal : 0;
+    steps.up = steps.up > 0 ? steps.up : 0;
+    steps.down = steps.down > 0 ? steps.down : 0;
+    return steps;
+}
+
 }
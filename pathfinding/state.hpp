@@ -1,10 +1,22 @@
 #pragma once
 
 #include "scenario.hpp"
+#include <cstddef>
+#include <cstdint>
 #include <tuple>
 
 namespace pathfinding {
 
+// splitmix64 finalizer, spreads neighboring coordinates across the whole hash range
+inline uint64_t mix_key(uint64_t key) {
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ULL;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebULL;
+    key ^= key >> 31;
+    return key;
+}
+
 struct State {
     State() : x(0), y(0), jump(0), scenario_meta(Scenario_None) { }
 
@@ -60,7 +72,8 @@ template<> struct hash<pathfinding::State> {
     typedef pathfinding::State argument_type;
     typedef std::size_t result_type;
     std::size_t operator()(const pathfinding::State& state) const noexcept {
-        return std::hash<int>()(state.x ^ (state.y << 4) ^ (state.jump << 8));
+        uint64_t position = ((uint64_t)(uint32_t)state.y << 32) | (uint32_t)state.x;
+        return (std::size_t)pathfinding::mix_key(pathfinding::mix_key(position) ^ (uint32_t)state.jump);
     }
 };
 }
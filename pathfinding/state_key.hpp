@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+
+#include "region.hpp"
+#include "state.hpp"
+
+/*
+ * Packed layout used inside the search:
+ *   bits  0-15  x relative to the packer origin
+ *   bits 16-31  y relative to the packer origin
+ *   bits 32-39  jump
+ *   bits 40-43  scenario
+ */
+#define STATE_KEY_SPAN 0x10000
+#define STATE_KEY_MAX_JUMP 0xFF
+
+namespace pathfinding {
+
+typedef uint64_t StateKey;
+
+struct StateKeyHash {
+    inline std::size_t operator()(const StateKey key) const noexcept { return (std::size_t)mix_key(key); }
+};
+
+class StatePacker {
+public:
+    // Places the origin so the initial state and as much of the region as possible fit in 16 bits
+    StatePacker(const Region& region, const State& initial) {
+        _origin_x = _place_origin(region.x, initial.x);
+        _origin_y = _place_origin(region.y, initial.y);
+    }
+
+    inline StateKey pack(const State& state) const {
+        return (StateKey)(uint16_t)(state.x - _origin_x) |
+            ((StateKey)(uint16_t)(state.y - _origin_y) << 16) |
+            ((StateKey)(uint8_t)state.jump << 32) |
+            ((StateKey)(state.scenario_meta & 0xF) << 40);
+    }
+
+    inline State unpack(const StateKey key) const {
+        State state;
+        state.x = _origin_x + (int)(key & 0xFFFF);
+        state.y = _origin_y + (int)((key >> 16) & 0xFFFF);
+        state.jump = (int)((key >> 32) & 0xFF);
+        state.scenario_meta = (int)((key >> 40) & 0xF);
+        return state;
+    }
+
+    // Only positions inside the returned region can be packed
+    inline Region clip(const Region& region) const {
+        Region clipped;
+        clipped.x = region.x > _origin_x ? region.x : _origin_x;
+        clipped.y = region.y > _origin_y ? region.y : _origin_y;
+
+        int64_t right = (int64_t)region.x + region.w;
+        int64_t bottom = (int64_t)region.y + region.h;
+        if (right > (int64_t)_origin_x + STATE_KEY_SPAN) right = (int64_t)_origin_x + STATE_KEY_SPAN;
+        if (bottom > (int64_t)_origin_y + STATE_KEY_SPAN) bottom = (int64_t)_origin_y + STATE_KEY_SPAN;
+
+        clipped.w = right > clipped.x ? (int)(right - clipped.x) : 0;
+        clipped.h = bottom > clipped.y ? (int)(bottom - clipped.y) : 0;
+        return clipped;
+    }
+
+private:
+    static inline int _place_origin(const int region_start, const int initial) {
+        int64_t lowest = (int64_t)initial - (STATE_KEY_SPAN / 2 - 1);
+        int64_t origin = region_start < initial ? region_start : initial;
+        return (int)(origin > lowest ? origin : lowest);
+    }
+
+    int _origin_x;
+    int _origin_y;
+};
+
+}
@@ -1,27 +1,58 @@
 #include <algorithm>
+#include <cstring>
+#include <filesystem>
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <sstream>
 
+#include "capi.h"
+#include "free_cells.hpp"
+#include "lod.hpp"
+#include "path_database.hpp"
+#include "realtime.hpp"
+#include "repair.hpp"
 #include "search.hpp"
 #include "test.hpp"
+#include "trace.hpp"
 
 using namespace std;
 
-void _read_settings(const string& line, pathfinding::Settings& settings) {
+// Max jump height and air stride, then any number of key=value options
+void _read_settings(const string& line, pathfinding::Test& test) {
+    pathfinding::Settings& settings = test.settings;
     settings.max_jump_height = 0;
     settings.air_stride = 2;
+    settings.width = 1;
+    settings.height = 1;
+    settings.ledge_hang = false;
 
-    istringstream in(line);
+    test.check = "search";
+    test.options.clear();
 
-    in >> settings.max_jump_height;
+    istringstream in(line);
+    string token;
+    int position = 0;
+
+    while (in >> token) {
+        size_t equals = token.find('=');
+        if (equals != string::npos) {
+            test.options[token.substr(0, equals)] = token.substr(equals + 1);
+            continue;
+        }
 
-    if (in.eof()) return;
+        if (position == 0) settings.max_jump_height = stoi(token);
+        else if (position == 1) settings.air_stride = stoi(token);
+        position++;
+    }
 
-    in >> settings.air_stride;
+    auto check = test.options.find("check");
+    if (check != test.options.end()) test.check = check->second;
+}
 
-    if (in.eof()) return;
+int _option(const pathfinding::Test& test, const string& key, int fallback) {
+    auto it = test.options.find(key);
+    return it == test.options.end() ? fallback : stoi(it->second, nullptr, 0);
 }
 
 bool _read_tests(ifstream& file, vector<pathfinding::Test>& tests) {
@@ -38,11 +69,14 @@ bool _read_tests(ifstream& file, vector<pathfinding::Test>& tests) {
         pathfinding::Test& test = tests[index];
         test.tag = row;
 
-        file >> test.graph.width;
+        test.region.x = 0;
+        test.region.y = 0;
+
+        file >> test.region.w;
 
         if (file.eof()) return false;
 
-        file >> test.graph.height;
+        file >> test.region.h;
 
         if (file.eof()) return false;
 
@@ -52,14 +86,14 @@ bool _read_tests(ifstream& file, vector<pathfinding::Test>& tests) {
 
         if (file.eof()) return false;
 
-        _read_settings(row, test.settings);
+        _read_settings(row, test);
 
-        for (int r = 0; r < test.graph.height; r++) {
+        for (int r = 0; r < test.region.h; r++) {
             file >> row;
 
             if (file.eof()) return false;
 
-            for (int c = 0; c < min((int)row.length(), test.graph.width); c++) {
+            for (int c = 0; c < min((int)row.length(), test.region.w); c++) {
                 char kind = row[c];
                 switch (kind) {
                     case '#':
@@ -79,17 +113,22 @@ bool _read_tests(ifstream& file, vector<pathfinding::Test>& tests) {
                         test.goal.y = r;
                         break;
                     }
+                    case 'X':
+                    {
+                        test.edits.push_back(pathfinding::State::create(c, r));
+                        break;
+                    }
                     default: break;
                 }
             }
         }
 
-        for (int r = 0; r < test.graph.height; r++) {
+        for (int r = 0; r < test.region.h; r++) {
             file >> row;
 
             if (file.eof()) break;
 
-            for (int c = 0; c < min((int)row.length(), test.graph.width); c++) {
+            for (int c = 0; c < min((int)row.length(), test.region.w); c++) {
                 char item = row[c];
                 if (item != '*') continue;
 
@@ -104,15 +143,262 @@ bool _read_tests(ifstream& file, vector<pathfinding::Test>& tests) {
     return true;
 }
 
+// Can't match any expected path, for checks that fail on something besides the path
+void _mismatch(vector<pathfinding::State>& actual_path) {
+    actual_path.push_back(pathfinding::State::create(-1, -1));
+}
+
+// Scratch files of the checks that write one, named after the test
+string _scratch_path(const pathfinding::Test& test, const string& extension) {
+    return (filesystem::temp_directory_path() / (test.tag + extension)).string();
+}
+
+/*
+ * The whole query goes through pf_search on a copy of the map, initial_x, initial_y,
+ * goal_x and goal_y options move the start and goal anywhere, even off the map.
+ */
+void _check_capi(const pathfinding::Test& test, vector<pathfinding::State>& actual_path) {
+    pf_graph* graph = pf_graph_create();
+    for (int y = 0; y < test.region.h; y++) {
+        for (int x = 0; x < test.region.w; x++) {
+            if (test.graph.get_at(x, y) == pathfinding::FLOOR_TILEKIND) pf_graph_set_tile(graph, x, y, PF_TILE_FLOOR);
+        }
+    }
+
+    pf_request request;
+    pf_settings_default(&request.settings);
+    request.id = 0;
+    request.settings.max_jump_height = test.settings.max_jump_height;
+    request.settings.air_stride = test.settings.air_stride;
+    bool bounded = _option(test, "region", 1) != 0;
+    request.region = pf_region { 0, 0, bounded ? test.region.w : 0, bounded ? test.region.h : 0 };
+    request.initial_x = _option(test, "initial_x", test.start.x);
+    request.initial_y = _option(test, "initial_y", test.start.y);
+    request.output = PF_OUTPUT_FULL;
+    request.goal_count = 1;
+    request.goals[0] = pf_region { _option(test, "goal_x", test.goal.x), _option(test, "goal_y", test.goal.y), 1, 1 };
+
+    pf_response* response = new pf_response();
+    if (pf_search(graph, &request, response)) {
+        for (int i = 0; i < min(response->length, PF_MAX_STATES); i++) {
+            actual_path.push_back(pathfinding::State::create(response->states[i].x, response->states[i].y));
+        }
+    }
+
+    if (response->error != _option(test, "error", PF_OK)) _mismatch(actual_path);
+
+    delete response;
+    pf_graph_destroy(graph);
+}
+
+static bool _same_region(const pathfinding::Region& a, const pathfinding::Region& b) {
+    return a.x == b.x && a.y == b.y && a.w == b.w && a.h == b.h;
+}
+
+// The query is written to a trace and searched again on the graph and query read back from it
+void _check_trace(const pathfinding::Test& test, vector<pathfinding::State>& actual_path) {
+    string path = _scratch_path(test, ".pftr");
+
+    pathfinding::TraceQuery query;
+    query.region = test.region;
+    query.mode = TRACE_MODE_LAZY;
+    query.settings = test.settings;
+    query.initial_x = test.start.x;
+    query.initial_y = test.start.y;
+    query.goals.push_back(pathfinding::Region { test.goal.x, test.goal.y, 1, 1 });
+
+    {
+        pathfinding::TraceWriter writer;
+        if (!writer.open(path)) {
+            _mismatch(actual_path);
+            return;
+        }
+
+        query.graph = writer.write_graph(test.graph);
+        writer.write_query(query);
+    }
+
+    pathfinding::Trace trace;
+    bool read = pathfinding::read_trace(path, trace);
+    filesystem::remove(path);
+
+    if (!read || trace.graphs.size() != 1 || trace.queries.size() != 1) {
+        _mismatch(actual_path);
+        return;
+    }
+
+    const pathfinding::TraceQuery& replayed = trace.queries[0];
+    bool same = replayed.graph == query.graph && replayed.mode == query.mode &&
+        _same_region(replayed.region, query.region) &&
+        replayed.initial_x == query.initial_x && replayed.initial_y == query.initial_y &&
+        replayed.settings.max_jump_height == query.settings.max_jump_height &&
+        replayed.settings.air_stride == query.settings.air_stride &&
+        replayed.goals.size() == 1 && _same_region(replayed.goals[0], query.goals[0]) &&
+        replayed.dynamic_masses.empty();
+    if (!same) {
+        _mismatch(actual_path);
+        return;
+    }
+
+    pathfinding::State initial = pathfinding::State::create(replayed.initial_x, replayed.initial_y);
+    int goal_index;
+    pathfinding::search(trace.graphs[replayed.graph], replayed.settings, replayed.region, initial, replayed.goals, actual_path, goal_index, nullptr, pathfinding::PathOutput_Full, (replayed.mode & TRACE_MODE_LAZY) != 0);
+}
+
+// The count=... cells closest to the goal marker, with prefer_floors=1 the ones standing on a floor first
+void _check_free_cells(const pathfinding::Test& test, vector<pathfinding::State>& actual_path) {
+    vector<pathfinding::FreeCell> cells;
+    pathfinding::closest_free_cells(test.graph, test.settings, vector<pathfinding::Region>(1, test.region),
+        test.goal.x, test.goal.y, _option(test, "prefer_floors", 0) != 0, _option(test, "count", 1), cells);
+
+    for (const pathfinding::FreeCell& cell : cells) actual_path.push_back(pathfinding::State::create(cell.x, cell.y));
+}
+
+// The path found before the X cells turn into floor has to break there and be repaired around them
+void _check_repair(const pathfinding::Test& test, vector<pathfinding::State>& actual_path) {
+    pathfinding::search(test.graph, test.settings, test.region, test.start, test.goal.x, test.goal.y, actual_path);
+
+    pathfinding::Graph edited = test.graph;
+    for (const pathfinding::State& cell : test.edits) edited.set_at(cell.x, cell.y, pathfinding::FLOOR_TILEKIND);
+
+    if (actual_path.empty() || pathfinding::validate_path(edited, test.settings, actual_path) < 0) {
+        _mismatch(actual_path);
+        return;
+    }
+
+    bool repaired = pathfinding::repair_path(edited, test.settings, test.region, actual_path);
+    if (!repaired || pathfinding::validate_path(edited, test.settings, actual_path) >= 0) _mismatch(actual_path);
+}
+
+/*
+ * Ticks realtime_search with lookahead=... expansions until it reaches the goal, which it
+ * has to within steps=... ticks. The path is every cell the agent passed through once.
+ */
+void _check_realtime(const pathfinding::Test& test, vector<pathfinding::State>& actual_path) {
+    vector<pathfinding::Region> goals(1, pathfinding::Region { test.goal.x, test.goal.y, 1, 1 });
+    pathfinding::LearnedHeuristic heuristic(goals);
+    pathfinding::State current = test.start;
+    unordered_set<pathfinding::State> passed;
+
+    int lookahead = _option(test, "lookahead", 4);
+    int steps = _option(test, "steps", 100);
+    int goal_index = -1;
+
+    vector<pathfinding::State> moves;
+    for (int step = 0; step < steps && goal_index < 0; step++) {
+        if (!pathfinding::realtime_search(test.graph, test.settings, test.region, current, lookahead, heuristic, moves, goal_index)) break;
+
+        for (const pathfinding::State& move : moves) {
+            if (passed.insert(pathfinding::State::create(move.x, move.y)).second) actual_path.push_back(move);
+        }
+
+        current = moves.back();
+    }
+
+    if (goal_index < 0) _mismatch(actual_path);
+}
+
+/*
+ * Searches the downsampled map first and the full one when that misses, the way far away
+ * agents are searched. lod=0 expects the coarse search to miss, lod=1 to find the path.
+ */
+void _check_lod(const pathfinding::Test& test, vector<pathfinding::State>& actual_path) {
+    pathfinding::Graph coarse;
+    pathfinding::downsample(test.graph, coarse);
+
+    vector<pathfinding::Region> goals(1, pathfinding::Region { test.goal.x, test.goal.y, 1, 1 });
+    int goal_index;
+
+    bool lod = pathfinding::coarse_search(coarse, test.settings, test.region, test.start, goals, actual_path, goal_index);
+    if (!lod) pathfinding::search(test.graph, test.settings, test.region, test.start, goals, actual_path, goal_index);
+
+    if (lod != (_option(test, "lod", 1) != 0)) _mismatch(actual_path);
+}
+
+/*
+ * Builds a path database between the start and the goal, saves it and finds the path in
+ * the copy loaded back, which has to match the one built. truncate=... cuts that many
+ * bytes off the end of the file, the load then has to be refused.
+ */
+void _check_database(const pathfinding::Test& test, vector<pathfinding::State>& actual_path) {
+    vector<pathfinding::State> points;
+    points.push_back(pathfinding::State::create(test.start.x, test.start.y));
+    points.push_back(pathfinding::State::create(test.goal.x, test.goal.y));
+
+    pathfinding::PathDatabase built;
+    built.build(test.graph, test.settings, test.region, points);
+
+    string path = _scratch_path(test, ".pfpd");
+    bool saved = built.save(path);
+
+    int truncate = _option(test, "truncate", 0);
+    if (saved && truncate > 0) filesystem::resize_file(path, filesystem::file_size(path) - truncate);
+
+    pathfinding::PathDatabase loaded;
+    bool refused = !loaded.load(path);
+    filesystem::remove(path);
+
+    if (!saved || refused != (truncate > 0)) {
+        _mismatch(actual_path);
+        return;
+    }
+
+    if (refused) return;
+
+    vector<pathfinding::State> expected;
+    built.find(test.graph, 0, 1, expected);
+    loaded.find(test.graph, loaded.point_index(points[0].x, points[0].y), loaded.point_index(points[1].x, points[1].y), actual_path);
+
+    if (actual_path != expected) _mismatch(actual_path);
+}
+
+void _run_test(const pathfinding::Test& test, vector<pathfinding::State>& actual_path) {
+    actual_path.clear();
+
+    if (test.check == "capi") {
+        _check_capi(test, actual_path);
+        return;
+    }
+
+    if (test.check == "database") {
+        _check_database(test, actual_path);
+        return;
+    }
+
+    if (test.check == "free_cells") {
+        _check_free_cells(test, actual_path);
+        return;
+    }
+
+    if (test.check == "lod") {
+        _check_lod(test, actual_path);
+        return;
+    }
+
+    if (test.check == "realtime") {
+        _check_realtime(test, actual_path);
+        return;
+    }
+
+    if (test.check == "repair") {
+        _check_repair(test, actual_path);
+        return;
+    }
+
+    if (test.check == "trace") {
+        _check_trace(test, actual_path);
+        return;
+    }
+
+    pathfinding::search(test.graph, test.settings, test.region, test.start, test.goal.x, test.goal.y, actual_path);
+}
+
 bool _run_tests(vector<pathfinding::Test>& tests, pathfinding::Test& failed_test, vector<pathfinding::State>& actual_path, int& test_num) {
     for (int i = 0; i < tests.size(); i++) {
         test_num = i + 1;
         failed_test = tests[i];
 
-        pathfinding::search(
-            failed_test.graph, failed_test.settings,
-            failed_test.start, failed_test.goal.x, failed_test.goal.y,
-            actual_path);
+        _run_test(failed_test, actual_path);
 
         if (actual_path.size() != failed_test.expected_path.size()) return false;
 
@@ -1,7 +1,9 @@
 #pragma once
 
+#include <unordered_map>
 #include <unordered_set>
 #include <string>
+#include <vector>
 
 #include "graph.hpp"
 
@@ -10,10 +12,18 @@ namespace pathfinding {
 struct Test {
     std::string tag;
     pathfinding::Graph graph;
+    pathfinding::Region region;
     pathfinding::State start;
     pathfinding::State goal;
     pathfinding::Settings settings;
     std::unordered_set<pathfinding::State> expected_path;
+
+    // Cells marked X, air until a check turns them into floor
+    std::vector<pathfinding::State> edits;
+
+    // What runs on the map, search unless the settings line has check=..., see test.cpp
+    std::string check;
+    std::unordered_map<std::string, std::string> options;
 };
 
 }
\ No newline at end of file
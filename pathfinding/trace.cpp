@@ -0,0 +1,303 @@
+#include "trace.hpp"
+
+#include <cstring>
+
+#define TRACE_BYTE_ORDER 0x01020304
+
+using namespace pathfinding;
+
+enum TraceRecord {
+    TraceRecord_Page = 'P',
+    TraceRecord_CostPage = 'C',
+    TraceRecord_Graph = 'G',
+    TraceRecord_Query = 'Q',
+};
+
+bool TraceWriter::open(const std::string& path) {
+    close();
+
+    _file = fopen(path.c_str(), "wb");
+    if (!_file) return false;
+
+    uint32_t version = TRACE_VERSION;
+    uint32_t byte_order = TRACE_BYTE_ORDER;
+    _write(TRACE_MAGIC, 4);
+    _write(&version, sizeof(version));
+    _write(&byte_order, sizeof(byte_order));
+
+    return true;
+}
+
+void TraceWriter::close() {
+    if (_file) fclose(_file);
+
+    _file = nullptr;
+    _next_graph = 0;
+    _pages.clear();
+    _cost_pages.clear();
+}
+
+void TraceWriter::_write(const void* data, size_t size) {
+    fwrite(data, 1, size, _file);
+}
+
+void TraceWriter::_write_region(const Region& region) {
+    int32_t values[4] = { region.x, region.y, region.w, region.h };
+    _write(values, sizeof(values));
+}
+
+uint32_t TraceWriter::write_graph(const Graph& graph) {
+    if (!_file) return 0;
+
+    std::vector<std::pair<int64_t, uint32_t>> entries;
+
+    graph.for_each_page([this, &entries](int32_t page_x, int32_t page_y, const PageRef& page) {
+        auto it = _pages.find(page.get());
+        uint32_t id;
+
+        if (it == _pages.end()) {
+            id = (uint32_t)_pages.size();
+            _pages[page.get()] = std::make_pair(id, page);
+
+            uint8_t tag = TraceRecord_Page;
+            _write(&tag, sizeof(tag));
+            _write(&id, sizeof(id));
+            _write(page->tiles, sizeof(Page));
+        }
+        else id = it->second.first;
+
+        entries.push_back(std::make_pair(page_key(page_x, page_y), id));
+    });
+
+    std::vector<std::pair<int64_t, uint32_t>> cost_entries;
+
+    graph.for_each_cost_page([this, &cost_entries](int32_t page_x, int32_t page_y, const CostPageRef& page) {
+        auto it = _cost_pages.find(page.get());
+        uint32_t id;
+
+        if (it == _cost_pages.end()) {
+            id = (uint32_t)_cost_pages.size();
+            _cost_pages[page.get()] = std::make_pair(id, page);
+
+            uint8_t tag = TraceRecord_CostPage;
+            _write(&tag, sizeof(tag));
+            _write(&id, sizeof(id));
+            _write(page->costs, sizeof(CostPage));
+        }
+        else id = it->second.first;
+
+        cost_entries.push_back(std::make_pair(page_key(page_x, page_y), id));
+    });
+
+    uint32_t id = _next_graph++;
+    uint32_t count = (uint32_t)entries.size();
+
+    uint8_t tag = TraceRecord_Graph;
+    _write(&tag, sizeof(tag));
+    _write(&id, sizeof(id));
+    _write(&count, sizeof(count));
+
+    for (auto& entry : entries) {
+        _write(&entry.first, sizeof(entry.first));
+        _write(&entry.second, sizeof(entry.second));
+    }
+
+    count = (uint32_t)cost_entries.size();
+    _write(&count, sizeof(count));
+
+    for (auto& entry : cost_entries) {
+        _write(&entry.first, sizeof(entry.first));
+        _write(&entry.second, sizeof(entry.second));
+    }
+
+    return id;
+}
+
+void TraceWriter::write_query(const TraceQuery& query) {
+    if (!_file) return;
+
+    uint8_t tag = TraceRecord_Query;
+    _write(&tag, sizeof(tag));
+    _write(&query.graph, sizeof(query.graph));
+    _write_region(query.region);
+    _write(&query.mode, sizeof(query.mode));
+
+    int32_t settings[4] = {
+        query.settings.max_jump_height,
+        (int32_t)query.settings.air_stride,
+        (int32_t)query.settings.width,
+        (int32_t)query.settings.height
+    };
+    uint8_t ledge_hang = query.settings.ledge_hang ? 1 : 0;
+    _write(settings, sizeof(settings));
+    _write(&ledge_hang, sizeof(ledge_hang));
+
+    const CostProfile& profile = query.settings.costs;
+    int32_t costs[6] = { profile.up, profile.down, profile.level, profile.ledge_climb, profile.character, profile.hazard };
+    _write(costs, sizeof(costs));
+
+    _write(&query.initial_x, sizeof(query.initial_x));
+    _write(&query.initial_y, sizeof(query.initial_y));
+
+    uint32_t goals = (uint32_t)query.goals.size();
+    _write(&goals, sizeof(goals));
+    for (const Region& goal : query.goals) _write_region(goal);
+
+    uint32_t masses = (uint32_t)query.dynamic_masses.size();
+    _write(&masses, sizeof(masses));
+    for (const Region& mass : query.dynamic_masses) _write_region(mass);
+}
+
+template <typename T>
+static inline bool _read(FILE* file, T& value) {
+    return fread(&value, sizeof(T), 1, file) == 1;
+}
+
+static inline bool _read_region(FILE* file, Region& region) {
+    int32_t values[4];
+    if (fread(values, sizeof(values), 1, file) != 1) return false;
+
+    region.x = values[0];
+    region.y = values[1];
+    region.w = values[2];
+    region.h = values[3];
+    return true;
+}
+
+bool pathfinding::read_trace(const std::string& path, Trace& trace) {
+    trace.graphs.clear();
+    trace.queries.clear();
+
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) return false;
+
+    char magic[4];
+    uint32_t version, byte_order;
+    if (fread(magic, 4, 1, file) != 1 || memcmp(magic, TRACE_MAGIC, 4) != 0 ||
+        !_read(file, version) || version != TRACE_VERSION ||
+        !_read(file, byte_order) || byte_order != TRACE_BYTE_ORDER) {
+        fclose(file);
+        return false;
+    }
+
+    std::vector<PageRef> pages;
+    std::vector<CostPageRef> cost_pages;
+    bool ok = true;
+    uint8_t tag;
+
+    // A truncated last record is dropped, the trace may have been cut off by a crash
+    while (ok && _read(file, tag)) {
+        switch (tag) {
+            case TraceRecord_Page:
+            {
+                uint32_t id;
+                auto page = std::make_shared<Page>();
+                if (!_read(file, id) || fread(page->tiles, sizeof(Page), 1, file) != 1) {
+                    ok = false;
+                    break;
+                }
+
+                if (id >= pages.size()) pages.resize(id + 1);
+                pages[id] = page;
+                break;
+            }
+            case TraceRecord_CostPage:
+            {
+                uint32_t id;
+                auto page = std::make_shared<CostPage>();
+                if (!_read(file, id) || fread(page->costs, sizeof(CostPage), 1, file) != 1) {
+                    ok = false;
+                    break;
+                }
+
+                if (id >= cost_pages.size()) cost_pages.resize(id + 1);
+                cost_pages[id] = page;
+                break;
+            }
+            case TraceRecord_Graph:
+            {
+                uint32_t id, count;
+                if (!_read(file, id) || !_read(file, count)) {
+                    ok = false;
+                    break;
+                }
+
+                if (id >= trace.graphs.size()) trace.graphs.resize(id + 1);
+                Graph& graph = trace.graphs[id];
+
+                for (uint32_t i = 0; ok && i < count; i++) {
+                    int64_t key;
+                    uint32_t page;
+                    if (!_read(file, key) || !_read(file, page) || page >= pages.size()) {
+                        ok = false;
+                        break;
+                    }
+
+                    graph.set_page(page_key_x(key), page_key_y(key), pages[page]);
+                }
+
+                ok = ok && _read(file, count);
+                for (uint32_t i = 0; ok && i < count; i++) {
+                    int64_t key;
+                    uint32_t page;
+                    if (!_read(file, key) || !_read(file, page) || page >= cost_pages.size()) {
+                        ok = false;
+                        break;
+                    }
+
+                    graph.set_cost_page(page_key_x(key), page_key_y(key), cost_pages[page]);
+                }
+                break;
+            }
+            case TraceRecord_Query:
+            {
+                TraceQuery query;
+                int32_t settings[4];
+                int32_t costs[6];
+                uint8_t ledge_hang;
+                uint32_t count;
+
+                ok = _read(file, query.graph) && _read_region(file, query.region) && _read(file, query.mode) &&
+                    fread(settings, sizeof(settings), 1, file) == 1 && _read(file, ledge_hang) &&
+                    fread(costs, sizeof(costs), 1, file) == 1 &&
+                    _read(file, query.initial_x) && _read(file, query.initial_y);
+
+                query.settings.max_jump_height = settings[0];
+                query.settings.air_stride = settings[1];
+                query.settings.width = settings[2];
+                query.settings.height = settings[3];
+                query.settings.ledge_hang = ledge_hang != 0;
+
+                query.settings.costs.up = costs[0];
+                query.settings.costs.down = costs[1];
+                query.settings.costs.level = costs[2];
+                query.settings.costs.ledge_climb = costs[3];
+                query.settings.costs.character = costs[4];
+                query.settings.costs.hazard = costs[5];
+
+                ok = ok && _read(file, count);
+                for (uint32_t i = 0; ok && i < count; i++) {
+                    Region goal;
+                    ok = _read_region(file, goal);
+                    query.goals.push_back(goal);
+                }
+
+                ok = ok && _read(file, count);
+                for (uint32_t i = 0; ok && i < count; i++) {
+                    Region mass;
+                    ok = _read_region(file, mass);
+                    query.dynamic_masses.push_back(mass);
+                }
+
+                if (ok && query.graph < trace.graphs.size()) trace.queries.push_back(query);
+                break;
+            }
+            default:
+                ok = false;
+                break;
+        }
+    }
+
+    fclose(file);
+    return true;
+}
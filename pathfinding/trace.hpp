@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "graph.hpp"
+#include "settings.hpp"
+
+#define TRACE_MAGIC "PFTR"
+#define TRACE_VERSION 3
+
+// Flags of TraceQuery::mode
+#define TRACE_MODE_WIDENING 0x1
+#define TRACE_MODE_LAZY 0x2
+
+// Bits 8-15 of TraceQuery::mode, the threads parallel_search was given or 1
+#define TRACE_MODE_THREADS_SHIFT 8
+#define TRACE_MODE_THREADS_MASK 0xFF
+
+namespace pathfinding {
+
+/*
+ * Everything needed to re-run a query outside the engine. The graph is the one the
+ * query saw before its dynamic masses were added.
+ */
+struct TraceQuery {
+    uint32_t graph;
+    Region region;
+    // How the query was searched, with TRACE_MODE_WIDENING region is the largest window search_widening could grow to
+    uint32_t mode;
+    Settings settings;
+    int32_t initial_x;
+    int32_t initial_y;
+    std::vector<Region> goals;
+    std::vector<Region> dynamic_masses;
+};
+
+struct Trace {
+    std::vector<Graph> graphs;
+    std::vector<TraceQuery> queries;
+};
+
+/*
+ * Appends records to a trace file:
+ *   'P' page       id, tiles
+ *   'C' cost page  id, costs
+ *   'G' graph      id, page count, (page key, page id) per page, then the same for cost pages
+ *   'Q' query      see TraceQuery
+ * Pages are immutable once shared, so each one is written once and referenced after.
+ */
+class TraceWriter {
+public:
+    TraceWriter() : _file(nullptr), _next_graph(0) {}
+    ~TraceWriter() { close(); }
+
+    bool open(const std::string& path);
+    void close();
+
+    inline bool is_open() const { return _file != nullptr; }
+
+    // Returns the id queries use to refer to the graph
+    uint32_t write_graph(const Graph& graph);
+    void write_query(const TraceQuery& query);
+
+private:
+    void _write(const void* data, size_t size);
+    void _write_region(const Region& region);
+
+    FILE* _file;
+    uint32_t _next_graph;
+
+    // Keeps written pages alive so their address can't be reused by a different page
+    std::unordered_map<const Page*, std::pair<uint32_t, PageRef>> _pages;
+    std::unordered_map<const CostPage*, std::pair<uint32_t, CostPageRef>> _cost_pages;
+};
+
+bool read_trace(const std::string& path, Trace& trace);
+
+}
@@ -4,6 +4,7 @@
 #include "grid.hpp"
 #include "gridded_graph.hpp"
 #include "pathfinder.hpp"
+#include "path_result.hpp"
 #include "character_parameters.hpp"
 
 void register_pathfinder_types() {
@@ -11,6 +12,7 @@ void register_pathfinder_types() {
     ClassDB::register_class<GriddedGraph>();
     ClassDB::register_class<Pathfinder>();
     ClassDB::register_class<CharacterParameters>();
+    ClassDB::register_class<PathResult>();
 }
 
 void unregister_pathfinder_types() {